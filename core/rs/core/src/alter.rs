@@ -76,11 +76,12 @@ unsafe fn compact_post_alter(
         // First delete entries that no longer have a column
         let sql = format!(
             "DELETE FROM \"{tbl_name_ident}__crsql_clock\" WHERE \"col_name\" NOT IN (
-              SELECT name FROM pragma_table_info('{tbl_name_val}') UNION SELECT '{cl_sentinel}'
+              SELECT name FROM pragma_table_info('{tbl_name_val}') UNION SELECT '{cl_sentinel}' UNION SELECT '{row_clock}'
             )",
             tbl_name_ident = crate::util::escape_ident(tbl_name_str),
             tbl_name_val = crate::util::escape_ident_as_value(tbl_name_str),
             cl_sentinel = crate::c::DELETE_SENTINEL,
+            row_clock = crate::consts::ROW_CLOCK,
         );
         db.exec_safe(&sql)?;
 
@@ -0,0 +1,340 @@
+use alloc::boxed::Box;
+use alloc::ffi::CString;
+use alloc::format;
+use alloc::vec::Vec;
+use bytes::Buf;
+use core::ffi::{c_char, c_int};
+use core::mem;
+use core::ptr::null_mut;
+use sqlite::Connection;
+use sqlite_nostd as sqlite;
+use sqlite_nostd::{sqlite3, Context, ResultCode, Value};
+
+use crate::c::crsql_ExtData;
+use crate::changes_vtab_write::{merge_row, Change, MergeValue};
+use crate::changeset::{is_changeset, ChangesetReader};
+use crate::consts::{MAX_TBL_NAME_LEN, SITE_ID_LEN};
+use crate::pack_columns::{unpack_columns, unpack_columns_from, ColumnValue};
+use crate::site_id_cache::site_id_cache;
+use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+
+// Changes are read and merged this many at a time when not sorting them.
+const APPLY_CHUNK_SIZE: usize = 256;
+
+/**
+ * Applies a batch of changes without going through `crsql_changes`.
+ *
+ * The batch is either a compact changeset from `crsql_changeset` or a blob of
+ * packed records laid end to end, each packed like
+ * `crsql_pack_columns([table], pk, cid, val, col_version, db_version, site_id, cl, seq)`.
+ * The whole batch is applied or none of it is.
+ *
+ * `select crsql_apply_changes(?)` returns the number of rows the batch impacted.
+ *
+ * Batches come ordered by `db_version, seq` which jumps from table to table and
+ * row to row. `select crsql_apply_changes(?, n)` reads `n` changes at a time and
+ * merges them ordered by table and primary key instead so that the changes to
+ * a row are merged together. Changes to the same row keep their relative order.
+ */
+pub unsafe extern "C" fn crsql_apply_changes(
+    ctx: *mut sqlite::context,
+    argc: i32,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc != 1 && argc != 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_apply_changes. Provide the changeset blob and, optionally, a sort window.",
+        );
+        return;
+    }
+    let args = sqlite::args!(argc, argv);
+    let window = if argc == 2 { args[1].int64() } else { 0 };
+    if window < 0 {
+        ctx.result_error("crsql_apply_changes sort window must not be negative");
+        return;
+    }
+    let ext_data = ctx.user_data() as *mut crsql_ExtData;
+    let db = ctx.db_handle();
+
+    if let Err(_) = db.exec_safe("SAVEPOINT apply_changes;") {
+        ctx.result_error("failed to start apply_changes savepoint");
+        return;
+    }
+
+    let mut errmsg: *mut c_char = null_mut();
+    let result = apply_changes(db, ext_data, args[0].blob(), window as usize, &mut errmsg);
+    // Nothing tells us if an enclosing savepoint is rolled back so site ordinals
+    // assigned by the batch are only remembered for the length of the batch.
+    site_id_cache(ext_data).rollback_to_savepoint();
+    match result {
+        Ok(rows_impacted) => {
+            if let Err(_) = db.exec_safe("RELEASE apply_changes;") {
+                ctx.result_error("failed to release apply_changes savepoint");
+                return;
+            }
+            sqlite::result_int(ctx, rows_impacted);
+        }
+        Err(rc) => {
+            let _ = db.exec_safe("ROLLBACK TO apply_changes; RELEASE apply_changes;");
+            if errmsg.is_null() {
+                ctx.result_error("failed to apply changes");
+            } else {
+                sqlite::result_error(ctx, errmsg, -1);
+                drop(CString::from_raw(errmsg));
+            }
+            sqlite::result_error_code(ctx, rc as c_int);
+        }
+    }
+}
+
+unsafe fn apply_changes(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    changeset: &[u8],
+    window: usize,
+    errmsg: *mut *mut c_char,
+) -> Result<c_int, ResultCode> {
+    // Table infos are resolved once for the whole batch rather than once per change.
+    let rc = crsql_ensure_table_infos_are_up_to_date(db, ext_data, errmsg);
+    if rc != ResultCode::OK as i32 {
+        return Err(ResultCode::ERROR);
+    }
+    let tbl_infos =
+        mem::ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>));
+
+    let rows_impacted_before = (*ext_data).rowsImpacted;
+    // changesets tend to be grouped by table so remember the last one we looked up
+    let mut tbl_info_index: Option<usize> = None;
+    let sort = window > 0;
+    let chunk_size = if sort { window } else { APPLY_CHUNK_SIZE };
+    if is_changeset(changeset) {
+        let mut reader = ChangesetReader::new(changeset)?;
+        let mut entries = Vec::new();
+        loop {
+            let entry = reader.next()?;
+            let done = entry.is_none();
+            if let Some(entry) = entry {
+                entries.push(entry);
+            }
+            if entries.len() == chunk_size || (done && !entries.is_empty()) {
+                let mut changes = entries.iter().map(|x| x.as_change()).collect();
+                apply_chunk(
+                    db,
+                    ext_data,
+                    &tbl_infos,
+                    &mut tbl_info_index,
+                    &mut changes,
+                    sort,
+                    errmsg,
+                )?;
+                entries.clear();
+            }
+            if done {
+                break;
+            }
+        }
+    } else {
+        let mut buf = changeset;
+        let mut records = Vec::new();
+        loop {
+            let done = !buf.has_remaining();
+            if !done {
+                records.push(unpack_columns_from(&mut buf)?);
+            }
+            if records.len() == chunk_size || (done && !records.is_empty()) {
+                let mut changes = records
+                    .iter()
+                    .map(|x| decode_change(x, errmsg))
+                    .collect::<Result<_, _>>()?;
+                apply_chunk(
+                    db,
+                    ext_data,
+                    &tbl_infos,
+                    &mut tbl_info_index,
+                    &mut changes,
+                    sort,
+                    errmsg,
+                )?;
+                records.clear();
+            }
+            if done {
+                break;
+            }
+        }
+    }
+
+    Ok((*ext_data).rowsImpacted - rows_impacted_before)
+}
+
+/**
+ * The changes to one row of a chunk, checked and resolved ahead of merging.
+ */
+struct RowChanges {
+    tbl_info_index: usize,
+    unpacked_pks: Vec<ColumnValue>,
+    // the changes to the row are `changes[start..end]` of the chunk
+    start: usize,
+    end: usize,
+}
+
+/**
+ * Merges a chunk of changes a row at a time.
+ * Changes to the same row are only merged together if they're next to each other
+ * unless `sort` is set.
+ *
+ * Everything that doesn't touch the database is done for the whole chunk up
+ * front: checking the changes, resolving their tables and unpacking primary
+ * keys. What's left, merging the rows, is then only lookups and writes.
+ */
+unsafe fn apply_chunk(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_infos: &Vec<TableInfo>,
+    tbl_info_index: &mut Option<usize>,
+    changes: &mut Vec<Change>,
+    sort: bool,
+    errmsg: *mut *mut c_char,
+) -> Result<(), ResultCode> {
+    if sort {
+        // a stable sort so changes to the same row keep their order
+        changes.sort_by(|a, b| (a.tbl, a.pks).cmp(&(b.tbl, b.pks)));
+    }
+    let rows = split_rows(tbl_infos, tbl_info_index, changes, errmsg)?;
+    for row in rows {
+        merge_row(
+            db,
+            ext_data,
+            &tbl_infos[row.tbl_info_index],
+            &row.unpacked_pks,
+            &changes[row.start..row.end],
+            errmsg,
+        )?;
+    }
+    Ok(())
+}
+
+fn split_rows(
+    tbl_infos: &Vec<TableInfo>,
+    tbl_info_index: &mut Option<usize>,
+    changes: &Vec<Change>,
+    errmsg: *mut *mut c_char,
+) -> Result<Vec<RowChanges>, ResultCode> {
+    for change in changes {
+        if change.tbl.len() > MAX_TBL_NAME_LEN as usize {
+            return Err(set_err(errmsg, "crsql - table name exceeded max length"));
+        }
+        if change.cid.len() > MAX_TBL_NAME_LEN as usize {
+            return Err(set_err(errmsg, "crsql - column name exceeded max length"));
+        }
+        if change.site_id.len() > SITE_ID_LEN as usize {
+            return Err(set_err(errmsg, "crsql - site id exceeded max length"));
+        }
+    }
+
+    let mut rows = Vec::new();
+    let mut start = 0;
+    for end in 1..=changes.len() {
+        if end == changes.len() || !is_same_row(&changes[start], &changes[end]) {
+            rows.push(RowChanges {
+                tbl_info_index: find_tbl_info(
+                    tbl_infos,
+                    tbl_info_index,
+                    changes[start].tbl,
+                    errmsg,
+                )?,
+                unpacked_pks: unpack_columns(changes[start].pks)?,
+                start,
+                end,
+            });
+            start = end;
+        }
+    }
+    Ok(rows)
+}
+
+fn is_same_row(a: &Change, b: &Change) -> bool {
+    a.tbl == b.tbl && a.pks == b.pks
+}
+
+fn find_tbl_info(
+    tbl_infos: &Vec<TableInfo>,
+    tbl_info_index: &mut Option<usize>,
+    tbl: &str,
+    errmsg: *mut *mut c_char,
+) -> Result<usize, ResultCode> {
+    let index = match *tbl_info_index {
+        Some(i) if tbl_infos[i].tbl_name == tbl => i,
+        _ => match tbl_infos.iter().position(|x| x.tbl_name == tbl) {
+            Some(i) => i,
+            None => {
+                let err = CString::new(format!(
+                    "crsql - could not find the schema information for table {}",
+                    tbl
+                ))?;
+                unsafe { *errmsg = err.into_raw() };
+                return Err(ResultCode::ERROR);
+            }
+        },
+    };
+    *tbl_info_index = Some(index);
+    Ok(index)
+}
+
+fn decode_change<'a>(
+    record: &'a Vec<ColumnValue>,
+    errmsg: *mut *mut c_char,
+) -> Result<Change<'a>, ResultCode> {
+    if record.len() != 9 {
+        return Err(set_err(errmsg, "crsql - a change must have 9 columns"));
+    }
+
+    let tbl = match &record[0] {
+        ColumnValue::Text(tbl) => tbl.as_str(),
+        _ => return Err(set_err(errmsg, "crsql - invalid table name in change")),
+    };
+    let pks = match &record[1] {
+        ColumnValue::Blob(pks) => pks.as_slice(),
+        _ => return Err(set_err(errmsg, "crsql - invalid pk in change")),
+    };
+    let cid = match &record[2] {
+        ColumnValue::Text(cid) => cid.as_str(),
+        _ => return Err(set_err(errmsg, "crsql - invalid column name in change")),
+    };
+    let site_id: &[u8] = match &record[6] {
+        ColumnValue::Blob(site_id) => site_id,
+        ColumnValue::Null => &[],
+        _ => return Err(set_err(errmsg, "crsql - invalid site id in change")),
+    };
+
+    let mut ints = [0; 4];
+    for (i, col) in [4, 5, 7, 8].iter().enumerate() {
+        ints[i] = match record[*col] {
+            ColumnValue::Integer(v) => v,
+            _ => {
+                return Err(set_err(
+                    errmsg,
+                    "crsql - versions and cl of a change must be integers",
+                ))
+            }
+        };
+    }
+
+    Ok(Change {
+        tbl,
+        pks,
+        cid,
+        val: MergeValue::Unpacked(&record[3]),
+        col_vrsn: ints[0],
+        db_vrsn: ints[1],
+        site_id,
+        cl: ints[2],
+        seq: ints[3],
+    })
+}
+
+fn set_err(errmsg: *mut *mut c_char, msg: &str) -> ResultCode {
+    if let Ok(err) = CString::new(msg) {
+        unsafe { *errmsg = err.into_raw() };
+    }
+    ResultCode::MISMATCH
+}
@@ -9,12 +9,14 @@ use sqlite_nostd as sqlite;
 
 /**
  * Backfills rows in a table with clock values.
+ * `packed_pks` is whether the lookaside has a `__crsql_packed` column.
  */
 pub fn backfill_table(
     db: *mut sqlite3,
     table: &str,
     pk_cols: &Vec<ColumnInfo>,
     non_pk_cols: &Vec<ColumnInfo>,
+    packed_pks: bool,
     is_commit_alter: bool,
     no_tx: bool,
 ) -> Result<ResultCode, ResultCode> {
@@ -42,6 +44,7 @@ pub fn backfill_table(
             table,
             pk_cols,
             &non_pk_cols_refs,
+            packed_pks,
             is_commit_alter,
         ),
         Err(e) => Err(e),
@@ -55,7 +58,9 @@ pub fn backfill_table(
         return Err(e);
     }
 
-    if let Err(e) = backfill_missing_columns(db, table, pk_cols, non_pk_cols, is_commit_alter) {
+    if let Err(e) =
+        backfill_missing_columns(db, table, pk_cols, non_pk_cols, packed_pks, is_commit_alter)
+    {
         if !no_tx {
             db.exec_safe("ROLLBACK")?;
         }
@@ -80,6 +85,7 @@ fn create_clock_rows_from_stmt(
     table: &str,
     pk_cols: &Vec<ColumnInfo>,
     non_pk_cols: &Vec<&ColumnInfo>,
+    packed_pks: bool,
     is_commit_alter: bool,
 ) -> Result<ResultCode, ResultCode> {
     let select_key = db.prepare_v2(&format!(
@@ -87,15 +93,26 @@ fn create_clock_rows_from_stmt(
         table = crate::util::escape_ident(table),
         pk_where_conditions = crate::util::where_list(pk_cols, None)?
     ))?;
+    let pk_values = if packed_pks {
+        crate::util::numbered_binding_list(pk_cols.len())
+    } else {
+        crate::util::binding_list(pk_cols.len())
+    };
     let create_key = db.prepare_v2(&format!(
-        "INSERT INTO \"{table}__crsql_pks\" ({pk_cols}) VALUES ({pk_values}) RETURNING __crsql_key",
+        "INSERT INTO \"{table}__crsql_pks\" ({pk_cols}{packed_col}) VALUES ({pk_values}{packed_value}) RETURNING __crsql_key",
         table = crate::util::escape_ident(table),
         pk_cols = pk_cols
             .iter()
             .map(|f| format!("\"{}\"", crate::util::escape_ident(&f.name)))
             .collect::<Vec<_>>()
             .join(", "),
-        pk_values = pk_cols.iter().map(|_| "?").collect::<Vec<_>>().join(", "),
+        pk_values = pk_values,
+        packed_col = if packed_pks { ", __crsql_packed" } else { "" },
+        packed_value = if packed_pks {
+            format!(", crsql_pack_columns({})", pk_values)
+        } else {
+            String::from("")
+        },
     ))?;
     // We do not grab nextdbversion on migration.
     // The idea is that other nodes will apply the same migration
@@ -107,37 +124,69 @@ fn create_clock_rows_from_stmt(
     let sql = format!(
         "INSERT OR IGNORE INTO \"{table}__crsql_clock\"
           (key, col_name, col_version, db_version, seq) VALUES
-          (?, ?, 1, {dbversion_getter}, crsql_increment_and_get_seq())",
+          (?, ?, 1, ?, ?)",
         table = crate::util::escape_ident(table),
-        dbversion_getter = if is_commit_alter {
-            "crsql_db_version()"
-        } else {
-            "crsql_next_db_version()"
-        }
     );
     let write_stmt = db.prepare_v2(&sql)?;
 
+    // The db version and first seq are looked up once, when the first clock row is
+    // written, and bound to every row. The seqs handed out are reserved at the end.
+    let mut versions: Option<(sqlite::int64, sqlite::int64)> = None;
+    let mut seqs_used: sqlite::int64 = 0;
     while read_stmt.step()? == ResultCode::ROW {
         let key = get_or_create_key(&select_key, &create_key, pk_cols, &read_stmt)?;
+        let (db_version, first_seq) = match versions {
+            Some(versions) => versions,
+            None => *versions.insert(get_backfill_versions(db, is_commit_alter)?),
+        };
         write_stmt.bind_int64(1, key)?;
+        write_stmt.bind_int64(3, db_version)?;
 
         for col in non_pk_cols.iter() {
             // We even backfill default values since we can't differentiate between an explicit
             // reset to a default vs an implicit set to default on create. Do we? I don't think we do set defaults.
             write_stmt.bind_text(2, &col.name, Destructor::STATIC)?;
+            write_stmt.bind_int64(4, first_seq + seqs_used)?;
+            seqs_used += 1;
             write_stmt.step()?;
             write_stmt.reset()?;
         }
         if non_pk_cols.len() == 0 {
             write_stmt.bind_text(2, crate::c::INSERT_SENTINEL, Destructor::STATIC)?;
+            write_stmt.bind_int64(4, first_seq + seqs_used)?;
+            seqs_used += 1;
             write_stmt.step()?;
             write_stmt.reset()?;
         }
     }
 
+    if seqs_used > 0 {
+        let reserve_stmt = db.prepare_v2("SELECT crsql_increment_and_get_seq(?)")?;
+        reserve_stmt.bind_int64(1, seqs_used)?;
+        reserve_stmt.step()?;
+    }
+
     Ok(ResultCode::OK)
 }
 
+/**
+ * The db version and first seq to give backfilled clock rows.
+ */
+fn get_backfill_versions(
+    db: *mut sqlite3,
+    is_commit_alter: bool,
+) -> Result<(sqlite::int64, sqlite::int64), ResultCode> {
+    let stmt = db.prepare_v2(if is_commit_alter {
+        "SELECT crsql_db_version(), crsql_get_seq()"
+    } else {
+        "SELECT crsql_next_db_version(), crsql_get_seq()"
+    })?;
+    if stmt.step()? != ResultCode::ROW {
+        return Err(ResultCode::ERROR);
+    }
+    Ok((stmt.column_int64(0), stmt.column_int64(1)))
+}
+
 fn get_or_create_key(
     select_stmt: &ManagedStmt,
     create_stmt: &ManagedStmt,
@@ -181,10 +230,11 @@ fn backfill_missing_columns(
     table: &str,
     pk_cols: &Vec<ColumnInfo>,
     non_pk_cols: &Vec<ColumnInfo>,
+    packed_pks: bool,
     is_commit_alter: bool,
 ) -> Result<ResultCode, ResultCode> {
     for non_pk_col in non_pk_cols {
-        fill_column(db, table, pk_cols, &non_pk_col, is_commit_alter)?;
+        fill_column(db, table, pk_cols, &non_pk_col, packed_pks, is_commit_alter)?;
     }
 
     Ok(ResultCode::OK)
@@ -197,12 +247,18 @@ fn fill_column(
     table: &str,
     pk_cols: &Vec<ColumnInfo>,
     non_pk_col: &ColumnInfo,
+    packed_pks: bool,
     is_commit_alter: bool,
 ) -> Result<ResultCode, ResultCode> {
     // Only fill rows for which
     // - a row does not exist for that pk combo _and_ the cid in the clock table.
     // - the value is not the default value for that column.
-    let dflt_value = get_dflt_value(db, table, &non_pk_col.name)?;
+    // The row clock stands for every column so is always filled.
+    let dflt_value = if non_pk_col.cid < 0 {
+        None
+    } else {
+        get_dflt_value(db, table, &non_pk_col.name)?
+    };
     let sql = format!(
         "SELECT {pk_cols} FROM {table} as t1
           JOIN \"{table}__crsql_pks\" as t2 ON {pk_on_conditions}
@@ -234,5 +290,13 @@ fn fill_column(
 
     // TODO: rm clone?
     let non_pk_cols = vec![non_pk_col];
-    create_clock_rows_from_stmt(read_stmt, db, table, pk_cols, &non_pk_cols, is_commit_alter)
+    create_clock_rows_from_stmt(
+        read_stmt,
+        db,
+        table,
+        pk_cols,
+        &non_pk_cols,
+        packed_pks,
+        is_commit_alter,
+    )
 }
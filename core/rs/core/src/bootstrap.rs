@@ -218,13 +218,47 @@ pub fn create_clock_table(
         "CREATE INDEX IF NOT EXISTS \"{table_name}__crsql_clock_dbv_idx\" ON \"{table_name}__crsql_clock\" (\"db_version\")",
         table_name = crate::util::escape_ident(table_name),
       ))?;
+    // The packed form of the primary key is what `crsql_changes` hands out and
+    // receives. Storing it saves packing on every read and lets merges find keys
+    // by blob equality.
+    let packed_pks = table_info.packed_pks;
+    // Rows are created with a causal length of 1 and only get a sentinel clock
+    // row once deleted. Keeping the sentinel's version next to the key makes
+    // the causal length of a row a lookup by key.
+    let pks_cl = table_info.pks_cl;
     db.exec_safe(
       &format!(
-        "CREATE TABLE IF NOT EXISTS \"{table_name}__crsql_pks\" (__crsql_key INTEGER PRIMARY KEY, {pk_list})",
+        "CREATE TABLE IF NOT EXISTS \"{table_name}__crsql_pks\" (__crsql_key INTEGER PRIMARY KEY, {pk_list}{packed_col}{cl_col})",
         table_name = table_name,
         pk_list = pk_list,
+        packed_col = if packed_pks { ", __crsql_packed BLOB" } else { "" },
+        cl_col = if pks_cl { ", __crsql_cl INTEGER NOT NULL DEFAULT 1" } else { "" },
       )
     )?;
+    if packed_pks {
+        db.exec_safe(
+          &format!(
+            "CREATE UNIQUE INDEX IF NOT EXISTS \"{table_name}__crsql_pks_packed\" ON \"{table_name}__crsql_pks\" (__crsql_packed)",
+            table_name = crate::util::escape_ident(table_name),
+          )
+        )?;
+    }
+    if pks_cl {
+        // Every write of the sentinel, local or merged, goes through the clock table.
+        for (event, name) in [("INSERT", "insert"), ("UPDATE OF col_version", "update")] {
+            db.exec_safe(&format!(
+              "CREATE TRIGGER IF NOT EXISTS \"{table_name}__crsql_clock_cl_{name}\"
+                AFTER {event} ON \"{table_name}__crsql_clock\" WHEN NEW.col_name = '{sentinel}'
+              BEGIN
+                UPDATE \"{table_name}__crsql_pks\" SET __crsql_cl = NEW.col_version WHERE __crsql_key = NEW.key;
+              END",
+              table_name = crate::util::escape_ident(table_name),
+              event = event,
+              name = name,
+              sentinel = crate::c::DELETE_SENTINEL,
+            ))?;
+        }
+    }
     db.exec_safe(
       &format!(
         "CREATE UNIQUE INDEX IF NOT EXISTS \"{table_name}__crsql_pks_pks\" ON \"{table_name}__crsql_pks\" ({pk_list})",
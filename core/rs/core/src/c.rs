@@ -23,6 +23,10 @@ pub enum CrsqlChangesColumn {
     SiteId = 6,
     Cl = 7,
     Seq = 8,
+    // Hidden. `after_db_version = ? AND after_seq = ?` resumes a read
+    // after the change at `(db_version, seq)`.
+    AfterDbVrsn = 9,
+    AfterSeq = 10,
 }
 
 #[derive(FromPrimitive, PartialEq, Debug)]
@@ -32,7 +36,7 @@ pub enum ClockUnionColumn {
     Cid = 2,
     ColVrsn = 3,
     DbVrsn = 4,
-    SiteId = 5,
+    SiteOrdinal = 5,
     RowId = 6,
     Seq = 7,
     Cl = 8,
@@ -62,12 +66,19 @@ pub struct crsql_ExtData {
     pub tableInfos: *mut ::core::ffi::c_void,
     pub rowsImpacted: ::core::ffi::c_int,
     pub seq: ::core::ffi::c_int,
-    pub pSetSyncBitStmt: *mut sqlite::stmt,
-    pub pClearSyncBitStmt: *mut sqlite::stmt,
+    pub pSyncBit: *mut ::core::ffi::c_int,
+    pub dbVersionCheckedThisTx: ::core::ffi::c_int,
     pub pSetSiteIdOrdinalStmt: *mut sqlite::stmt,
     pub pSelectSiteIdOrdinalStmt: *mut sqlite::stmt,
     pub pSelectClockTablesStmt: *mut sqlite::stmt,
     pub mergeEqualValues: ::core::ffi::c_int,
+    pub changesStmtCache: *mut ::core::ffi::c_void,
+    pub pSelectSiteIdByOrdinalStmt: *mut sqlite::stmt,
+    pub siteIdCache: *mut ::core::ffi::c_void,
+    pub mergeStats: *mut ::core::ffi::c_void,
+    pub capturedUpdates: *mut ::core::ffi::c_void,
+    pub siteCount: sqlite::int64,
+    pub siteCountDbVersion: sqlite::int64,
 }
 
 #[repr(C)]
@@ -91,6 +102,8 @@ pub struct crsql_Changes_cursor {
     pub rowType: ::core::ffi::c_int,
     pub changesRowid: sqlite::int64,
     pub tblInfoIdx: ::core::ffi::c_int,
+    pub pChangesMerge: *mut ::core::ffi::c_void,
+    pub rowColIdx: ::core::ffi::c_int,
 }
 
 extern "C" {
@@ -108,7 +121,32 @@ extern "C" {
         siteIdBuffer: *mut c_char,
     ) -> *mut crsql_ExtData;
     pub fn crsql_freeExtData(pExtData: *mut crsql_ExtData);
+    pub fn crsql_total_changes(db: *mut sqlite::sqlite3) -> c_int;
+    pub fn crsql_current_time_ms(db: *mut sqlite::sqlite3) -> sqlite::int64;
+    pub fn crsql_set_preupdate_hook(
+        db: *mut sqlite::sqlite3,
+        pExtData: *mut crsql_ExtData,
+    ) -> *mut ::core::ffi::c_void;
     pub fn crsql_finalize(pExtData: *mut crsql_ExtData);
+    pub fn crsql_changes_vtab_in(
+        pIdxInfo: *mut sqlite::index_info,
+        iCons: c_int,
+        bHandle: c_int,
+    ) -> c_int;
+    pub fn crsql_changes_vtab_in_first(
+        pVal: *mut sqlite::value,
+        ppOut: *mut *mut sqlite::value,
+    ) -> c_int;
+    pub fn crsql_changes_vtab_in_next(
+        pVal: *mut sqlite::value,
+        ppOut: *mut *mut sqlite::value,
+    ) -> c_int;
+    pub fn crsql_changes_vtab_rhs_value(
+        pIdxInfo: *mut sqlite::index_info,
+        iCons: c_int,
+        ppVal: *mut *mut sqlite::value,
+    ) -> c_int;
+    pub fn crsql_changes_vtab_distinct(pIdxInfo: *mut sqlite::index_info) -> c_int;
 }
 
 #[test]
@@ -166,7 +204,7 @@ fn bindgen_test_layout_crsql_Changes_cursor() {
     let ptr = UNINIT.as_ptr();
     assert_eq!(
         ::core::mem::size_of::<crsql_Changes_cursor>(),
-        64usize,
+        80usize,
         concat!("Size of: ", stringify!(crsql_Changes_cursor))
     );
     assert_eq!(
@@ -254,6 +292,26 @@ fn bindgen_test_layout_crsql_Changes_cursor() {
             stringify!(tblInfoIdx)
         )
     );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).pChangesMerge) as usize - ptr as usize },
+        64usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_Changes_cursor),
+            "::",
+            stringify!(pChangesMerge)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).rowColIdx) as usize - ptr as usize },
+        72usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_Changes_cursor),
+            "::",
+            stringify!(rowColIdx)
+        )
+    );
 }
 
 #[test]
@@ -263,7 +321,7 @@ fn bindgen_test_layout_crsql_ExtData() {
     let ptr = UNINIT.as_ptr();
     assert_eq!(
         ::core::mem::size_of::<crsql_ExtData>(),
-        136usize,
+        192usize,
         concat!("Size of: ", stringify!(crsql_ExtData))
     );
     assert_eq!(
@@ -404,23 +462,23 @@ fn bindgen_test_layout_crsql_ExtData() {
         )
     );
     assert_eq!(
-        unsafe { ::core::ptr::addr_of!((*ptr).pSetSyncBitStmt) as usize - ptr as usize },
+        unsafe { ::core::ptr::addr_of!((*ptr).pSyncBit) as usize - ptr as usize },
         88usize,
         concat!(
             "Offset of field: ",
             stringify!(crsql_ExtData),
             "::",
-            stringify!(pSetSyncBitStmt)
+            stringify!(pSyncBit)
         )
     );
     assert_eq!(
-        unsafe { ::core::ptr::addr_of!((*ptr).pClearSyncBitStmt) as usize - ptr as usize },
+        unsafe { ::core::ptr::addr_of!((*ptr).dbVersionCheckedThisTx) as usize - ptr as usize },
         96usize,
         concat!(
             "Offset of field: ",
             stringify!(crsql_ExtData),
             "::",
-            stringify!(pClearSyncBitStmt)
+            stringify!(dbVersionCheckedThisTx)
         )
     );
     assert_eq!(
@@ -463,4 +521,74 @@ fn bindgen_test_layout_crsql_ExtData() {
             stringify!(mergeEqualValues)
         )
     );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).changesStmtCache) as usize - ptr as usize },
+        136usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(changesStmtCache)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).pSelectSiteIdByOrdinalStmt) as usize - ptr as usize },
+        144usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(pSelectSiteIdByOrdinalStmt)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).siteIdCache) as usize - ptr as usize },
+        152usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(siteIdCache)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).mergeStats) as usize - ptr as usize },
+        160usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(mergeStats)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).capturedUpdates) as usize - ptr as usize },
+        168usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(capturedUpdates)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).siteCount) as usize - ptr as usize },
+        176usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(siteCount)
+        )
+    );
+    assert_eq!(
+        unsafe { ::core::ptr::addr_of!((*ptr).siteCountDbVersion) as usize - ptr as usize },
+        184usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(crsql_ExtData),
+            "::",
+            stringify!(siteCountDbVersion)
+        )
+    );
 }
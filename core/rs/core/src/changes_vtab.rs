@@ -1,14 +1,19 @@
 extern crate alloc;
 use crate::alloc::string::ToString;
 use crate::changes_vtab_write::crsql_merge_insert;
-use crate::stmt_cache::reset_cached_stmt;
-use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
+use crate::db_version::fill_db_version_if_needed;
+use crate::stmt_cache::{reset_cached_stmt, ChangesStmtCache};
+use crate::tableinfo::{
+    crsql_ensure_table_infos_are_up_to_date, stats_are_due, ChangeStats, TableInfo,
+};
+use crate::util::Countable;
 use alloc::boxed::Box;
 use alloc::format;
 use alloc::string::String;
+use alloc::vec;
 use alloc::vec::Vec;
-use core::ffi::{c_char, c_int, CStr};
-use core::mem::{self, forget};
+use core::ffi::{c_char, c_int, c_void, CStr};
+use core::mem;
 use core::ptr::null_mut;
 
 use alloc::ffi::CString;
@@ -19,21 +24,56 @@ use sqlite_nostd as sqlite;
 use sqlite_nostd::ResultCode;
 
 use crate::c::{
-    crsql_Changes_cursor, crsql_Changes_vtab, ChangeRowType, ClockUnionColumn, CrsqlChangesColumn,
+    crsql_Changes_cursor, crsql_Changes_vtab, crsql_ExtData, crsql_changes_vtab_distinct,
+    crsql_changes_vtab_in, crsql_changes_vtab_in_first, crsql_changes_vtab_in_next,
+    crsql_changes_vtab_rhs_value, ChangeRowType, ClockUnionColumn, CrsqlChangesColumn,
 };
-use crate::changes_vtab_read::changes_union_query;
+use crate::changes_vtab_read::{changes_table_query, changes_union_query, ChangesMerge};
 use crate::pack_columns::bind_package_to_stmt;
 use crate::pack_columns::unpack_columns;
+use crate::site_id_cache::site_id_cache;
+
+// `changes_best_index` prefixes `idx_str` with one of these per argument it asks sqlite
+// to pass to `changes_filter`, in argv order, followed by `ARG_KINDS_END`.
+// The remainder of `idx_str` is the where / order by clause of the union.
+const ARG_WHERE: char = 'w';
+const ARG_TBL: char = 't';
+const ARG_TBL_IN: char = 'T';
+const ARG_PK: char = 'p';
+const ARG_SITE: char = 's';
+const ARG_LIMIT: char = 'l';
+const ARG_OFFSET: char = 'o';
+const ARG_KINDS_END: char = '|';
+
+// SQLITE_INDEX_CONSTRAINT_LIMIT / OFFSET from sqlite3.h
+const INDEX_CONSTRAINT_LIMIT: u8 = 73;
+const INDEX_CONSTRAINT_OFFSET: u8 = 74;
+
+#[no_mangle]
+pub extern "C" fn crsql_changes_crsr_finalize(crsr: *mut crsql_Changes_cursor) -> c_int {
+    changes_crsr_finalize(crsr)
+}
 
 fn changes_crsr_finalize(crsr: *mut crsql_Changes_cursor) -> c_int {
     // Assign pointers to null after freeing
     // since we can get into this twice for the same cursor object.
     unsafe {
         let mut rc = 0;
-        rc += match (*crsr).pChangesStmt.finalize() {
-            Ok(rc) => rc as c_int,
-            Err(rc) => rc as c_int,
-        };
+        if !(*crsr).pChangesMerge.is_null() {
+            // `pChangesStmt` is owned by the merge which hands it back to the
+            // statement cache for the next query.
+            let merge = Box::from_raw((*crsr).pChangesMerge as *mut ChangesMerge);
+            let mut cache = mem::ManuallyDrop::new(Box::from_raw(
+                (*(*(*crsr).pTab).pExtData).changesStmtCache as *mut ChangesStmtCache,
+            ));
+            merge.release(&mut cache);
+            (*crsr).pChangesMerge = null_mut();
+        } else {
+            rc += match (*crsr).pChangesStmt.finalize() {
+                Ok(rc) => rc as c_int,
+                Err(rc) => rc as c_int,
+            };
+        }
         (*crsr).pChangesStmt = null_mut();
         let reset_rc = reset_cached_stmt((*crsr).pRowStmt);
         match reset_rc {
@@ -59,10 +99,14 @@ pub unsafe extern "C" fn crsql_changes_best_index(
 }
 
 fn changes_best_index(
-    _vtab: *mut sqlite::vtab,
+    vtab: *mut sqlite::vtab,
     index_info: *mut sqlite::index_info,
 ) -> Result<ResultCode, ResultCode> {
     let mut idx_num: i32 = 0;
+    // (constraint index, op) of constraints used in the where clause.
+    // Kept to cost the query once all constraints have been seen.
+    let mut dbv_constraints: Vec<(usize, u8)> = vec![];
+    let mut site_constraints: Vec<u8> = vec![];
 
     let mut first_constraint = true;
     let mut str = String::new();
@@ -70,12 +114,78 @@ fn changes_best_index(
     let constraint_usage =
         sqlite::args_mut!((*index_info).nConstraint, (*index_info).aConstraintUsage);
     let mut arg_v_index = 1;
+    // describes, in argv order, what each argument passed to `changes_filter` is for.
+    // See `ARG_*` for the possible values.
+    let mut arg_kinds = String::new();
+    // the constraint, if any, that restricts the set of tables to pull from.
+    let mut tbl_constraint: Option<(usize, bool)> = None;
+    // `after_db_version = ?` and `after_seq = ?` constraints
+    let mut after_db_vrsn_constraint: Option<usize> = None;
+    let mut after_seq_constraint: Option<usize> = None;
+    let mut pk_constraint: Option<usize> = None;
+    let mut limit_constraint: Option<usize> = None;
+    let mut offset_constraint: Option<usize> = None;
     for (i, constraint) in constraints.iter().enumerate() {
+        if tbl_constraint.is_none() && constraint_is_usable_tbl_filter(constraint) {
+            // `tbl IN (...)` is handed to us as an EQ constraint. Ask for all the values
+            // at once so we can build a single union over just the requested tables.
+            let all_at_once = unsafe { crsql_changes_vtab_in(index_info, i as c_int, 1) } != 0;
+            tbl_constraint = Some((i, all_at_once));
+            idx_num |= 8;
+            continue;
+        }
+        if constraint.usable != 0 {
+            let slot = match (
+                constraint.op,
+                CrsqlChangesColumn::from_i32(constraint.iColumn),
+            ) {
+                (INDEX_CONSTRAINT_LIMIT, _) => Some(&mut limit_constraint),
+                (INDEX_CONSTRAINT_OFFSET, _) => Some(&mut offset_constraint),
+                (op, Some(CrsqlChangesColumn::AfterDbVrsn))
+                    if op == sqlite::INDEX_CONSTRAINT_EQ as u8 =>
+                {
+                    Some(&mut after_db_vrsn_constraint)
+                }
+                (op, Some(CrsqlChangesColumn::AfterSeq))
+                    if op == sqlite::INDEX_CONSTRAINT_EQ as u8 =>
+                {
+                    Some(&mut after_seq_constraint)
+                }
+                (op, Some(CrsqlChangesColumn::Pk)) if op == sqlite::INDEX_CONSTRAINT_EQ as u8 => {
+                    Some(&mut pk_constraint)
+                }
+                _ => None,
+            };
+            if let Some(slot) = slot {
+                if slot.is_none() {
+                    *slot = Some(i);
+                    continue;
+                }
+            }
+        }
         if !constraint_is_usable(constraint) {
             continue;
         }
         let col = CrsqlChangesColumn::from_i32(constraint.iColumn);
-        if let Some(col_name) = get_clock_table_col_name(&col) {
+        // Equality on site_id is checked against the ordinal the clock tables store.
+        // `changes_filter` maps the site id argument to its ordinal. Anything else
+        // needs the site id itself, joined in from `crsql_site_id`.
+        let by_ordinal = col == Some(CrsqlChangesColumn::SiteId)
+            && matches!(
+                constraint.op as u32,
+                sqlite::INDEX_CONSTRAINT_EQ
+                    | sqlite::INDEX_CONSTRAINT_IS
+                    | sqlite::INDEX_CONSTRAINT_NE
+                    | sqlite::INDEX_CONSTRAINT_ISNOT
+                    | sqlite::INDEX_CONSTRAINT_ISNULL
+                    | sqlite::INDEX_CONSTRAINT_ISNOTNULL
+            );
+        let col_name = if by_ordinal {
+            Some("site_ord".to_string())
+        } else {
+            get_clock_table_col_name(&col)
+        };
+        if let Some(col_name) = col_name {
             if let Some(op_string) = get_operator_string(constraint.op) {
                 if first_constraint {
                     str.push_str("WHERE ");
@@ -95,46 +205,113 @@ fn changes_best_index(
                     constraint_usage[i].argvIndex = arg_v_index;
                     constraint_usage[i].omit = 1;
                     arg_v_index += 1;
+                    arg_kinds.push(if by_ordinal { ARG_SITE } else { ARG_WHERE });
+                }
+                if col == Some(CrsqlChangesColumn::SiteId) && !by_ordinal {
+                    idx_num |= 128;
                 }
             }
         }
 
         // idx bit mask
         match col {
-            Some(CrsqlChangesColumn::DbVrsn) => idx_num |= 2,
-            Some(CrsqlChangesColumn::SiteId) => idx_num |= 4,
+            Some(CrsqlChangesColumn::DbVrsn) => {
+                idx_num |= 2;
+                dbv_constraints.push((i, constraint.op));
+            }
+            Some(CrsqlChangesColumn::SiteId) => {
+                idx_num |= 4;
+                site_constraints.push(constraint.op);
+            }
             _ => {}
         }
     }
 
-    let mut desc = 0;
+    // Resume after a given change. Without `after_seq` everything in `after_db_version`
+    // is skipped. `after_seq` on its own is left to sqlite, which matches nothing
+    // as the hidden columns always read as NULL.
+    if let Some(i) = after_db_vrsn_constraint {
+        str.push_str(if first_constraint { "WHERE " } else { " AND " });
+        first_constraint = false;
+        constraint_usage[i].argvIndex = arg_v_index;
+        constraint_usage[i].omit = 1;
+        arg_v_index += 1;
+        arg_kinds.push(ARG_WHERE);
+        if let Some(j) = after_seq_constraint {
+            str.push_str("(db_vrsn, seq) > (?, ?)");
+            constraint_usage[j].argvIndex = arg_v_index;
+            constraint_usage[j].omit = 1;
+            arg_v_index += 1;
+            arg_kinds.push(ARG_WHERE);
+        } else {
+            str.push_str("db_vrsn > ?");
+        }
+        idx_num |= 2;
+        dbv_constraints.push((i, sqlite::INDEX_CONSTRAINT_GT as u8));
+    }
+
+    // `pk = ?` is resolved to the lookaside key of each table in `changes_filter`
+    // so each clock table is probed through its primary key rather than scanned.
+    if let Some(i) = pk_constraint {
+        str.push_str(if first_constraint { "WHERE " } else { " AND " });
+        first_constraint = false;
+        str.push_str("key = ?");
+        constraint_usage[i].argvIndex = arg_v_index;
+        constraint_usage[i].omit = 1;
+        arg_v_index += 1;
+        arg_kinds.push(ARG_PK);
+        idx_num |= 64;
+    }
+
+    // Table filters are not part of the generated where clause. They pick which
+    // tables participate in the union and thus always come after the where args.
+    if let Some((i, all_at_once)) = tbl_constraint {
+        constraint_usage[i].argvIndex = arg_v_index;
+        constraint_usage[i].omit = 1;
+        arg_v_index += 1;
+        arg_kinds.push(if all_at_once { ARG_TBL_IN } else { ARG_TBL });
+    }
+
     let order_bys = sqlite::args!((*index_info).nOrderBy, (*index_info).aOrderBy);
     let mut order_by_consumed = true;
-    if order_bys.len() > 0 {
-        str.push_str(" ORDER BY ");
-    } else {
-        // The user didn't provide an ordering? Tack on a default one that will
-        // retrieve changes in-order
+    if is_in_version_order(order_bys.iter().map(|o| (o.iColumn, o.desc))) {
+        // The user didn't provide an ordering or asked for changes in the order
+        // they happened. Either way, retrieve changes in-order. Since every table
+        // can stream its changes in this order we can merge tables rather than sort them.
         str.push_str(" ORDER BY db_vrsn, seq ASC");
-    }
-    first_constraint = true;
-    for order_by in order_bys {
-        desc = order_by.desc;
-        let col = CrsqlChangesColumn::from_i32(order_by.iColumn);
-        if let Some(col_name) = get_clock_table_col_name(&col) {
-            if first_constraint {
-                first_constraint = false;
+        idx_num |= 16;
+    } else if order_bys.len() > 0
+        && order_bys
+            .iter()
+            .all(|o| CrsqlChangesColumn::from_i32(o.iColumn) == Some(CrsqlChangesColumn::Tbl))
+        && matches!(unsafe { crsql_changes_vtab_distinct(index_info) }, 1 | 2)
+    {
+        // `GROUP BY tbl` or `DISTINCT tbl`. Rows only need to be grouped by table,
+        // which pulling one table after the other does without sorting anything.
+        idx_num |= 32;
+    } else {
+        let mut desc = 0;
+        str.push_str(" ORDER BY ");
+        first_constraint = true;
+        for order_by in order_bys {
+            desc = order_by.desc;
+            let col = CrsqlChangesColumn::from_i32(order_by.iColumn);
+            if let Some(col_name) = get_clock_table_col_name(&col) {
+                if col == Some(CrsqlChangesColumn::SiteId) {
+                    idx_num |= 128;
+                }
+                if first_constraint {
+                    first_constraint = false;
+                } else {
+                    str.push_str(", ");
+                }
+                str.push_str(&col_name);
             } else {
-                str.push_str(", ");
+                // TODO: test we're consuming
+                order_by_consumed = false;
             }
-            str.push_str(&col_name);
-        } else {
-            // TODO: test we're consuming
-            order_by_consumed = false;
         }
-    }
 
-    if order_bys.len() > 0 {
         if desc != 0 {
             str.push_str(" DESC");
         } else {
@@ -142,37 +319,79 @@ fn changes_best_index(
         }
     }
 
-    // manual null-term since we'll pass to C
-    str.push('\0');
-
-    // TODO: update your order by py test to explain query plans to ensure correct indices are selected
-    // both constraints are present. Also to check that order by is consumed.
-    if idx_num & 6 == 6 {
-        unsafe {
-            (*index_info).estimatedCost = 1.0;
-            (*index_info).estimatedRows = 1;
-        }
+    // A key only means something within its own table so `pk = ?` is always
+    // pulled with a statement per table. Those can be merged into version order
+    // or drained one after the other but anything else is left for sqlite to sort.
+    if idx_num & 64 == 64 && idx_num & (16 | 32) == 0 && order_bys.len() > 0 {
+        order_by_consumed = false;
     }
-    // only the version constraint is present
-    else if idx_num & 2 == 2 {
-        unsafe {
-            (*index_info).estimatedCost = 10.0;
-            (*index_info).estimatedRows = 10;
-        }
-    }
-    // only the requestor constraint is present
-    else if idx_num & 4 == 4 {
-        unsafe {
-            (*index_info).estimatedCost = 2147483647.0;
-            (*index_info).estimatedRows = 2147483647;
+
+    // We can only stop early if sqlite has nothing left to filter or sort
+    // after us. Every statement pulls `LIMIT + OFFSET` rows and the merge drops
+    // the first `OFFSET` of them.
+    let mut limit = None;
+    if let Some(i) = limit_constraint {
+        let all_consumed = constraints.iter().enumerate().all(|(j, c)| {
+            c.op == INDEX_CONSTRAINT_LIMIT
+                || c.op == INDEX_CONSTRAINT_OFFSET
+                || constraint_usage[j].omit != 0
+        });
+        // distinct rows are counted after us, so a limit on changes isn't one on results
+        let distinct = unsafe { crsql_changes_vtab_distinct(index_info) } != 0;
+        if all_consumed && order_by_consumed && !distinct {
+            str.push_str(" LIMIT ?");
+            constraint_usage[i].argvIndex = arg_v_index;
+            constraint_usage[i].omit = 1;
+            arg_v_index += 1;
+            arg_kinds.push(ARG_LIMIT);
+            limit = rhs_value(index_info, i).map(|v| v.int64());
+            if let Some(j) = offset_constraint {
+                // with `omit` set sqlite leaves the offset to us
+                constraint_usage[j].argvIndex = arg_v_index;
+                constraint_usage[j].omit = 1;
+                arg_kinds.push(ARG_OFFSET);
+                limit = match (limit, rhs_value(index_info, j)) {
+                    (Some(l), Some(o)) if l >= 0 => Some(l + o.int64().max(0)),
+                    _ => None,
+                };
+            }
         }
     }
-    // no constraints are present
-    else {
-        unsafe {
-            (*index_info).estimatedCost = 2147483647.0;
-            (*index_info).estimatedRows = 2147483647;
+
+    // manual null-term since we'll pass to C
+    str.push('\0');
+    let str = format!("{}{}{}", arg_kinds, ARG_KINDS_END, str);
+
+    let rows = estimate_rows(
+        vtab,
+        index_info,
+        &dbv_constraints,
+        &site_constraints,
+        tbl_constraint,
+        pk_constraint.is_some(),
+    )
+    .unwrap_or(UNKNOWN_ROWS_ESTIMATE);
+    // Changes stream from the db_version index of each clock table. Any other
+    // order requires sorting them first.
+    let needs_sort = idx_num & (16 | 32) == 0 && order_bys.len() > 0;
+    let (rows, cost) = if needs_sort {
+        // rows * log2(rows) w/o floating point math, which no_std lacks.
+        let cost = rows * (u64::BITS - (rows as u64).leading_zeros()) as f64;
+        match limit {
+            Some(l) if l >= 0 => (rows.min(l as f64), cost),
+            _ => (rows, cost),
         }
+    } else {
+        // streaming. We stop once the limit is reached.
+        let rows = match limit {
+            Some(l) if l >= 0 => rows.min(l as f64),
+            _ => rows,
+        };
+        (rows, rows)
+    };
+    unsafe {
+        (*index_info).estimatedCost = cost.max(1.0);
+        (*index_info).estimatedRows = (rows as i64).max(1);
     }
 
     unsafe {
@@ -189,13 +408,209 @@ fn changes_best_index(
     Ok(ResultCode::OK)
 }
 
+// Used when the statistics of the clock tables can't be read.
+const UNKNOWN_ROWS_ESTIMATE: f64 = 2147483647.0;
+// Stand ins for a table whose stats `changes_filter` is yet to read.
+const UNKNOWN_TABLE_ROWS: f64 = 1000000.0;
+const UNKNOWN_VERSION_FRACTION: f64 = 0.01;
+
+/**
+ * Estimates the number of changes a query will return from the size and
+ * db_version spread of each clock table (see `TableInfo::cached_change_stats`)
+ * and, where sqlite knows them up front, the values constraints compare against.
+ *
+ * Planning can happen many times per query so this runs no SQL. It reads the
+ * table infos and stats last loaded by `changes_filter`.
+ */
+fn estimate_rows(
+    vtab: *mut sqlite::vtab,
+    index_info: *mut sqlite::index_info,
+    dbv_constraints: &Vec<(usize, u8)>,
+    site_constraints: &Vec<u8>,
+    tbl_constraint: Option<(usize, bool)>,
+    pk_constraint: bool,
+) -> Result<f64, ResultCode> {
+    let tab = vtab.cast::<crsql_Changes_vtab>();
+    let ext_data = unsafe { (*tab).pExtData };
+    if unsafe { (*ext_data).pragmaSchemaVersionForTableInfos } == -1 {
+        // never loaded
+        return Err(ResultCode::ERROR);
+    }
+    let tbl_infos = unsafe {
+        mem::ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>))
+    };
+    if tbl_infos.len() == 0 {
+        return Ok(0.0);
+    }
+
+    // `tbl = 'literal'` lets us cost just that table. Otherwise assume an average table.
+    let mut tables: Vec<&TableInfo> = tbl_infos.iter().collect();
+    let mut table_share = 1.0;
+    if let Some((i, all_at_once)) = tbl_constraint {
+        match rhs_value(index_info, i) {
+            Some(tbl) if !all_at_once => {
+                let tbl = tbl.text();
+                tables.retain(|x| x.tbl_name == tbl);
+            }
+            _ => table_share = 1.0 / tables.len() as f64,
+        }
+    }
+
+    let sites = unsafe { (*ext_data).siteCount }.max(1) as f64;
+    let dbv_bounds: Vec<(u8, Option<i64>)> = dbv_constraints
+        .iter()
+        .map(|(i, op)| {
+            (
+                *op,
+                rhs_value(index_info, *i)
+                    .filter(|v| v.value_type() == ColumnType::Integer)
+                    .map(|v| v.int64()),
+            )
+        })
+        .collect();
+
+    let mut rows = 0.0;
+    for tbl_info in tables {
+        let stats = tbl_info.cached_change_stats();
+        let mut tbl_rows = stats.map_or(UNKNOWN_TABLE_ROWS, |stats| stats.rows);
+        if pk_constraint {
+            // a sentinel and a clock entry per column, at most
+            tbl_rows = tbl_rows.min((tbl_info.non_pks.len() + 1) as f64);
+        }
+        for (op, bound) in &dbv_bounds {
+            let fraction = match (*op as u32, bound, &stats) {
+                (sqlite::INDEX_CONSTRAINT_EQ | sqlite::INDEX_CONSTRAINT_IS, _, Some(stats)) => {
+                    stats.rows_per_version / stats.rows.max(1.0)
+                }
+                (sqlite::INDEX_CONSTRAINT_EQ | sqlite::INDEX_CONSTRAINT_IS, _, None) => {
+                    UNKNOWN_VERSION_FRACTION
+                }
+                (
+                    sqlite::INDEX_CONSTRAINT_GT | sqlite::INDEX_CONSTRAINT_GE,
+                    Some(v),
+                    Some(stats),
+                ) => (stats.max_db_version - v) as f64 / versions(stats),
+                (
+                    sqlite::INDEX_CONSTRAINT_LT | sqlite::INDEX_CONSTRAINT_LE,
+                    Some(v),
+                    Some(stats),
+                ) => (v - stats.min_db_version) as f64 / versions(stats),
+                // A range against a value we can't see yet. Typically a peer asking for
+                // what it has missed since its last sync.
+                (
+                    sqlite::INDEX_CONSTRAINT_GT
+                    | sqlite::INDEX_CONSTRAINT_GE
+                    | sqlite::INDEX_CONSTRAINT_LT
+                    | sqlite::INDEX_CONSTRAINT_LE,
+                    _,
+                    _,
+                ) => 0.25,
+                _ => 1.0,
+            };
+            tbl_rows *= fraction.clamp(0.0, 1.0);
+        }
+        for op in site_constraints {
+            tbl_rows *= match *op as u32 {
+                sqlite::INDEX_CONSTRAINT_EQ | sqlite::INDEX_CONSTRAINT_IS => 1.0 / sites,
+                sqlite::INDEX_CONSTRAINT_NE | sqlite::INDEX_CONSTRAINT_ISNOT => {
+                    (sites - 1.0).max(1.0) / sites
+                }
+                _ => 1.0,
+            };
+        }
+        rows += tbl_rows;
+    }
+
+    Ok(rows * table_share)
+}
+
+fn versions(stats: &ChangeStats) -> f64 {
+    (stats.max_db_version - stats.min_db_version + 1).max(1) as f64
+}
+
+/**
+ * Reads what `estimate_rows` costs queries from for the tables a query reads,
+ * `tbl_names` or all of them, once they are due. See `stats_are_due`.
+ * Done here rather than when planning, which may happen many times for a
+ * query and should run no SQL.
+ * Stats from a later ANALYZE are picked up the next time they are due. Schema
+ * changes reload the table infos and with them the stats.
+ */
+unsafe fn refresh_planner_stats(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_names: Option<&[String]>,
+) -> Result<ResultCode, ResultCode> {
+    if fill_db_version_if_needed(db, ext_data).is_err() {
+        return Err(ResultCode::ERROR);
+    }
+    let db_version = (*ext_data).dbVersion;
+    let site_count_read_at = Some((*ext_data).siteCountDbVersion).filter(|v| *v >= 0);
+    if stats_are_due(site_count_read_at, db_version) {
+        (*ext_data).siteCount = db.count("SELECT count(*) FROM crsql_site_id")? as i64;
+        (*ext_data).siteCountDbVersion = db_version;
+    }
+
+    let tbl_infos =
+        mem::ManuallyDrop::new(Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>));
+    let mut stale = tbl_infos
+        .iter()
+        .filter(|x| tbl_names.map_or(true, |names| names.contains(&x.tbl_name)))
+        .filter(|x| x.change_stats_are_stale(db_version))
+        .peekable();
+    if stale.peek().is_none() {
+        return Ok(ResultCode::OK);
+    }
+    // absent on databases that were never analyzed
+    let stat1_stmt = db
+        .prepare_v2("SELECT stat FROM sqlite_stat1 WHERE tbl = ? AND idx = ?")
+        .ok();
+    for tbl_info in stale {
+        tbl_info.refresh_change_stats(db, db_version, stat1_stmt.as_ref())?;
+    }
+    Ok(ResultCode::OK)
+}
+
+// The right-hand side of a constraint if it is known when planning, e.g. a literal.
+fn rhs_value(index_info: *mut sqlite::index_info, i: usize) -> Option<*mut sqlite::value> {
+    let mut value: *mut sqlite::value = null_mut();
+    let rc = unsafe { crsql_changes_vtab_rhs_value(index_info, i as c_int, &mut value as *mut _) };
+    if rc == ResultCode::OK as c_int && !value.is_null() {
+        Some(value)
+    } else {
+        None
+    }
+}
+
+// No ordering or an ascending ordering that is a prefix of `db_version, seq`
+fn is_in_version_order(mut order_bys: impl Iterator<Item = (c_int, u8)>) -> bool {
+    let version_order = [CrsqlChangesColumn::DbVrsn, CrsqlChangesColumn::Seq];
+    let mut expected = version_order.iter();
+    order_bys.all(
+        |(col, desc)| match (expected.next(), CrsqlChangesColumn::from_i32(col)) {
+            (Some(expected), Some(col)) => desc == 0 && *expected == col,
+            _ => false,
+        },
+    )
+}
+
+fn constraint_is_usable_tbl_filter(constraint: &sqlite::index_constraint) -> bool {
+    constraint.usable != 0
+        && constraint.op == sqlite::INDEX_CONSTRAINT_EQ as u8
+        && CrsqlChangesColumn::from_i32(constraint.iColumn) == Some(CrsqlChangesColumn::Tbl)
+}
+
 fn constraint_is_usable(constraint: &sqlite::index_constraint) -> bool {
     if constraint.usable == 0 {
         return false;
     }
     if let Some(col) = CrsqlChangesColumn::from_i32(constraint.iColumn) {
         match col {
-            CrsqlChangesColumn::Tbl | CrsqlChangesColumn::Pk | CrsqlChangesColumn::Cval => false,
+            CrsqlChangesColumn::Tbl
+            | CrsqlChangesColumn::Pk
+            | CrsqlChangesColumn::Cval
+            | CrsqlChangesColumn::AfterDbVrsn
+            | CrsqlChangesColumn::AfterSeq => false,
             _ => true,
         }
     } else {
@@ -215,6 +630,7 @@ fn get_clock_table_col_name(col: &Option<CrsqlChangesColumn>) -> Option<String>
         Some(CrsqlChangesColumn::SiteId) => Some("site_id".to_string()),
         Some(CrsqlChangesColumn::Seq) => Some("seq".to_string()),
         Some(CrsqlChangesColumn::Cl) => Some("cl".to_string()),
+        Some(CrsqlChangesColumn::AfterDbVrsn) | Some(CrsqlChangesColumn::AfterSeq) => None,
         None => None,
     }
 }
@@ -244,7 +660,7 @@ fn get_operator_string(op: u8) -> Option<String> {
 #[no_mangle]
 pub unsafe extern "C" fn crsql_changes_filter(
     cursor: *mut sqlite::vtab_cursor,
-    _idx_num: c_int,
+    idx_num: c_int,
     idx_str: *const c_char,
     argc: c_int,
     argv: *mut *mut sqlite::value,
@@ -253,7 +669,7 @@ pub unsafe extern "C" fn crsql_changes_filter(
     let cursor = cursor.cast::<crsql_Changes_cursor>();
     let idx_str = unsafe { CStr::from_ptr(idx_str).to_str() };
     match idx_str {
-        Ok(idx_str) => match changes_filter(cursor, idx_str, args) {
+        Ok(idx_str) => match changes_filter(cursor, idx_num, idx_str, args) {
             Err(rc) | Ok(rc) => rc as c_int,
         },
         Err(_) => ResultCode::FORMAT as c_int,
@@ -262,6 +678,7 @@ pub unsafe extern "C" fn crsql_changes_filter(
 
 unsafe fn changes_filter(
     cursor: *mut crsql_Changes_cursor,
+    idx_num: c_int,
     idx_str: &str,
     args: &[*mut sqlite::value],
 ) -> Result<ResultCode, ResultCode> {
@@ -269,9 +686,8 @@ unsafe fn changes_filter(
     let db = (*tab).db;
     // This should never happen. pChangesStmt should be finalized
     // before filter is ever invoked.
-    if !(*cursor).pChangesStmt.is_null() {
-        (*cursor).pChangesStmt.finalize()?;
-        (*cursor).pChangesStmt = null_mut();
+    if !(*cursor).pChangesStmt.is_null() || !(*cursor).pChangesMerge.is_null() {
+        changes_crsr_finalize(cursor);
     }
 
     let c_rc = crsql_ensure_table_infos_are_up_to_date(
@@ -286,27 +702,187 @@ unsafe fn changes_filter(
             return Err(ResultCode::ERROR);
         }
     }
+    let (arg_kinds, idx_str) = idx_str
+        .split_once(ARG_KINDS_END)
+        .ok_or(ResultCode::FORMAT)?;
+    if arg_kinds.len() != args.len() {
+        return Err(ResultCode::FORMAT);
+    }
+
+    let mut where_args = vec![];
+    // position of `key = ?` among the where args
+    let mut pk_slot: Option<usize> = None;
+    // positions of `site_ord = ?` and friends among the where args with the ordinal to bind
+    let mut site_slots: Vec<(usize, Option<i64>)> = vec![];
+    let ext_data = (*tab).pExtData;
+    let mut tbl_names: Option<Vec<String>> = None;
+    let mut limit: Option<i64> = None;
+    let mut offset: i64 = 0;
+    for (kind, arg) in arg_kinds.chars().zip(args.iter()) {
+        match kind {
+            ARG_WHERE => where_args.push(*arg),
+            ARG_PK => {
+                pk_slot = Some(where_args.len());
+                where_args.push(*arg);
+            }
+            ARG_SITE => {
+                site_slots.push((where_args.len(), site_ordinal(ext_data, *arg)?));
+                where_args.push(*arg);
+            }
+            ARG_TBL => {
+                // `tbl = NULL` matches nothing but still restricts the tables to pull from
+                let names = tbl_names.get_or_insert_with(|| vec![]);
+                if arg.value_type() != ColumnType::Null {
+                    names.push(arg.text().to_string());
+                }
+            }
+            ARG_TBL_IN => {
+                let names = tbl_names.get_or_insert_with(|| vec![]);
+                let mut value: *mut sqlite::value = null_mut();
+                let mut rc = crsql_changes_vtab_in_first(*arg, &mut value as *mut _);
+                while rc == ResultCode::OK as c_int {
+                    // values handed out by the iterator are only valid until the next call
+                    if !value.is_null() && value.value_type() != ColumnType::Null {
+                        names.push(value.text().to_string());
+                    }
+                    rc = crsql_changes_vtab_in_next(*arg, &mut value as *mut _);
+                }
+                if rc != ResultCode::DONE as c_int {
+                    return Err(ResultCode::from_i32(rc).unwrap_or(ResultCode::ERROR));
+                }
+            }
+            // a negative limit means no limit
+            ARG_LIMIT => limit = Some(arg.int64()).filter(|l| *l >= 0),
+            ARG_OFFSET => offset = arg.int64().max(0),
+            _ => return Err(ResultCode::FORMAT),
+        }
+    }
+
+    // only used to cost later queries. Not being able to read them shouldn't fail this one.
+    let _ = refresh_planner_stats(db, ext_data, tbl_names.as_deref());
 
     // nothing to fetch, no crrs exist.
     let tbl_infos = mem::ManuallyDrop::new(Box::from_raw(
         (*(*tab).pExtData).tableInfos as *mut Vec<TableInfo>,
     ));
+    // only union the tables that were asked for, if the query asked for specific tables.
+    let tbl_infos: Vec<&TableInfo> = match tbl_names {
+        Some(names) => tbl_infos
+            .iter()
+            .filter(|x| names.contains(&x.tbl_name))
+            .collect(),
+        None => tbl_infos.iter().collect(),
+    };
+    // the key of the requested pk in each table that has it. Tables without it have no changes for it.
+    let mut keys = vec![];
+    let tbl_infos: Vec<&TableInfo> = match pk_slot {
+        Some(slot) => {
+            let pk = where_args[slot];
+            let unpacked = if pk.value_type() == ColumnType::Blob {
+                unpack_columns(pk.blob()).ok()
+            } else {
+                None
+            };
+            let mut with_key = vec![];
+            if let Some(unpacked) = unpacked {
+                for tbl_info in tbl_infos {
+                    if tbl_info.pks.len() != unpacked.len() {
+                        continue;
+                    }
+                    if let Some(key) = tbl_info.get_key_via_packed(db, pk.blob(), &unpacked)? {
+                        with_key.push(tbl_info);
+                        keys.push(key);
+                    }
+                }
+            }
+            with_key
+        }
+        None => tbl_infos,
+    };
     if tbl_infos.len() == 0 {
         return Ok(ResultCode::OK);
     }
 
-    let sql = changes_union_query(&tbl_infos, idx_str)?;
+    let mut cache = mem::ManuallyDrop::new(Box::from_raw(
+        (*(*tab).pExtData).changesStmtCache as *mut ChangesStmtCache,
+    ));
+    // site ids are only joined in when filtering or ordering needs more than the ordinal
+    let with_site_id = idx_num & 128 == 128;
+    let sqls = if pk_slot.is_some() || (idx_num & (16 | 32) != 0 && tbl_infos.len() > 1) {
+        // pull each table in version order and merge them rather than
+        // sorting the union of all of them. Or, if the query only needs rows grouped
+        // by table, drain the tables one after the other.
+        // `key = ?` always needs a statement per table as each binds its own key.
+        tbl_infos
+            .iter()
+            .map(|tbl_info| changes_table_query(tbl_info, idx_str, with_site_id))
+            .collect::<Result<Vec<_>, _>>()?
+    } else {
+        vec![changes_union_query(&tbl_infos, idx_str, with_site_id)?]
+    };
 
-    let stmt = db.prepare_v2(&sql)?;
-    for (i, arg) in args.iter().enumerate() {
-        stmt.bind_value(i as i32 + 1, *arg)?;
+    let mut stmts = Vec::with_capacity(sqls.len());
+    for (t, sql) in sqls.into_iter().enumerate() {
+        let (sql, stmt) = match cache.take(&sql) {
+            Some(cached) => cached,
+            None => {
+                let stmt = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
+                (sql, stmt)
+            }
+        };
+        for (i, arg) in where_args.iter().enumerate() {
+            if pk_slot == Some(i) {
+                stmt.bind_int64(i as i32 + 1, keys[t])?;
+            } else if let Some((_, ordinal)) = site_slots.iter().find(|(slot, _)| *slot == i) {
+                match ordinal {
+                    Some(ordinal) => stmt.bind_int64(i as i32 + 1, *ordinal)?,
+                    None => stmt.bind_null(i as i32 + 1)?,
+                };
+            } else {
+                stmt.bind_value(i as i32 + 1, *arg)?;
+            }
+        }
+        if arg_kinds.contains(ARG_LIMIT) {
+            stmt.bind_int64(
+                where_args.len() as i32 + 1,
+                limit.map_or(-1, |l| l.saturating_add(offset)),
+            )?;
+        }
+        stmts.push((sql, stmt));
     }
-    (*cursor).pChangesStmt = stmt.stmt;
-    // forget the stmt. it will be managed by the vtab
-    forget(stmt);
+    let mut merge = if idx_num & 32 == 32 {
+        ChangesMerge::sequential(stmts)
+    } else {
+        ChangesMerge::new(stmts)?
+    };
+    merge.limit(limit, offset);
+    (*cursor).pChangesMerge = Box::into_raw(Box::new(merge)) as *mut c_void;
     changes_next(cursor, (*cursor).pTab.cast::<sqlite::vtab>())
 }
 
+/**
+ * The ordinal to compare against for a site_id argument.
+ * A site without an ordinal has no changes so it is given one that matches nothing.
+ */
+fn site_ordinal(
+    ext_data: *mut crate::c::crsql_ExtData,
+    site_id: *mut sqlite::value,
+) -> Result<Option<i64>, ResultCode> {
+    match site_id.value_type() {
+        ColumnType::Null => Ok(None),
+        ColumnType::Blob => {
+            let mut site_ids = unsafe { site_id_cache(ext_data) };
+            Ok(Some(
+                site_ids
+                    .get_ordinal(ext_data, site_id.blob())?
+                    .unwrap_or(-1),
+            ))
+        }
+        // site ids are always blobs
+        _ => Ok(Some(-1)),
+    }
+}
+
 /**
  * Advances our Changes_cursor to its next row of output.
  * TODO: this'll get more idiomatic as we move dependencies to Rust
@@ -329,21 +905,24 @@ unsafe fn changes_next(
     cursor: *mut crsql_Changes_cursor,
     vtab: *mut sqlite::vtab,
 ) -> Result<ResultCode, ResultCode> {
-    if (*cursor).pChangesStmt.is_null() {
+    if (*cursor).pChangesStmt.is_null() && (*cursor).pChangesMerge.is_null() {
         let err = CString::new("pChangesStmt is null in changes_next")?;
         (*vtab).zErrMsg = err.into_raw();
         return Err(ResultCode::ABORT);
     }
 
-    if !(*cursor).pRowStmt.is_null() {
-        let rc = reset_cached_stmt((*cursor).pRowStmt);
-        (*cursor).pRowStmt = null_mut();
-        if rc.is_err() {
-            return rc;
+    let rc = if (*cursor).pChangesMerge.is_null() {
+        (*cursor).pChangesStmt.step()?
+    } else {
+        let merge = &mut *((*cursor).pChangesMerge as *mut ChangesMerge);
+        match merge.next()? {
+            Some(stmt) => {
+                (*cursor).pChangesStmt = stmt;
+                ResultCode::ROW
+            }
+            None => ResultCode::DONE,
         }
-    }
-
-    let rc = (*cursor).pChangesStmt.step()?;
+    };
     if rc == ResultCode::DONE {
         let c_rc = changes_crsr_finalize(cursor);
         if c_rc == 0 {
@@ -386,6 +965,20 @@ unsafe fn changes_next(
     let tbl_info_index = tbl_info_index.unwrap();
 
     let tbl_info = &tbl_infos[tbl_info_index];
+
+    // `pRowStmt` holds every column of the row the prior change was for.
+    // Changes to the same row tend to be adjacent so keep serving from it
+    // until we move to a different row.
+    let same_row =
+        (*cursor).tblInfoIdx == tbl_info_index as i32 && (*cursor).changesRowid == changes_rowid;
+    if !same_row && !(*cursor).pRowStmt.is_null() {
+        let rc = reset_cached_stmt((*cursor).pRowStmt);
+        (*cursor).pRowStmt = null_mut();
+        if rc.is_err() {
+            return rc;
+        }
+    }
+
     (*cursor).changesRowid = changes_rowid;
     (*cursor).tblInfoIdx = tbl_info_index as i32;
 
@@ -405,7 +998,15 @@ unsafe fn changes_next(
         (*cursor).rowType = ChangeRowType::Update as c_int;
     }
 
-    let row_stmt_ref = tbl_info.get_row_patch_data_stmt((*(*cursor).pTab).db, cid)?;
+    let col_idx = tbl_info
+        .row_patch_data_col_idx(cid)
+        .ok_or(ResultCode::ERROR)?;
+    (*cursor).rowColIdx = col_idx as c_int;
+    if !(*cursor).pRowStmt.is_null() {
+        return Ok(ResultCode::OK);
+    }
+
+    let row_stmt_ref = tbl_info.get_row_patch_data_stmt((*(*cursor).pTab).db)?;
     let row_stmt = row_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
     let packed_pks = pks.blob();
@@ -465,10 +1066,11 @@ fn column_impl(
             ctx.result_value(changes_stmt.column_value(ClockUnionColumn::Pks as i32));
         }
         Some(CrsqlChangesColumn::Cval) => unsafe {
-            if (*cursor).pRowStmt.is_null() {
+            // pRowStmt may still be holding the row for a sentinel change
+            if (*cursor).pRowStmt.is_null() || (*cursor).rowType != ChangeRowType::Update as c_int {
                 ctx.result_null();
             } else {
-                ctx.result_value((*cursor).pRowStmt.column_value(0));
+                ctx.result_value((*cursor).pRowStmt.column_value((*cursor).rowColIdx));
             }
         },
         Some(CrsqlChangesColumn::Cid) => unsafe {
@@ -493,9 +1095,22 @@ fn column_impl(
             ctx.result_value(changes_stmt.column_value(ClockUnionColumn::DbVrsn as i32));
         }
         Some(CrsqlChangesColumn::SiteId) => {
-            // todo: short circuit null? if col type null bind null rather than value?
-            // sholdn't matter..
-            ctx.result_value(changes_stmt.column_value(ClockUnionColumn::SiteId as i32));
+            let ordinal = changes_stmt.column_value(ClockUnionColumn::SiteOrdinal as i32);
+            if ordinal.value_type() == ColumnType::Null {
+                ctx.result_null();
+            } else {
+                let ext_data = unsafe { (*(*cursor).pTab).pExtData };
+                let mut site_ids = unsafe { site_id_cache(ext_data) };
+                match site_ids.get_site_id(ext_data, ordinal.int64())? {
+                    Some(site_id) => sqlite::result_blob(
+                        ctx,
+                        site_id.as_ptr() as *mut u8,
+                        site_id.len() as i32,
+                        sqlite::Destructor::TRANSIENT,
+                    ),
+                    None => ctx.result_null(),
+                }
+            }
         }
         Some(CrsqlChangesColumn::Seq) => {
             ctx.result_value(changes_stmt.column_value(ClockUnionColumn::Seq as i32));
@@ -503,6 +1118,10 @@ fn column_impl(
         Some(CrsqlChangesColumn::Cl) => {
             ctx.result_value(changes_stmt.column_value(ClockUnionColumn::Cl as i32))
         }
+        // only used as arguments
+        Some(CrsqlChangesColumn::AfterDbVrsn) | Some(CrsqlChangesColumn::AfterSeq) => {
+            ctx.result_null();
+        }
         None => return Err(ResultCode::MISUSE),
     }
 
@@ -572,3 +1191,19 @@ pub extern "C" fn crsql_changes_commit(vtab: *mut sqlite::vtab) -> c_int {
     }
     ResultCode::OK as c_int
 }
+
+// Without xSavepoint sqlite does not call xRollbackTo for savepoints
+// opened before the first write to crsql_changes in a transaction.
+#[no_mangle]
+pub extern "C" fn crsql_changes_savepoint(_vtab: *mut sqlite::vtab, _savepoint: c_int) -> c_int {
+    ResultCode::OK as c_int
+}
+
+// Called when a savepoint or a failed statement rolls back. Site ordinals
+// assigned under it are given out again so they can't be cached any longer.
+#[no_mangle]
+pub extern "C" fn crsql_changes_rollback_to(vtab: *mut sqlite::vtab, _savepoint: c_int) -> c_int {
+    let tab = vtab.cast::<crsql_Changes_vtab>();
+    unsafe { site_id_cache((*tab).pExtData) }.rollback_to_savepoint();
+    ResultCode::OK as c_int
+}
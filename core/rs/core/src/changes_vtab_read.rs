@@ -1,14 +1,21 @@
 extern crate alloc;
+use crate::c::ClockUnionColumn;
+use crate::stmt_cache::ChangesStmtCache;
 use crate::tableinfo::TableInfo;
+use alloc::collections::BinaryHeap;
 use alloc::format;
 use alloc::string::String;
 use alloc::vec;
 use alloc::vec::Vec;
-use sqlite::ResultCode;
+use core::cmp::Reverse;
+use sqlite::{ManagedStmt, ResultCode, Stmt};
 
 use sqlite_nostd as sqlite;
 
-fn crsql_changes_query_for_table(table_info: &TableInfo) -> Result<String, ResultCode> {
+fn crsql_changes_query_for_table(
+    table_info: &TableInfo,
+    with_site_id: bool,
+) -> Result<String, ResultCode> {
     if table_info.pks.len() == 0 {
         // no primary keys? We can't get changes for a table w/o primary keys...
         // this should be an impossible case.
@@ -16,52 +23,235 @@ fn crsql_changes_query_for_table(table_info: &TableInfo) -> Result<String, Resul
     }
 
     let pk_list = crate::util::as_identifier_list(&table_info.pks, Some("pk_tbl."))?;
-    // TODO: we can remove the self join if we put causal length in the primary key table
-
+    let packed_pks = if table_info.packed_pks {
+        format!("COALESCE(pk_tbl.__crsql_packed, crsql_pack_columns({pk_list}))")
+    } else {
+        format!("crsql_pack_columns({pk_list})")
+    };
+    // Changes carry the ordinal of their site which is mapped back to the site id
+    // when read. The site id itself is only joined in if the query filters or
+    // orders by more than the ordinal can answer.
+    let (site_id_col, site_id_join) = if with_site_id {
+        (
+            "site_tbl.site_id as site_id,",
+            "LEFT JOIN crsql_site_id AS site_tbl ON t1.site_id = site_tbl.ordinal",
+        )
+    } else {
+        ("", "")
+    };
     // We LEFT JOIN and COALESCE the causal length
     // since we incorporated an optimization to not store causal length records
     // until they're required. I.e., do not store them until a delete
     // is actually issued. This cuts data weight quite a bit for
     // rows that never get removed.
+    // Lookasides that keep the causal length already hold it for every row.
+    let (cl, cl_join) = if table_info.pks_cl {
+        ("pk_tbl.__crsql_cl", String::from(""))
+    } else {
+        (
+            "COALESCE(t2.col_version, 1)",
+            format!(
+                "LEFT JOIN \"{table_name_ident}__crsql_clock\" AS t2 ON
+      t1.key = t2.key AND t2.col_name = '{sentinel}'",
+                table_name_ident = crate::util::escape_ident(&table_info.tbl_name),
+                sentinel = crate::c::INSERT_SENTINEL
+            ),
+        )
+    };
     Ok(format!(
         "SELECT
           '{table_name_val}' as tbl,
-          crsql_pack_columns({pk_list}) as pks,
+          {packed_pks} as pks,
           t1.col_name as cid,
           t1.col_version as col_vrsn,
           t1.db_version as db_vrsn,
-          site_tbl.site_id as site_id,
+          t1.site_id as site_ord,
+          {site_id_col}
           t1.key,
           t1.seq as seq,
-          COALESCE(t2.col_version, 1) as cl
+          {cl} as cl
       FROM \"{table_name_ident}__crsql_clock\" AS t1
       JOIN \"{table_name_ident}__crsql_pks\" AS pk_tbl ON t1.key = pk_tbl.__crsql_key
-      LEFT JOIN crsql_site_id AS site_tbl ON t1.site_id = site_tbl.ordinal
-      LEFT JOIN \"{table_name_ident}__crsql_clock\" AS t2 ON
-      t1.key = t2.key AND t2.col_name = '{sentinel}'",
+      {site_id_join}
+      {cl_join}",
         table_name_val = crate::util::escape_ident_as_value(&table_info.tbl_name),
-        pk_list = pk_list,
+        packed_pks = packed_pks,
+        site_id_col = site_id_col,
+        site_id_join = site_id_join,
+        cl = cl,
+        cl_join = cl_join,
         table_name_ident = crate::util::escape_ident(&table_info.tbl_name),
-        sentinel = crate::c::INSERT_SENTINEL
     ))
 }
 
 pub fn changes_union_query(
-    table_infos: &Vec<TableInfo>,
+    table_infos: &Vec<&TableInfo>,
     idx_str: &str,
+    with_site_id: bool,
 ) -> Result<String, ResultCode> {
     let mut sub_queries = vec![];
 
     for table_info in table_infos {
-        let query_part = crsql_changes_query_for_table(&table_info)?;
+        let query_part = crsql_changes_query_for_table(table_info, with_site_id)?;
         sub_queries.push(query_part);
     }
 
     // Manually null-terminate the string so we don't have to copy it to create a CString.
     // We can just extract the raw bytes of the Rust string.
     return Ok(format!(
-      "SELECT tbl, pks, cid, col_vrsn, db_vrsn, site_id, key, seq, cl FROM ({unions}) {idx_str}\0",
+      "SELECT tbl, pks, cid, col_vrsn, db_vrsn, site_ord, key, seq, cl FROM ({unions}) {idx_str}\0",
       unions = sub_queries.join(" UNION ALL "),
       idx_str = idx_str,
     ));
 }
+
+pub fn changes_table_query(
+    table_info: &TableInfo,
+    idx_str: &str,
+    with_site_id: bool,
+) -> Result<String, ResultCode> {
+    let query_part = crsql_changes_query_for_table(table_info, with_site_id)?;
+
+    return Ok(format!(
+      "SELECT tbl, pks, cid, col_vrsn, db_vrsn, site_ord, key, seq, cl FROM ({query_part}) {idx_str}\0",
+      query_part = query_part,
+      idx_str = idx_str,
+    ));
+}
+
+/**
+ * Merges the changes of many tables, each pulled by a statement ordered by `db_vrsn, seq`,
+ * into a single stream with that same ordering.
+ *
+ * This is used in place of a `UNION ALL` + `ORDER BY` which requires SQLite to materialize
+ * and sort the changes of every table before returning the first row. Here each table's
+ * statement streams from its `db_version` index and we only ever hold one row per table.
+ *
+ * Given a single statement, or when built with `sequential`, the rows of each statement
+ * are passed through in whatever order it returns them, one statement after the other.
+ * This is enough when the query only needs the changes of a table to be adjacent.
+ *
+ * The statements are owned by the merge and handed back to the
+ * connection's statement cache once the query completes.
+ */
+pub struct ChangesMerge {
+    stmts: Vec<(String, ManagedStmt)>,
+    // min-heap of (db_vrsn, seq, stmt index) for every statement that is sitting on a row
+    // that has not been handed out yet.
+    heap: BinaryHeap<Reverse<(i64, i64, usize)>>,
+    // the statement that produced the row currently being read by the cursor.
+    // It is advanced on the next call to `next`.
+    current: Option<usize>,
+    // drain the statements one after the other rather than interleaving them by version.
+    sequential: bool,
+    // rows left to skip and to hand out for a query with a LIMIT / OFFSET
+    offset: i64,
+    remaining: Option<i64>,
+}
+
+impl ChangesMerge {
+    pub fn new(stmts: Vec<(String, ManagedStmt)>) -> Result<Self, ResultCode> {
+        let mut heap = BinaryHeap::with_capacity(stmts.len());
+        let sequential = stmts.len() == 1;
+        if !sequential {
+            for (i, (_, stmt)) in stmts.iter().enumerate() {
+                if stmt.step()? == ResultCode::ROW {
+                    heap.push(Reverse(ordering_key(stmt, i)));
+                }
+            }
+        }
+        Ok(ChangesMerge {
+            stmts,
+            heap,
+            current: None,
+            sequential,
+            offset: 0,
+            remaining: None,
+        })
+    }
+
+    pub fn sequential(stmts: Vec<(String, ManagedStmt)>) -> Self {
+        ChangesMerge {
+            stmts,
+            heap: BinaryHeap::new(),
+            current: None,
+            sequential: true,
+            offset: 0,
+            remaining: None,
+        }
+    }
+
+    /**
+     * Skip the first `offset` changes and stop after `limit` more, if set.
+     */
+    pub fn limit(&mut self, limit: Option<i64>, offset: i64) {
+        self.remaining = limit;
+        self.offset = offset;
+    }
+
+    /**
+     * Moves to the next change across all tables. Returns the statement
+     * positioned on that change or `None` once all tables are exhausted
+     * or the limit has been reached.
+     */
+    pub fn next(&mut self) -> Result<Option<*mut sqlite::stmt>, ResultCode> {
+        while self.offset > 0 {
+            self.offset -= 1;
+            if self.next_row()?.is_none() {
+                return Ok(None);
+            }
+        }
+        match self.remaining {
+            Some(0) => return Ok(None),
+            Some(n) => self.remaining = Some(n - 1),
+            None => {}
+        }
+        self.next_row()
+    }
+
+    fn next_row(&mut self) -> Result<Option<*mut sqlite::stmt>, ResultCode> {
+        if self.sequential {
+            let mut i = self.current.unwrap_or(0);
+            while i < self.stmts.len() {
+                let stmt = &self.stmts[i].1;
+                if stmt.step()? == ResultCode::ROW {
+                    self.current = Some(i);
+                    return Ok(Some(stmt.stmt));
+                }
+                i += 1;
+            }
+            // remember we're exhausted so a finished statement is never re-run
+            self.current = Some(i);
+            return Ok(None);
+        }
+
+        if let Some(i) = self.current.take() {
+            let stmt = &self.stmts[i].1;
+            if stmt.step()? == ResultCode::ROW {
+                self.heap.push(Reverse(ordering_key(stmt, i)));
+            }
+        }
+
+        match self.heap.pop() {
+            Some(Reverse((_, _, i))) => {
+                self.current = Some(i);
+                Ok(Some(self.stmts[i].1.stmt))
+            }
+            None => Ok(None),
+        }
+    }
+
+    pub fn release(self, cache: &mut ChangesStmtCache) {
+        for (sql, stmt) in self.stmts {
+            cache.put(sql, stmt);
+        }
+    }
+}
+
+fn ordering_key(stmt: &ManagedStmt, i: usize) -> (i64, i64, usize) {
+    (
+        stmt.column_int64(ClockUnionColumn::DbVrsn as i32),
+        stmt.column_int64(ClockUnionColumn::Seq as i32),
+        i,
+    )
+}
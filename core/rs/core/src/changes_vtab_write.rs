@@ -6,13 +6,16 @@ use core::ffi::{c_char, c_int};
 use core::mem;
 use sqlite::Stmt;
 use sqlite_nostd as sqlite;
-use sqlite_nostd::{sqlite3, ResultCode, Value};
+use sqlite_nostd::{sqlite3, ColumnType, ManagedStmt, ResultCode, Value};
 
 use crate::c::crsql_ExtData;
 use crate::c::{crsql_Changes_vtab, CrsqlChangesColumn};
-use crate::compare_values::crsql_compare_sqlite_values;
-use crate::pack_columns::bind_package_to_stmt;
+use crate::compare_values::{compare_column_value, crsql_compare_sqlite_values};
+use crate::db_version::next_merge_db_version;
+use crate::merge_stats::record_merge;
+use crate::pack_columns::{bind_package_to_stmt, bind_slot};
 use crate::pack_columns::{unpack_columns, ColumnValue};
+use crate::site_id_cache::site_id_cache;
 use crate::stmt_cache::reset_cached_stmt;
 use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, TableInfo};
 use crate::util::slab_rowid;
@@ -24,6 +27,10 @@ use crate::util::slab_rowid;
  * - early return because insert_cl < local_cl
  * - automatic win because insert_cl > local_cl
  * - come here to did_cid_win if insert_cl = local_cl
+ *
+ * The local col_version, value and site_id are read with a single lookup.
+ * If that finds nothing, because there is no clock entry or the row is missing,
+ * `did_cid_win_by_parts` sorts out which it was.
  */
 fn did_cid_win(
     db: *mut sqlite3,
@@ -32,7 +39,121 @@ fn did_cid_win(
     tbl_info: &TableInfo,
     unpacked_pks: &Vec<ColumnValue>,
     key: sqlite::int64,
-    insert_val: *mut sqlite::value,
+    insert_val: &MergeValue,
+    insert_site_id: &[u8],
+    col_name: &str,
+    col_version: sqlite::int64,
+    errmsg: *mut *mut c_char,
+) -> Result<bool, ResultCode> {
+    let conflict_stmt_ref = tbl_info.get_col_conflict_stmt(db, col_name)?;
+    let conflict_stmt = conflict_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
+
+    if let Err(rc) = conflict_stmt.bind_int64(1, key) {
+        reset_cached_stmt(conflict_stmt.stmt)?;
+        return Err(rc);
+    }
+
+    match conflict_stmt.step() {
+        Ok(ResultCode::ROW) => {
+            let local_version = conflict_stmt.column_int64(0);
+            if col_version != local_version {
+                reset_cached_stmt(conflict_stmt.stmt)?;
+                return Ok(version_outcome(
+                    ext_data,
+                    tbl_info,
+                    col_version,
+                    local_version,
+                ));
+            }
+
+            let mut ret = insert_val.compare(conflict_stmt.column_value(1)?);
+            let tie_break = ret == 0 && unsafe { (*ext_data).mergeEqualValues == 1 };
+            if tie_break {
+                if conflict_stmt.column_value(2)?.value_type() == ColumnType::Null {
+                    reset_cached_stmt(conflict_stmt.stmt)?;
+                    let err = CString::new(format!(
+                        "could not find site_id for previous change, cr-sqlite clock table might be corrupt for tbl {}",
+                        insert_tbl
+                    ))?;
+                    unsafe { *errmsg = err.into_raw() };
+                    return Err(ResultCode::ERROR);
+                }
+                ret = insert_site_id.cmp(conflict_stmt.column_blob(2)?) as c_int;
+            }
+            // reset the stmt after, we're accessing values in-memory
+            reset_cached_stmt(conflict_stmt.stmt)?;
+            Ok(value_outcome(ext_data, tbl_info, ret, tie_break))
+        }
+        Ok(ResultCode::DONE) => {
+            reset_cached_stmt(conflict_stmt.stmt)?;
+            did_cid_win_by_parts(
+                db,
+                ext_data,
+                insert_tbl,
+                tbl_info,
+                unpacked_pks,
+                key,
+                insert_val,
+                insert_site_id,
+                col_name,
+                col_version,
+                errmsg,
+            )
+        }
+        Ok(rc) | Err(rc) => {
+            reset_cached_stmt(conflict_stmt.stmt)?;
+            let err = CString::new("Bad return code when selecting local column state")?;
+            unsafe { *errmsg = err.into_raw() };
+            Err(rc)
+        }
+    }
+}
+
+/**
+ * Whether a column change with a different col_version than ours wins.
+ */
+fn version_outcome(
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    col_version: sqlite::int64,
+    local_version: sqlite::int64,
+) -> bool {
+    let won = col_version > local_version;
+    if !won {
+        unsafe { record_merge(ext_data, &tbl_info.tbl_name, |x| x.lost_on_version += 1) };
+    }
+    won
+}
+
+/**
+ * Whether a column change with our col_version wins given how it compared to
+ * our value or, if `tie_break`, how its site id compared to ours.
+ */
+fn value_outcome(
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    ret: c_int,
+    tie_break: bool,
+) -> bool {
+    if tie_break {
+        unsafe { record_merge(ext_data, &tbl_info.tbl_name, |x| x.site_id_tie_breaks += 1) };
+    } else if ret <= 0 {
+        unsafe { record_merge(ext_data, &tbl_info.tbl_name, |x| x.lost_on_value += 1) };
+    }
+    ret > 0
+}
+
+/**
+ * Reads the local col_version, value and site_id one statement at a time.
+ */
+fn did_cid_win_by_parts(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    insert_tbl: &str,
+    tbl_info: &TableInfo,
+    unpacked_pks: &Vec<ColumnValue>,
+    key: sqlite::int64,
+    insert_val: &MergeValue,
     insert_site_id: &[u8],
     col_name: &str,
     col_version: sqlite::int64,
@@ -56,10 +177,13 @@ fn did_cid_win(
             let local_version = col_vrsn_stmt.column_int64(0);
             reset_cached_stmt(col_vrsn_stmt.stmt)?;
             // causal lengths are the same. Fall back to original algorithm.
-            if col_version > local_version {
-                return Ok(true);
-            } else if col_version < local_version {
-                return Ok(false);
+            if col_version != local_version {
+                return Ok(version_outcome(
+                    ext_data,
+                    tbl_info,
+                    col_version,
+                    local_version,
+                ));
             }
         }
         Ok(ResultCode::DONE) => {
@@ -91,9 +215,10 @@ fn did_cid_win(
     match step_result {
         Ok(ResultCode::ROW) => {
             let local_value = col_val_stmt.column_value(0)?;
-            let mut ret = crsql_compare_sqlite_values(insert_val, local_value);
+            let mut ret = insert_val.compare(local_value);
             reset_cached_stmt(col_val_stmt.stmt)?;
-            if ret == 0 && unsafe { (*ext_data).mergeEqualValues == 1 } {
+            let tie_break = ret == 0 && unsafe { (*ext_data).mergeEqualValues == 1 };
+            if tie_break {
                 // values are the same (ret == 0) and the option to tie break on site_id is true
                 let col_site_id_stmt_ref = tbl_info.get_col_site_id_stmt(db)?;
                 let col_site_id_stmt = col_site_id_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
@@ -135,7 +260,7 @@ fn did_cid_win(
                     }
                 }
             }
-            return Ok(ret > 0);
+            return Ok(value_outcome(ext_data, tbl_info, ret, tie_break));
         }
         _ => {
             // ResultCode::DONE would happen if clock values exist but actual values are missing.
@@ -151,6 +276,14 @@ fn did_cid_win(
     }
 }
 
+/**
+ * Keeps the crr triggers from recording merged writes as local changes.
+ * This is the bit read by `crsql_internal_sync_bit()`, flipped without going through sql.
+ */
+unsafe fn set_sync_bit(ext_data: *mut crsql_ExtData, on: bool) {
+    *(*ext_data).pSyncBit = if on { 1 } else { 0 };
+}
+
 fn set_winner_clock(
     db: *mut sqlite3,
     ext_data: *mut crsql_ExtData,
@@ -162,51 +295,16 @@ fn set_winner_clock(
     insert_site_id: &[u8],
     insert_seq: sqlite::int64,
 ) -> Result<sqlite::int64, ResultCode> {
-    // set the site_id ordinal
-    // get the returned ordinal
-    // use that in place of insert_site_id in the metadata table(s)
-
-    // on changes read, join to gather the proper site id.
-    let ordinal = unsafe {
-        if insert_site_id.is_empty() {
-            None
-        } else {
-            (*ext_data).pSelectSiteIdOrdinalStmt.bind_blob(
-                1,
-                insert_site_id,
-                sqlite::Destructor::STATIC,
-            )?;
-            let rc = (*ext_data).pSelectSiteIdOrdinalStmt.step()?;
-            if rc == ResultCode::ROW {
-                let ordinal = (*ext_data).pSelectSiteIdOrdinalStmt.column_int64(0);
-                (*ext_data).pSelectSiteIdOrdinalStmt.clear_bindings()?;
-                (*ext_data).pSelectSiteIdOrdinalStmt.reset()?;
-
-                Some(ordinal)
-            } else {
-                (*ext_data).pSelectSiteIdOrdinalStmt.clear_bindings()?;
-                (*ext_data).pSelectSiteIdOrdinalStmt.reset()?;
-                // site id had no ordinal yet.
-                // set one and return the ordinal.
-                (*ext_data).pSetSiteIdOrdinalStmt.bind_blob(
-                    1,
-                    insert_site_id,
-                    sqlite::Destructor::STATIC,
-                )?;
-                let rc = (*ext_data).pSetSiteIdOrdinalStmt.step()?;
-                if rc == ResultCode::DONE {
-                    (*ext_data).pSetSiteIdOrdinalStmt.clear_bindings()?;
-                    (*ext_data).pSetSiteIdOrdinalStmt.reset()?;
-                    return Err(ResultCode::ABORT);
-                }
-                let ordinal = (*ext_data).pSetSiteIdOrdinalStmt.column_int64(0);
-                (*ext_data).pSetSiteIdOrdinalStmt.clear_bindings()?;
-                (*ext_data).pSetSiteIdOrdinalStmt.reset()?;
-                Some(ordinal)
-            }
-        }
+    // clock tables record the ordinal of the site rather than the site id itself.
+    // on changes read, the ordinal is mapped back to the site id.
+    let ordinal = if insert_site_id.is_empty() {
+        None
+    } else {
+        let mut site_ids = unsafe { site_id_cache(ext_data) };
+        Some(site_ids.get_or_create_ordinal(ext_data, insert_site_id)?)
     };
 
+    let db_vrsn = next_merge_db_version(db, ext_data, insert_db_vrsn).or(Err(ResultCode::ERROR))?;
     let set_stmt_ref = tbl_info.get_set_winner_clock_stmt(db)?;
     let set_stmt = set_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
@@ -218,7 +316,7 @@ fn set_winner_clock(
     let bind_result = set_stmt
         .bind_text(2, insert_col_name, sqlite::Destructor::STATIC)
         .and_then(|_| set_stmt.bind_int64(3, insert_col_vrsn))
-        .and_then(|_| set_stmt.bind_int64(4, insert_db_vrsn))
+        .and_then(|_| set_stmt.bind_int64(4, db_vrsn))
         .and_then(|_| set_stmt.bind_int64(5, insert_seq))
         .and_then(|_| match ordinal {
             Some(ordinal) => set_stmt.bind_int64(6, ordinal),
@@ -234,6 +332,7 @@ fn set_winner_clock(
         Ok(ResultCode::ROW) => {
             let rowid = set_stmt.column_int64(0);
             reset_cached_stmt(set_stmt.stmt)?;
+            unsafe { (*ext_data).dbVersionCheckedThisTx = 1 };
             Ok(rowid)
         }
         _ => {
@@ -263,32 +362,21 @@ fn merge_sentinel_only_insert(
         return Err(rc);
     }
     let rc = unsafe {
-        (*ext_data)
-            .pSetSyncBitStmt
-            .step()
-            .and_then(|_| (*ext_data).pSetSyncBitStmt.reset())
-            .and_then(|_| merge_stmt.step())
+        set_sync_bit(ext_data, true);
+        let rc = merge_stmt.step();
+        set_sync_bit(ext_data, false);
+        rc
     };
 
     // TODO: report err?
     let _ = reset_cached_stmt(merge_stmt.stmt);
 
-    let sync_rc = unsafe {
-        (*ext_data)
-            .pClearSyncBitStmt
-            .step()
-            .and_then(|_| (*ext_data).pClearSyncBitStmt.reset())
-    };
-
-    if let Err(sync_rc) = sync_rc {
-        return Err(sync_rc);
-    }
     if let Err(rc) = rc {
         return Err(rc);
     }
 
     if let Ok(_) = rc {
-        zero_clocks_on_resurrect(db, tbl_info, key, remote_db_vsn)?;
+        zero_clocks_on_resurrect(db, ext_data, tbl_info, key, remote_db_vsn)?;
         return set_winner_clock(
             db,
             ext_data,
@@ -307,15 +395,17 @@ fn merge_sentinel_only_insert(
 
 fn zero_clocks_on_resurrect(
     db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
     key: sqlite::int64,
     insert_db_vrsn: sqlite::int64,
 ) -> Result<ResultCode, ResultCode> {
+    let db_vrsn = next_merge_db_version(db, ext_data, insert_db_vrsn).or(Err(ResultCode::ERROR))?;
     let zero_stmt_ref = tbl_info.get_zero_clocks_on_resurrect_stmt(db)?;
     let zero_stmt = zero_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
 
     let ret = zero_stmt
-        .bind_int64(1, insert_db_vrsn)
+        .bind_int64(1, db_vrsn)
         .and_then(|_| zero_stmt.bind_int64(2, key))
         .and_then(|_| zero_stmt.step());
     reset_cached_stmt(zero_stmt.stmt)?;
@@ -340,22 +430,12 @@ unsafe fn merge_delete(
         reset_cached_stmt(delete_stmt.stmt)?;
         return Err(rc);
     }
-    let rc = (*ext_data)
-        .pSetSyncBitStmt
-        .step()
-        .and_then(|_| (*ext_data).pSetSyncBitStmt.reset())
-        .and_then(|_| delete_stmt.step());
+    set_sync_bit(ext_data, true);
+    let rc = delete_stmt.step();
+    set_sync_bit(ext_data, false);
 
     reset_cached_stmt(delete_stmt.stmt)?;
 
-    let sync_rc = (*ext_data)
-        .pClearSyncBitStmt
-        .step()
-        .and_then(|_| (*ext_data).pClearSyncBitStmt.reset());
-
-    if let Err(sync_rc) = sync_rc {
-        return Err(sync_rc);
-    }
     if let Err(rc) = rc {
         return Err(rc);
     }
@@ -412,10 +492,12 @@ fn get_local_cl(
         reset_cached_stmt(local_cl_stmt.stmt)?;
         return Err(rc);
     }
-    let rc = local_cl_stmt.bind_int64(2, key);
-    if let Err(rc) = rc {
-        reset_cached_stmt(local_cl_stmt.stmt)?;
-        return Err(rc);
+    if !tbl_info.pks_cl {
+        let rc = local_cl_stmt.bind_int64(2, key);
+        if let Err(rc) = rc {
+            reset_cached_stmt(local_cl_stmt.stmt)?;
+            return Err(rc);
+        }
     }
 
     let step_result = local_cl_stmt.step();
@@ -436,6 +518,60 @@ fn get_local_cl(
     }
 }
 
+/**
+ * The value carried by a change.
+ * Inserts into `crsql_changes` hand us sqlite values while
+ * `crsql_apply_changes` decodes them out of a packed changeset.
+ */
+pub enum MergeValue<'a> {
+    Raw(*mut sqlite::value),
+    Unpacked(&'a ColumnValue),
+}
+
+impl<'a> MergeValue<'a> {
+    fn bind(&self, stmt: &ManagedStmt, slot: i32) -> Result<ResultCode, ResultCode> {
+        match self {
+            MergeValue::Raw(value) => stmt.bind_value(slot, *value),
+            MergeValue::Unpacked(value) => bind_slot(slot as usize, value, stmt.stmt),
+        }
+    }
+
+    fn compare(&self, local_value: *mut sqlite::value) -> c_int {
+        match self {
+            MergeValue::Raw(value) => crsql_compare_sqlite_values(*value, local_value),
+            MergeValue::Unpacked(value) => compare_column_value(value, local_value),
+        }
+    }
+
+    /**
+     * The columns packed into the value of a row clock change.
+     */
+    fn unpack(&self) -> Result<Vec<ColumnValue>, ResultCode> {
+        match self {
+            MergeValue::Raw(value) if value.value_type() == ColumnType::Blob => {
+                unpack_columns(value.blob())
+            }
+            MergeValue::Unpacked(ColumnValue::Blob(blob)) => unpack_columns(blob),
+            _ => Err(ResultCode::MISMATCH),
+        }
+    }
+}
+
+/**
+ * A single change to merge. Mirrors the columns of `crsql_changes`.
+ */
+pub struct Change<'a> {
+    pub tbl: &'a str,
+    pub pks: &'a [u8],
+    pub cid: &'a str,
+    pub val: MergeValue<'a>,
+    pub col_vrsn: sqlite::int64,
+    pub db_vrsn: sqlite::int64,
+    pub site_id: &'a [u8],
+    pub cl: sqlite::int64,
+    pub seq: sqlite::int64,
+}
+
 unsafe fn merge_insert(
     vtab: *mut sqlite::vtab,
     argc: c_int,
@@ -470,21 +606,25 @@ unsafe fn merge_insert(
         return Err(ResultCode::ERROR);
     }
 
-    let insert_col = insert_col.text();
-    let insert_val = args[2 + CrsqlChangesColumn::Cval as usize];
-    let insert_col_vrsn = args[2 + CrsqlChangesColumn::ColVrsn as usize].int64();
-    let insert_db_vrsn = args[2 + CrsqlChangesColumn::DbVrsn as usize].int64();
     let insert_site_id = args[2 + CrsqlChangesColumn::SiteId as usize];
-    let insert_cl = args[2 + CrsqlChangesColumn::Cl as usize].int64();
-    let insert_seq = args[2 + CrsqlChangesColumn::Seq as usize].int64();
-
     if insert_site_id.bytes() > crate::consts::SITE_ID_LEN {
         let err = CString::new("crsql - site id exceeded max length")?;
         *errmsg = err.into_raw();
         return Err(ResultCode::ERROR);
     }
 
-    let insert_site_id = insert_site_id.blob();
+    let change = Change {
+        tbl: insert_tbl,
+        pks: insert_pks.blob(),
+        cid: insert_col.text(),
+        val: MergeValue::Raw(args[2 + CrsqlChangesColumn::Cval as usize]),
+        col_vrsn: args[2 + CrsqlChangesColumn::ColVrsn as usize].int64(),
+        db_vrsn: args[2 + CrsqlChangesColumn::DbVrsn as usize].int64(),
+        site_id: insert_site_id.blob(),
+        cl: args[2 + CrsqlChangesColumn::Cl as usize].int64(),
+        seq: args[2 + CrsqlChangesColumn::Seq as usize].int64(),
+    };
+
     let tbl_infos = mem::ManuallyDrop::new(Box::from_raw(
         (*(*tab).pExtData).tableInfos as *mut Vec<TableInfo>,
     ));
@@ -503,18 +643,62 @@ unsafe fn merge_insert(
     let tbl_info_index = tbl_info_index.unwrap();
 
     let tbl_info = &tbl_infos[tbl_info_index];
-    let unpacked_pks = unpack_columns(insert_pks.blob())?;
+    if let Some(inner_rowid) = merge_change(db, (*tab).pExtData, tbl_info, &change, errmsg)? {
+        *rowid = slab_rowid(tbl_info_index as i32, inner_rowid);
+    }
+    Ok(ResultCode::OK)
+}
 
-    // Get or create key as the first thing we do.
-    // We'll need the key for all later operations.
-    let key = tbl_info.get_or_create_key(db, &unpacked_pks)?;
+/**
+ * Merges a single change into `tbl_info`'s table.
+ *
+ * Returns the rowid of the clock entry the change was written to or
+ * `None` if the change lost or had nothing to do.
+ */
+pub unsafe fn merge_change(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    change: &Change,
+    errmsg: *mut *mut c_char,
+) -> Result<Option<sqlite::int64>, ResultCode> {
+    let unpacked_pks = unpack_columns(change.pks)?;
+    merge_unpacked_change(db, ext_data, tbl_info, change, &unpacked_pks, errmsg)
+}
 
-    let local_cl = get_local_cl(db, &tbl_info, key)?;
+/**
+ * `merge_change` for a change whose primary key has already been unpacked.
+ */
+unsafe fn merge_unpacked_change(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    change: &Change,
+    unpacked_pks: &Vec<ColumnValue>,
+    errmsg: *mut *mut c_char,
+) -> Result<Option<sqlite::int64>, ResultCode> {
+    let insert_tbl = change.tbl;
+    let insert_col = change.cid;
+    let insert_col_vrsn = change.col_vrsn;
+    let insert_db_vrsn = change.db_vrsn;
+    let insert_site_id = change.site_id;
+    let insert_cl = change.cl;
+    let insert_seq = change.seq;
+
+    // Only look the key up for now. A row without a key has no clock entries
+    // and so has a causal length of 0. The key is created once we know
+    // the change is going to be written.
+    let key = tbl_info.get_key_via_packed(db, change.pks, unpacked_pks)?;
+    let local_cl = match key {
+        Some(key) => get_local_cl(db, &tbl_info, key)?,
+        None => 0,
+    };
 
     // We can ignore all updates from older causal lengths.
     // They won't win at anything.
     if insert_cl < local_cl {
-        return Ok(ResultCode::OK);
+        record_merge(ext_data, &tbl_info.tbl_name, |x| x.stale += 1);
+        return Ok(None);
     }
 
     let is_delete = insert_cl % 2 == 0;
@@ -530,30 +714,25 @@ unsafe fn merge_insert(
         // We got a delete event but we've already processed a delete at that version.
         // Just bail.
         if insert_cl == local_cl {
-            return Ok(ResultCode::OK);
+            record_merge(ext_data, &tbl_info.tbl_name, |x| x.stale += 1);
+            return Ok(None);
         }
         // else, it is a delete and the cl is > than ours. Drop the row.
-        let merge_result = merge_delete(
+        let key = key_to_write(db, tbl_info, key, unpacked_pks)?;
+        let inner_rowid = merge_delete(
             db,
-            (*tab).pExtData,
+            ext_data,
             &tbl_info,
-            &unpacked_pks,
+            unpacked_pks,
             key,
             insert_col_vrsn,
             insert_db_vrsn,
             insert_site_id,
             insert_seq,
-        );
-        match merge_result {
-            Err(rc) => {
-                return Err(rc);
-            }
-            Ok(inner_rowid) => {
-                (*(*tab).pExtData).rowsImpacted += 1;
-                *rowid = slab_rowid(tbl_info_index as i32, inner_rowid);
-                return Ok(ResultCode::OK);
-            }
-        }
+        )?;
+        (*ext_data).rowsImpacted += 1;
+        record_merge(ext_data, &tbl_info.tbl_name, |x| x.deletes += 1);
+        return Ok(Some(inner_rowid));
     }
 
     /*
@@ -568,36 +747,52 @@ unsafe fn merge_insert(
         // If it is a sentinel but the local_cl already matches, nothing to do
         // as the local sentinel already has the same data!
         if insert_cl == local_cl {
-            return Ok(ResultCode::OK);
+            record_merge(ext_data, &tbl_info.tbl_name, |x| x.stale += 1);
+            return Ok(None);
         }
-        let merge_result = merge_sentinel_only_insert(
+        let key = key_to_write(db, tbl_info, key, unpacked_pks)?;
+        let inner_rowid = merge_sentinel_only_insert(
             db,
-            (*tab).pExtData,
+            ext_data,
             &tbl_info,
-            &unpacked_pks,
+            unpacked_pks,
             key,
             insert_col_vrsn,
             insert_db_vrsn,
             insert_site_id,
             insert_seq,
-        );
-        match merge_result {
-            Err(rc) => {
-                return Err(rc);
-            }
-            Ok(inner_rowid) => {
-                // a success & rowid of -1 means the merge was a no-op
-                if inner_rowid != -1 {
-                    (*(*tab).pExtData).rowsImpacted += 1;
-                    *rowid = slab_rowid(tbl_info_index as i32, inner_rowid);
-                    return Ok(ResultCode::OK);
-                } else {
-                    return Ok(ResultCode::OK);
-                }
-            }
+        )?;
+        // a success & rowid of -1 means the merge was a no-op
+        if inner_rowid != -1 {
+            (*ext_data).rowsImpacted += 1;
+            record_merge(ext_data, &tbl_info.tbl_name, |x| x.sentinel_only += 1);
+            return Ok(Some(inner_rowid));
+        } else {
+            record_merge(ext_data, &tbl_info.tbl_name, |x| x.stale += 1);
+            return Ok(None);
         }
     }
 
+    // Tables merged as whole rows only take changes to the row clock and vice versa.
+    let is_row_clock = crate::consts::ROW_CLOCK == insert_col;
+    if is_row_clock != tbl_info.row_clock.is_some() {
+        let err = CString::new(format!(
+            "crsql - {} is merged {} but got a change to {}",
+            insert_tbl,
+            if is_row_clock {
+                "column by column"
+            } else {
+                "as whole rows"
+            },
+            insert_col
+        ))?;
+        *errmsg = err.into_raw();
+        return Err(ResultCode::ERROR);
+    }
+
+    // A missing key means the row does not exist locally so the change wins.
+    let key = key_to_write(db, tbl_info, key, unpacked_pks)?;
+
     // we got a causal length which would resurrect the row.
     // In an in-order delivery situation then `sentinel_only` would have already resurrected the row
     // In out-of-order delivery, we need to resurrect the row as soon as we get a value
@@ -609,16 +804,17 @@ unsafe fn merge_insert(
         // and the version to set to is the cl not col_vrsn of current insert
         merge_sentinel_only_insert(
             db,
-            (*tab).pExtData,
+            ext_data,
             &tbl_info,
-            &unpacked_pks,
+            unpacked_pks,
             key,
             insert_cl,
             insert_db_vrsn,
             insert_site_id,
             insert_seq,
         )?;
-        (*(*tab).pExtData).rowsImpacted += 1;
+        (*ext_data).rowsImpacted += 1;
+        record_merge(ext_data, &tbl_info.tbl_name, |x| x.resurrects += 1);
     }
 
     // we can short-circuit via needs_resurrect
@@ -628,12 +824,12 @@ unsafe fn merge_insert(
         || !row_exists_locally
         || did_cid_win(
             db,
-            (*tab).pExtData,
+            ext_data,
             insert_tbl,
             &tbl_info,
-            &unpacked_pks,
+            unpacked_pks,
             key,
-            insert_val,
+            &change.val,
             insert_site_id,
             insert_col,
             insert_col_vrsn,
@@ -643,44 +839,38 @@ unsafe fn merge_insert(
     if !does_cid_win {
         // doesCidWin == 0? compared against our clocks, nothing wins. OK and
         // Done.
-        return Ok(ResultCode::OK);
+        return Ok(None);
     }
 
-    // TODO: this is all almost identical between all three merge cases!
-    let merge_stmt_ref = tbl_info.get_merge_insert_stmt(db, insert_col)?;
-    let merge_stmt = merge_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
-
-    let bind_result = bind_package_to_stmt(merge_stmt.stmt, &unpacked_pks, 0)
-        .and_then(|_| merge_stmt.bind_value(unpacked_pks.len() as i32 + 1, insert_val))
-        .and_then(|_| merge_stmt.bind_value(unpacked_pks.len() as i32 + 2, insert_val));
-    if let Err(rc) = bind_result {
-        reset_cached_stmt(merge_stmt.stmt)?;
-        return Err(rc);
-    }
-
-    let rc = (*(*tab).pExtData)
-        .pSetSyncBitStmt
-        .step()
-        .and_then(|_| (*(*tab).pExtData).pSetSyncBitStmt.reset())
-        .and_then(|_| merge_stmt.step());
+    if is_row_clock {
+        merge_row_clock_values(db, ext_data, tbl_info, unpacked_pks, &change.val, errmsg)?;
+    } else {
+        // TODO: this is all almost identical between all three merge cases!
+        let merge_stmt_ref = tbl_info.get_merge_insert_stmt(db, insert_col)?;
+        let merge_stmt = merge_stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
+
+        let bind_result = bind_package_to_stmt(merge_stmt.stmt, unpacked_pks, 0)
+            .and_then(|_| change.val.bind(merge_stmt, unpacked_pks.len() as i32 + 1))
+            .and_then(|_| change.val.bind(merge_stmt, unpacked_pks.len() as i32 + 2));
+        if let Err(rc) = bind_result {
+            reset_cached_stmt(merge_stmt.stmt)?;
+            return Err(rc);
+        }
 
-    reset_cached_stmt(merge_stmt.stmt)?;
+        set_sync_bit(ext_data, true);
+        let rc = merge_stmt.step();
+        set_sync_bit(ext_data, false);
 
-    let sync_rc = (*(*tab).pExtData)
-        .pClearSyncBitStmt
-        .step()
-        .and_then(|_| (*(*tab).pExtData).pClearSyncBitStmt.reset());
+        reset_cached_stmt(merge_stmt.stmt)?;
 
-    if let Err(rc) = rc {
-        return Err(rc);
-    }
-    if let Err(sync_rc) = sync_rc {
-        return Err(sync_rc);
+        if let Err(rc) = rc {
+            return Err(rc);
+        }
     }
 
-    let merge_result = set_winner_clock(
+    let inner_rowid = set_winner_clock(
         db,
-        (*tab).pExtData,
+        ext_data,
         &tbl_info,
         key,
         insert_col,
@@ -688,15 +878,263 @@ unsafe fn merge_insert(
         insert_db_vrsn,
         insert_site_id,
         insert_seq,
-    );
-    match merge_result {
-        Err(rc) => {
-            return Err(rc);
+    )?;
+    (*ext_data).rowsImpacted += 1;
+    record_merge(ext_data, &tbl_info.tbl_name, |x| x.applied += 1);
+    Ok(Some(inner_rowid))
+}
+
+/**
+ * Writes every non primary key column of a row from the packed value of a
+ * winning change to its row clock.
+ */
+unsafe fn merge_row_clock_values(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    unpacked_pks: &Vec<ColumnValue>,
+    val: &MergeValue,
+    errmsg: *mut *mut c_char,
+) -> Result<(), ResultCode> {
+    let values = val.unpack()?;
+    if values.len() != tbl_info.non_pks.len() {
+        let err = CString::new(format!(
+            "crsql - a row of {} has {} columns but the change has {}",
+            tbl_info.tbl_name,
+            tbl_info.non_pks.len(),
+            values.len()
+        ))?;
+        *errmsg = err.into_raw();
+        return Err(ResultCode::ERROR);
+    }
+
+    let cols = (0..tbl_info.non_pks.len()).collect::<Vec<_>>();
+    let merge_stmt = tbl_info.take_merge_row_stmt(db, &cols)?;
+    let rc = bind_package_to_stmt(merge_stmt.stmt, unpacked_pks, 0)
+        .and_then(|_| bind_package_to_stmt(merge_stmt.stmt, &values, unpacked_pks.len()))
+        .and_then(|_| {
+            set_sync_bit(ext_data, true);
+            let rc = merge_stmt.step();
+            set_sync_bit(ext_data, false);
+            rc
+        });
+    tbl_info.put_merge_row_stmt(cols, merge_stmt)?;
+    rc?;
+    Ok(())
+}
+
+/**
+ * The key of a row a change is about to be written to, creating it if the row has none.
+ */
+fn key_to_write(
+    db: *mut sqlite3,
+    tbl_info: &TableInfo,
+    key: Option<sqlite::int64>,
+    unpacked_pks: &Vec<ColumnValue>,
+) -> Result<sqlite::int64, ResultCode> {
+    match key {
+        Some(key) => Ok(key),
+        None => tbl_info.create_key(db, unpacked_pks),
+    }
+}
+
+/**
+ * Merges consecutive changes to the same row of `tbl_info`'s table.
+ *
+ * Column changes at the row's current causal length are decided one by one
+ * but only written once all of them are: the base row with a single upsert
+ * and their clock rows with a single insert. Deletes, sentinels, resurrections
+ * and a second change to an already won column go through `merge_change`
+ * after the winners so far are written.
+ *
+ * A row that has no key when we start has nothing locally to conflict with.
+ * That is every row when an empty replica pulls its initial copy. Its columns
+ * win without being checked unless this same run of changes already wrote them.
+ */
+pub unsafe fn merge_row(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    unpacked_pks: &Vec<ColumnValue>,
+    changes: &[Change],
+    errmsg: *mut *mut c_char,
+) -> Result<(), ResultCode> {
+    // A row clock change already carries the whole row
+    if changes.len() == 1 || tbl_info.row_clock.is_some() {
+        for change in changes {
+            merge_unpacked_change(db, ext_data, tbl_info, change, unpacked_pks, errmsg)?;
+        }
+        return Ok(());
+    }
+
+    let mut key = tbl_info.get_key_via_packed(db, changes[0].pks, unpacked_pks)?;
+    let mut local_cl = match key {
+        Some(key) => get_local_cl(db, &tbl_info, key)?,
+        None => 0,
+    };
+    let mut winners: Vec<(usize, &Change)> = Vec::new();
+    let is_new_row = key.is_none();
+    let mut written_cols: Vec<usize> = Vec::new();
+
+    for change in changes {
+        // the same no-ops `merge_change` would bail on
+        if change.cl < local_cl
+            || (change.cl == local_cl
+                && (change.cl % 2 == 0 || change.cid == crate::c::INSERT_SENTINEL))
+        {
+            record_merge(ext_data, &tbl_info.tbl_name, |x| x.stale += 1);
+            continue;
         }
-        Ok(inner_rowid) => {
-            (*(*tab).pExtData).rowsImpacted += 1;
-            *rowid = slab_rowid(tbl_info_index as i32, inner_rowid);
-            return Ok(ResultCode::OK);
+
+        let col_idx = tbl_info.row_patch_data_col_idx(change.cid);
+        if key.is_none()
+            && col_idx.is_some()
+            && change.cl % 2 == 1
+            && change.cid != crate::c::INSERT_SENTINEL
+        {
+            // Create the row the way `merge_change` would but leave its first
+            // column to be written with the rest.
+            let new_key = tbl_info.create_key(db, unpacked_pks)?;
+            if change.cl > 1 {
+                merge_sentinel_only_insert(
+                    db,
+                    ext_data,
+                    &tbl_info,
+                    unpacked_pks,
+                    new_key,
+                    change.cl,
+                    change.db_vrsn,
+                    change.site_id,
+                    change.seq,
+                )?;
+                (*ext_data).rowsImpacted += 1;
+                record_merge(ext_data, &tbl_info.tbl_name, |x| x.resurrects += 1);
+            }
+            key = Some(new_key);
+            local_cl = change.cl;
         }
+
+        if change.cl > local_cl || winners.iter().any(|(x, _)| Some(*x) == col_idx) {
+            if let Some(key) = key {
+                merge_row_winners(db, ext_data, tbl_info, unpacked_pks, key, &mut winners)?;
+            }
+            merge_unpacked_change(db, ext_data, tbl_info, change, unpacked_pks, errmsg)?;
+            if let Some(col_idx) = col_idx {
+                written_cols.push(col_idx);
+            }
+            if key.is_none() {
+                key = tbl_info.get_key_via_packed(db, changes[0].pks, unpacked_pks)?;
+            }
+            local_cl = match key {
+                Some(key) => get_local_cl(db, &tbl_info, key)?,
+                None => 0,
+            };
+            continue;
+        }
+
+        let col_idx = col_idx.ok_or(ResultCode::ERROR)?;
+        // the row is at a causal length > 0 so it has a key
+        let row_key = key.ok_or(ResultCode::ERROR)?;
+        let does_cid_win = (is_new_row && !written_cols.contains(&col_idx))
+            || did_cid_win(
+                db,
+                ext_data,
+                change.tbl,
+                &tbl_info,
+                unpacked_pks,
+                row_key,
+                &change.val,
+                change.site_id,
+                change.cid,
+                change.col_vrsn,
+                errmsg,
+            )?;
+        if does_cid_win {
+            winners.push((col_idx, change));
+            written_cols.push(col_idx);
+        }
+    }
+
+    match key {
+        Some(key) => merge_row_winners(db, ext_data, tbl_info, unpacked_pks, key, &mut winners),
+        None => Ok(()),
+    }
+}
+
+/**
+ * Writes the winning column changes of a row and clears `winners`.
+ * `winners` are `(position in non_pks, change)` pairs.
+ */
+unsafe fn merge_row_winners(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    tbl_info: &TableInfo,
+    unpacked_pks: &Vec<ColumnValue>,
+    key: sqlite::int64,
+    winners: &mut Vec<(usize, &Change)>,
+) -> Result<(), ResultCode> {
+    if winners.is_empty() {
+        return Ok(());
+    }
+    // a given set of columns always maps to the same statement.
+    // Clocks are still written in the order the changes came in since
+    // that decides the db versions they're given.
+    let mut by_col = winners.iter().collect::<Vec<_>>();
+    by_col.sort_by_key(|(col_idx, _)| *col_idx);
+    let cols = by_col
+        .iter()
+        .map(|(col_idx, _)| *col_idx)
+        .collect::<Vec<_>>();
+
+    let merge_stmt = tbl_info.take_merge_row_stmt(db, &cols)?;
+    let mut bind_result = bind_package_to_stmt(merge_stmt.stmt, unpacked_pks, 0);
+    for (i, (_, change)) in by_col.iter().enumerate() {
+        bind_result = bind_result.and_then(|_| {
+            change
+                .val
+                .bind(&merge_stmt, (unpacked_pks.len() + i + 1) as i32)
+        });
     }
+    let rc = bind_result.and_then(|_| {
+        set_sync_bit(ext_data, true);
+        let rc = merge_stmt.step();
+        set_sync_bit(ext_data, false);
+        rc
+    });
+    tbl_info.put_merge_row_stmt(cols, merge_stmt)?;
+    rc?;
+
+    let clocks_stmt = tbl_info.take_set_winner_clocks_stmt(db, winners.len())?;
+    let mut bind_result = Ok(ResultCode::OK);
+    for (i, (_, change)) in winners.iter().enumerate() {
+        let ordinal = if change.site_id.is_empty() {
+            None
+        } else {
+            let mut site_ids = site_id_cache(ext_data);
+            Some(site_ids.get_or_create_ordinal(ext_data, change.site_id)?)
+        };
+        let db_vrsn =
+            next_merge_db_version(db, ext_data, change.db_vrsn).or(Err(ResultCode::ERROR))?;
+        let slot = (i * 6) as i32;
+        bind_result = bind_result
+            .and_then(|_| clocks_stmt.bind_int64(slot + 1, key))
+            .and_then(|_| clocks_stmt.bind_text(slot + 2, change.cid, sqlite::Destructor::STATIC))
+            .and_then(|_| clocks_stmt.bind_int64(slot + 3, change.col_vrsn))
+            .and_then(|_| clocks_stmt.bind_int64(slot + 4, db_vrsn))
+            .and_then(|_| clocks_stmt.bind_int64(slot + 5, change.seq))
+            .and_then(|_| match ordinal {
+                Some(ordinal) => clocks_stmt.bind_int64(slot + 6, ordinal),
+                None => clocks_stmt.bind_null(slot + 6),
+            });
+    }
+    let rc = bind_result.and_then(|_| clocks_stmt.step());
+    tbl_info.put_set_winner_clocks_stmt(winners.len(), clocks_stmt)?;
+    rc?;
+
+    (*ext_data).dbVersionCheckedThisTx = 1;
+    (*ext_data).rowsImpacted += winners.len() as c_int;
+    let applied = winners.len() as i64;
+    record_merge(ext_data, &tbl_info.tbl_name, |x| x.applied += applied);
+    winners.clear();
+    Ok(())
 }
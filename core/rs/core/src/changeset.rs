@@ -0,0 +1,365 @@
+use alloc::collections::BTreeMap;
+use alloc::vec::Vec;
+use bytes::{Buf, BufMut};
+use core::str;
+use sqlite::Connection;
+use sqlite_nostd as sqlite;
+use sqlite_nostd::{ColumnType, Context, ResultCode, Stmt, Value};
+
+use crate::changes_vtab_write::{Change, MergeValue};
+use crate::pack_columns::{pack_value, unpack_value, ColumnValue};
+
+/**
+ * Compact changesets as produced by `crsql_changeset` and consumed by
+ * `crsql_apply_changes`.
+ *
+ * Format:
+ * [magic:u8, version:u8, ...changes]
+ *
+ * Each change is:
+ * - tbl: varint index into the table dictionary
+ * - pk: varint length followed by the packed primary key
+ * - cid: varint index into the column dictionary
+ * - val: a single value as written by `pack_value`
+ * - col_version: zigzag varint
+ * - db_version: zigzag varint delta from the prior change's db_version
+ * - site_id: varint, 0 for NULL otherwise 1 + index into the site id dictionary
+ * - cl: zigzag varint
+ * - seq: zigzag varint delta from the prior change's seq if the db_version is unchanged,
+ *   the seq itself otherwise
+ *
+ * Dictionaries start empty. An index equal to the current size of a dictionary
+ * introduces a new entry which follows inline as a varint length and its bytes.
+ *
+ * The magic byte can never be the first byte of a batch of `crsql_pack_columns`
+ * records since those start with the column count (9).
+ */
+pub const CHANGESET_MAGIC: u8 = 0xCE;
+const CHANGESET_VERSION: u8 = 1;
+
+pub fn is_changeset(data: &[u8]) -> bool {
+    data.first() == Some(&CHANGESET_MAGIC)
+}
+
+/**
+ * `select crsql_changeset(since)` or `select crsql_changeset(since, exclude_site_id)`
+ *
+ * Encodes the changes with a db_version greater than `since`, in the order
+ * `crsql_changes` returns them, into a single compact blob.
+ */
+pub extern "C" fn crsql_changeset(
+    ctx: *mut sqlite::context,
+    argc: i32,
+    argv: *mut *mut sqlite::value,
+) {
+    if argc != 1 && argc != 2 {
+        ctx.result_error(
+            "Wrong number of args provided to crsql_changeset. Provide the db_version to start after and optionally a site_id to exclude.",
+        );
+        return;
+    }
+    let args = sqlite::args!(argc, argv);
+    let exclude_site = if argc == 2 && args[1].value_type() != ColumnType::Null {
+        Some(args[1].blob())
+    } else {
+        None
+    };
+
+    match encode_changeset(ctx.db_handle(), args[0].int64(), exclude_site) {
+        Ok(blob) => ctx.result_blob_owned(blob),
+        Err(rc) => {
+            ctx.result_error("Failed to encode the changeset");
+            ctx.result_error_code(rc);
+        }
+    }
+}
+
+fn encode_changeset(
+    db: *mut sqlite::sqlite3,
+    since: sqlite::int64,
+    exclude_site: Option<&[u8]>,
+) -> Result<Vec<u8>, ResultCode> {
+    let sql = if exclude_site.is_some() {
+        "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes WHERE db_version > ? AND site_id IS NOT ?"
+    } else {
+        "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes WHERE db_version > ?"
+    };
+    let stmt = db.prepare_v2(sql)?;
+    stmt.bind_int64(1, since)?;
+    if let Some(site_id) = exclude_site {
+        stmt.bind_blob(2, site_id, sqlite::Destructor::STATIC)?;
+    }
+
+    let mut writer = ChangesetWriter::new();
+    while stmt.step()? == ResultCode::ROW {
+        writer.write(
+            stmt.column_value(0)?.text(),
+            stmt.column_value(1)?.blob(),
+            stmt.column_value(2)?.text(),
+            stmt.column_value(3)?,
+            stmt.column_int64(4),
+            stmt.column_int64(5),
+            stmt.column_value(6)?,
+            stmt.column_int64(7),
+            stmt.column_int64(8),
+        );
+    }
+
+    Ok(writer.finish())
+}
+
+struct ChangesetWriter {
+    buf: Vec<u8>,
+    tbls: BTreeMap<Vec<u8>, u64>,
+    cids: BTreeMap<Vec<u8>, u64>,
+    site_ids: BTreeMap<Vec<u8>, u64>,
+    db_vrsn: i64,
+    seq: i64,
+}
+
+impl ChangesetWriter {
+    fn new() -> Self {
+        let mut buf = Vec::new();
+        buf.put_u8(CHANGESET_MAGIC);
+        buf.put_u8(CHANGESET_VERSION);
+        Self {
+            buf,
+            tbls: BTreeMap::new(),
+            cids: BTreeMap::new(),
+            site_ids: BTreeMap::new(),
+            db_vrsn: 0,
+            seq: 0,
+        }
+    }
+
+    fn write(
+        &mut self,
+        tbl: &str,
+        pks: &[u8],
+        cid: &str,
+        val: *mut sqlite::value,
+        col_vrsn: i64,
+        db_vrsn: i64,
+        site_id: *mut sqlite::value,
+        cl: i64,
+        seq: i64,
+    ) {
+        put_dict_entry(&mut self.buf, &mut self.tbls, tbl.as_bytes(), 0);
+        put_bytes(&mut self.buf, pks);
+        put_dict_entry(&mut self.buf, &mut self.cids, cid.as_bytes(), 0);
+        pack_value(&mut self.buf, val);
+        put_zigzag(&mut self.buf, col_vrsn);
+        put_zigzag(&mut self.buf, db_vrsn.wrapping_sub(self.db_vrsn));
+        if site_id.value_type() == ColumnType::Null {
+            put_varint(&mut self.buf, 0);
+        } else {
+            put_dict_entry(&mut self.buf, &mut self.site_ids, site_id.blob(), 1);
+        }
+        put_zigzag(&mut self.buf, cl);
+        if db_vrsn == self.db_vrsn {
+            put_zigzag(&mut self.buf, seq.wrapping_sub(self.seq));
+        } else {
+            put_zigzag(&mut self.buf, seq);
+        }
+        self.db_vrsn = db_vrsn;
+        self.seq = seq;
+    }
+
+    fn finish(self) -> Vec<u8> {
+        self.buf
+    }
+}
+
+/**
+ * A change decoded out of a compact changeset. Names and site ids point into the changeset.
+ */
+pub struct ChangesetEntry<'a> {
+    tbl: &'a str,
+    pks: &'a [u8],
+    cid: &'a str,
+    val: ColumnValue,
+    col_vrsn: i64,
+    db_vrsn: i64,
+    site_id: &'a [u8],
+    cl: i64,
+    seq: i64,
+}
+
+impl<'a> ChangesetEntry<'a> {
+    pub fn as_change(&self) -> Change {
+        Change {
+            tbl: self.tbl,
+            pks: self.pks,
+            cid: self.cid,
+            val: MergeValue::Unpacked(&self.val),
+            col_vrsn: self.col_vrsn,
+            db_vrsn: self.db_vrsn,
+            site_id: self.site_id,
+            cl: self.cl,
+            seq: self.seq,
+        }
+    }
+}
+
+pub struct ChangesetReader<'a> {
+    buf: &'a [u8],
+    tbls: Vec<&'a str>,
+    cids: Vec<&'a str>,
+    site_ids: Vec<&'a [u8]>,
+    db_vrsn: i64,
+    seq: i64,
+}
+
+impl<'a> ChangesetReader<'a> {
+    pub fn new(data: &'a [u8]) -> Result<Self, ResultCode> {
+        let mut buf = data;
+        if buf.remaining() < 2 || buf.get_u8() != CHANGESET_MAGIC {
+            return Err(ResultCode::MISMATCH);
+        }
+        if buf.get_u8() != CHANGESET_VERSION {
+            return Err(ResultCode::MISMATCH);
+        }
+        Ok(Self {
+            buf,
+            tbls: Vec::new(),
+            cids: Vec::new(),
+            site_ids: Vec::new(),
+            db_vrsn: 0,
+            seq: 0,
+        })
+    }
+
+    pub fn next(&mut self) -> Result<Option<ChangesetEntry<'a>>, ResultCode> {
+        if !self.buf.has_remaining() {
+            return Ok(None);
+        }
+
+        let tbl = get_dict_entry(&mut self.buf, &mut self.tbls, 0)?;
+        let pks = get_bytes(&mut self.buf)?;
+        let cid = get_dict_entry(&mut self.buf, &mut self.cids, 0)?;
+        let val = unpack_value(&mut self.buf)?;
+        let col_vrsn = get_zigzag(&mut self.buf)?;
+        let db_vrsn = self.db_vrsn.wrapping_add(get_zigzag(&mut self.buf)?);
+        let site_id: &[u8] = if self.buf.first() == Some(&0) {
+            self.buf.advance(1);
+            &[]
+        } else {
+            get_dict_entry(&mut self.buf, &mut self.site_ids, 1)?
+        };
+        let cl = get_zigzag(&mut self.buf)?;
+        let seq = if db_vrsn == self.db_vrsn {
+            self.seq.wrapping_add(get_zigzag(&mut self.buf)?)
+        } else {
+            get_zigzag(&mut self.buf)?
+        };
+        self.db_vrsn = db_vrsn;
+        self.seq = seq;
+
+        Ok(Some(ChangesetEntry {
+            tbl,
+            pks,
+            cid,
+            val,
+            col_vrsn,
+            db_vrsn,
+            site_id,
+            cl,
+            seq,
+        }))
+    }
+}
+
+fn put_dict_entry(buf: &mut Vec<u8>, dict: &mut BTreeMap<Vec<u8>, u64>, entry: &[u8], base: u64) {
+    match dict.get(entry) {
+        Some(index) => put_varint(buf, base + index),
+        None => {
+            let index = dict.len() as u64;
+            dict.insert(entry.to_vec(), index);
+            put_varint(buf, base + index);
+            put_bytes(buf, entry);
+        }
+    }
+}
+
+fn get_dict_entry<'a, T: DictEntry<'a>>(
+    buf: &mut &'a [u8],
+    dict: &mut Vec<T>,
+    base: u64,
+) -> Result<T, ResultCode> {
+    let index = get_varint(buf)?
+        .checked_sub(base)
+        .ok_or(ResultCode::MISMATCH)? as usize;
+    if index < dict.len() {
+        Ok(dict[index])
+    } else if index == dict.len() {
+        let entry = T::from_bytes(get_bytes(buf)?)?;
+        dict.push(entry);
+        Ok(entry)
+    } else {
+        Err(ResultCode::MISMATCH)
+    }
+}
+
+trait DictEntry<'a>: Copy {
+    fn from_bytes(bytes: &'a [u8]) -> Result<Self, ResultCode>;
+}
+
+impl<'a> DictEntry<'a> for &'a [u8] {
+    fn from_bytes(bytes: &'a [u8]) -> Result<Self, ResultCode> {
+        Ok(bytes)
+    }
+}
+
+impl<'a> DictEntry<'a> for &'a str {
+    fn from_bytes(bytes: &'a [u8]) -> Result<Self, ResultCode> {
+        str::from_utf8(bytes).or(Err(ResultCode::MISMATCH))
+    }
+}
+
+fn put_bytes(buf: &mut Vec<u8>, bytes: &[u8]) {
+    put_varint(buf, bytes.len() as u64);
+    buf.put_slice(bytes);
+}
+
+fn get_bytes<'a>(buf: &mut &'a [u8]) -> Result<&'a [u8], ResultCode> {
+    let len = get_varint(buf)? as usize;
+    if buf.remaining() < len {
+        return Err(ResultCode::ABORT);
+    }
+    let (bytes, rest) = buf.split_at(len);
+    *buf = rest;
+    Ok(bytes)
+}
+
+fn put_varint(buf: &mut Vec<u8>, mut val: u64) {
+    while val >= 0x80 {
+        buf.put_u8((val as u8) | 0x80);
+        val >>= 7;
+    }
+    buf.put_u8(val as u8);
+}
+
+fn get_varint(buf: &mut &[u8]) -> Result<u64, ResultCode> {
+    let mut ret: u64 = 0;
+    let mut shift = 0;
+    loop {
+        if !buf.has_remaining() || shift > 63 {
+            return Err(ResultCode::ABORT);
+        }
+        let byte = buf.get_u8();
+        ret |= ((byte & 0x7F) as u64) << shift;
+        if byte & 0x80 == 0 {
+            return Ok(ret);
+        }
+        shift += 7;
+    }
+}
+
+fn put_zigzag(buf: &mut Vec<u8>, val: i64) {
+    put_varint(buf, ((val << 1) ^ (val >> 63)) as u64);
+}
+
+fn get_zigzag(buf: &mut &[u8]) -> Result<i64, ResultCode> {
+    let val = get_varint(buf)?;
+    Ok((val >> 1) as i64 ^ -((val & 1) as i64))
+}
@@ -1,6 +1,8 @@
 use alloc::format;
 use alloc::string::String;
 use core::ffi::c_int;
+
+use crate::pack_columns::ColumnValue;
 use sqlite::value;
 use sqlite::Value;
 use sqlite_nostd as sqlite;
@@ -44,6 +46,49 @@ pub fn crsql_compare_sqlite_values(l: *mut sqlite::value, r: *mut sqlite::value)
     }
 }
 
+/**
+ * Same ordering as `crsql_compare_sqlite_values` but for a value that was
+ * decoded out of a packed changeset rather than handed to us by sqlite.
+ */
+pub fn compare_column_value(l: &ColumnValue, r: *mut sqlite::value) -> c_int {
+    let l_type = match l {
+        ColumnValue::Blob(_) => sqlite::ColumnType::Blob,
+        ColumnValue::Float(_) => sqlite::ColumnType::Float,
+        ColumnValue::Integer(_) => sqlite::ColumnType::Integer,
+        ColumnValue::Null => sqlite::ColumnType::Null,
+        ColumnValue::Text(_) => sqlite::ColumnType::Text,
+    };
+    let r_type = r.value_type();
+
+    if l_type != r_type {
+        return (r_type as i32) - (l_type as i32);
+    }
+
+    match l {
+        ColumnValue::Blob(l_blob) => l_blob.as_slice().cmp(r.blob()) as c_int,
+        ColumnValue::Float(l_double) => {
+            let r_double = r.double();
+            if *l_double < r_double {
+                return -1;
+            } else if *l_double > r_double {
+                return 1;
+            }
+            return 0;
+        }
+        ColumnValue::Integer(l_int) => {
+            let r_int = r.int64();
+            if *l_int < r_int {
+                return -1;
+            } else if *l_int > r_int {
+                return 1;
+            }
+            return 0;
+        }
+        ColumnValue::Null => 0,
+        ColumnValue::Text(l_text) => l_text.as_str().cmp(r.text()) as c_int,
+    }
+}
+
 pub fn any_value_changed(left: &[*mut value], right: &[*mut value]) -> Result<bool, String> {
     if left.len() != right.len() {
         return Err(format!(
@@ -5,8 +5,31 @@ use sqlite_nostd as sqlite;
 use sqlite_nostd::{ResultCode, Value};
 
 use crate::c::crsql_ExtData;
+use crate::local_writes::captured_updates::captured_updates_available;
 
 pub const MERGE_EQUAL_VALUES: &str = "merge-equal-values";
+// The settings below are read when a table is first made into a crr and recorded
+// with it, see `crate::tableinfo::TableModes`. Changing them later, including
+// around a `crsql_begin_alter` / `crsql_commit_alter`, leaves existing crrs as they are.
+
+// Whether tables made into crrs from now on store their packed primary keys
+// in their `__crsql_pks` lookaside.
+pub const PACKED_PKS: &str = "packed-pks";
+// Whether tables made into crrs from now on keep the causal length of each row
+// in their `__crsql_pks` lookaside rather than only in the clock table's sentinel.
+pub const PKS_CL: &str = "pks-cl";
+// Whether tables made into crrs from now on have the preupdate hook, rather than
+// their update trigger, work out which columns an update changed.
+// Only available when SQLite is built with `SQLITE_ENABLE_PREUPDATE_HOOK`. Takes the
+// connection's one preupdate hook so can't be combined with the session extension
+// or another preupdate hook.
+pub const CAPTURE_UPDATES: &str = "capture-updates";
+// Whether tables made into crrs from now on get an update trigger per column so
+// updates only pass along the columns they set.
+pub const COLUMN_TRIGGERS: &str = "column-triggers";
+// Whether tables made into crrs from now on skip the clock rows of columns
+// inserted with their literal default value.
+pub const SPARSE_CLOCKS: &str = "sparse-clocks";
 
 pub extern "C" fn crsql_config_set(
     ctx: *mut sqlite::context,
@@ -24,6 +47,19 @@ pub extern "C" fn crsql_config_set(
             unsafe { (*ext_data).mergeEqualValues = value.int() };
             value
         }
+        // only read back when a table is first made into a crr
+        PACKED_PKS | PKS_CL | COLUMN_TRIGGERS | SPARSE_CLOCKS => args[1],
+        CAPTURE_UPDATES => {
+            let ext_data = ctx.user_data() as *mut crsql_ExtData;
+            if args[1].int() != 0 && !captured_updates_available(ext_data) {
+                ctx.result_error(
+                    "capture-updates requires SQLite built with SQLITE_ENABLE_PREUPDATE_HOOK",
+                );
+                ctx.result_error_code(ResultCode::ERROR);
+                return;
+            }
+            args[1]
+        }
         _ => {
             ctx.result_error("Unknown setting name");
             ctx.result_error_code(ResultCode::ERROR);
@@ -76,6 +112,15 @@ pub extern "C" fn crsql_config_get(
             let ext_data = ctx.user_data() as *mut crsql_ExtData;
             ctx.result_int(unsafe { (*ext_data).mergeEqualValues });
         }
+        PACKED_PKS | PKS_CL | CAPTURE_UPDATES | COLUMN_TRIGGERS | SPARSE_CLOCKS => {
+            match setting_enabled(ctx.db_handle(), name) {
+                Ok(enabled) => ctx.result_int(enabled as i32),
+                Err(rc) => {
+                    ctx.result_error("Could not read config from database");
+                    ctx.result_error_code(rc);
+                }
+            }
+        }
         _ => {
             ctx.result_error("Unknown setting name");
             ctx.result_error_code(ResultCode::ERROR);
@@ -83,3 +128,47 @@ pub extern "C" fn crsql_config_get(
         }
     }
 }
+
+/**
+ * The settings deciding how tables made into crrs are laid out and
+ * which triggers they get. See the constants above.
+ */
+#[derive(Clone, Copy, Default)]
+pub struct CrrSettings {
+    pub packed_pks: bool,
+    pub pks_cl: bool,
+    pub capture_updates: bool,
+    pub column_triggers: bool,
+    pub sparse_clocks: bool,
+}
+
+/**
+ * Reads every setting `create_crr` needs with a single query.
+ */
+pub fn crr_settings(db: *mut sqlite_nostd::sqlite3) -> Result<CrrSettings, ResultCode> {
+    let stmt = db.prepare_v2("SELECT key, value FROM crsql_master WHERE key LIKE 'config.%'")?;
+    let mut settings = CrrSettings::default();
+    while stmt.step()? == ResultCode::ROW {
+        let enabled = stmt.column_int(1) != 0;
+        match stmt.column_text(0)?.strip_prefix("config.") {
+            Some(PACKED_PKS) => settings.packed_pks = enabled,
+            Some(PKS_CL) => settings.pks_cl = enabled,
+            Some(CAPTURE_UPDATES) => settings.capture_updates = enabled,
+            Some(COLUMN_TRIGGERS) => settings.column_triggers = enabled,
+            Some(SPARSE_CLOCKS) => settings.sparse_clocks = enabled,
+            _ => {}
+        }
+    }
+    Ok(settings)
+}
+
+fn setting_enabled(db: *mut sqlite_nostd::sqlite3, name: &str) -> Result<bool, ResultCode> {
+    let stmt = db.prepare_v2("SELECT value FROM crsql_master WHERE key = ?")?;
+    stmt.bind_text(1, &format!("config.{name}"), sqlite::Destructor::TRANSIENT)?;
+
+    if let ResultCode::ROW = stmt.step()? {
+        Ok(stmt.column_int(0) != 0)
+    } else {
+        Ok(false)
+    }
+}
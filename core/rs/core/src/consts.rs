@@ -16,6 +16,9 @@ pub const CRSQLITE_VERSION_STR: &'static str = "0.16.3";
 pub const CRSQLITE_VERSION_0_15_0: i32 = 15_00_00;
 
 pub const SITE_ID_LEN: i32 = 16;
+// `col_name` of the one clock row kept per row by tables merged as whole rows,
+// i.e. made crrs with `crsql_as_crr(schema, table, 'row')`.
+pub const ROW_CLOCK: &'static str = "__crsql_row";
 pub const ROWID_SLAB_SIZE: i64 = 10000000000000;
 // db version is a signed 64bit int since sqlite doesn't support saving and
 // retrieving unsigned 64bit ints. (2^64 / 2) is a big enough number to write 1
@@ -3,6 +3,7 @@ extern crate alloc;
 use core::ffi::{c_char, c_int, c_void};
 
 use crate::alloc::borrow::ToOwned;
+use crate::c::crsql_ExtData;
 use crate::create_crr::create_crr;
 use alloc::boxed::Box;
 use alloc::format;
@@ -24,13 +25,13 @@ struct CLSetTab {
 // used in response to `create virtual table ... using clset`
 extern "C" fn create(
     db: *mut sqlite::sqlite3,
-    _aux: *mut c_void,
+    aux: *mut c_void,
     argc: c_int,
     argv: *const *const c_char,
     vtab: *mut *mut sqlite::vtab,
     err: *mut *mut c_char,
 ) -> c_int {
-    match create_impl(db, argc, argv, vtab, err) {
+    match create_impl(db, aux as *mut crsql_ExtData, argc, argv, vtab, err) {
         Ok(rc) => rc as c_int,
         Err(rc) => {
             // deallocate the vtab on error.
@@ -48,6 +49,7 @@ extern "C" fn create(
 
 fn create_impl(
     db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
     argc: c_int,
     argv: *const *const c_char,
     vtab: *mut *mut sqlite::vtab,
@@ -69,7 +71,7 @@ fn create_impl(
     create_clset_storage(db, &vtab_args, err)?;
     let schema = vtab_args.database_name;
     let table = base_name_from_virtual_name(vtab_args.table_name);
-    create_crr(db, schema, table, false, true, err)
+    create_crr(db, ext_data, schema, table, false, true, false, err)
 }
 
 fn create_clset_storage(
@@ -261,8 +263,11 @@ static MODULE: sqlite_nostd::module = sqlite_nostd::module {
     xIntegrity: None,
 };
 
-pub fn create_module(db: *mut sqlite::sqlite3) -> Result<ResultCode, ResultCode> {
-    db.create_module_v2("clset", &MODULE, None, None)?;
+pub fn create_module(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<ResultCode, ResultCode> {
+    db.create_module_v2("clset", &MODULE, Some(ext_data as *mut c_void), None)?;
 
     // xCreate(|x| 0);
 
@@ -1,22 +1,39 @@
+use alloc::format;
+use alloc::vec;
 use core::ffi::c_char;
 use sqlite_nostd as sqlite;
 use sqlite_nostd::ResultCode;
 
 use crate::bootstrap::create_clock_table;
-use crate::tableinfo::{is_table_compatible, pull_table_info};
+use crate::c::crsql_ExtData;
+use crate::config::crr_settings;
+use crate::local_writes::captured_updates::captured_updates_available;
+use crate::tableinfo::{
+    is_table_compatible, pull_table_info, read_table_modes, write_table_modes, ColumnInfo,
+    TableInfo, TableModes,
+};
 use crate::triggers::create_triggers;
+use crate::util::Countable;
 use crate::{backfill_table, is_crr, remove_crr_triggers_if_exist};
 
 /**
  * Create a new crr --
  * all triggers, views, tables
+ *
+ * `row_lww` makes the table merge whole rows, last writer wins, rather than
+ * column by column. Tables already merged as whole rows stay that way.
+ *
+ * The modes a table is made into a crr with, see `TableModes`, are recorded
+ * and kept for as long as it remains one, altered or not.
  */
 pub fn create_crr(
     db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
     _schema: &str,
     table: &str,
     is_commit_alter: bool,
     no_tx: bool,
+    row_lww: bool,
     err: *mut *mut c_char,
 ) -> Result<ResultCode, ResultCode> {
     if !is_table_compatible(db, table, err)? {
@@ -30,20 +47,84 @@ pub fn create_crr(
     // since nothing would exist in it for a table not yet made into a crr.
     // TODO: Note: we can optimize out our `ensureTableInfosAreUpToDate` by mutating our ext data
     // when upgrading stuff to CRRs
-    let table_info = pull_table_info(db, table, err)?;
+    let mut table_info = pull_table_info(db, table, err)?;
+    let modes = if is_commit_alter || has_clock_table(db, table)? {
+        // Crrs from before modes were recorded have none of them.
+        let modes = read_table_modes(db, table)?.unwrap_or_default();
+        TableModes {
+            // The modes may have been recorded by a build with the preupdate hook
+            // and read by one without it. Such builds fall back to the other triggers.
+            captured_updates: modes.captured_updates && captured_updates_available(ext_data),
+            ..modes
+        }
+    } else {
+        new_table_modes(db, ext_data, &table_info, row_lww)?
+    };
+    table_info.packed_pks = modes.packed_pks;
+    table_info.pks_cl = modes.pks_cl;
+    table_info.captured_updates = modes.captured_updates;
+    table_info.row_clock = if modes.row_lww {
+        Some(ColumnInfo::row_clock())
+    } else {
+        None
+    };
+    write_table_modes(db, table, &modes)?;
 
     create_clock_table(db, &table_info, err)?;
     remove_crr_triggers_if_exist(db, table)?;
-    create_triggers(db, &table_info, err)?;
+    create_triggers(db, &table_info, &modes, err)?;
 
+    let row_clock_cols;
+    let clocked_cols = match &table_info.row_clock {
+        Some(_) => {
+            row_clock_cols = vec![ColumnInfo::row_clock()];
+            &row_clock_cols
+        }
+        None => &table_info.non_pks,
+    };
     backfill_table(
         db,
         table,
         &table_info.pks,
-        &table_info.non_pks,
+        clocked_cols,
+        table_info.packed_pks,
         is_commit_alter,
         no_tx,
     )?;
 
     Ok(ResultCode::OK)
 }
+
+fn has_clock_table(db: *mut sqlite::sqlite3, table: &str) -> Result<bool, ResultCode> {
+    Ok(db.count(&format!(
+        "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = '{table}__crsql_clock'",
+        table = crate::util::escape_ident_as_value(table),
+    ))? > 0)
+}
+
+/**
+ * The modes for a table being made into a crr for the first time, from the
+ * current settings. Modes that make no difference to the table are left off.
+ */
+fn new_table_modes(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+    table_info: &TableInfo,
+    row_lww: bool,
+) -> Result<TableModes, ResultCode> {
+    let settings = crr_settings(db)?;
+    // A table of nothing but primary keys has no row to merge. Its sentinel clocks do.
+    let has_columns = !table_info.non_pks.is_empty();
+    let row_lww = has_columns && row_lww;
+    Ok(TableModes {
+        packed_pks: settings.packed_pks,
+        pks_cl: settings.pks_cl,
+        captured_updates: has_columns
+            && settings.capture_updates
+            && captured_updates_available(ext_data),
+        // Tables merged as whole rows have a single clock whatever the row holds
+        column_triggers: has_columns && !row_lww && settings.column_triggers,
+        sparse_clocks: has_columns && !row_lww && settings.sparse_clocks,
+        row_lww,
+    })
+}
@@ -58,7 +58,29 @@ pub fn next_db_version(
     merging_version: Option<i64>,
 ) -> Result<i64, String> {
     fill_db_version_if_needed(db, ext_data)?;
+    Ok(bump_db_version(ext_data, merging_version))
+}
+
+/**
+ * `next_db_version` for a change being merged.
+ *
+ * No other connection can commit while we hold the write lock so the db version
+ * only has to be checked against storage by the first merge of a transaction.
+ * The caller sets `dbVersionCheckedThisTx` once the change is written, which
+ * guarantees the commit or rollback hook runs and resets it.
+ */
+pub fn next_merge_db_version(
+    db: *mut sqlite3,
+    ext_data: *mut crsql_ExtData,
+    merging_version: i64,
+) -> Result<i64, String> {
+    if unsafe { (*ext_data).dbVersionCheckedThisTx } == 0 {
+        return next_db_version(db, ext_data, Some(merging_version));
+    }
+    Ok(bump_db_version(ext_data, Some(merging_version)))
+}
 
+fn bump_db_version(ext_data: *mut crsql_ExtData, merging_version: Option<i64>) -> i64 {
     let mut ret = unsafe { (*ext_data).dbVersion + 1 };
     if ret < unsafe { (*ext_data).pendingDbVersion } {
         ret = unsafe { (*ext_data).pendingDbVersion };
@@ -71,7 +93,7 @@ pub fn next_db_version(
     unsafe {
         (*ext_data).pendingDbVersion = ret;
     }
-    Ok(ret)
+    ret
 }
 
 pub fn fill_db_version_if_needed(
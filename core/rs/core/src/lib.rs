@@ -4,6 +4,7 @@
 // TODO: these pub mods are exposed for the integration testing
 // we should re-export in a `test` mod such that they do not become public apis
 mod alter;
+mod apply_changes;
 mod automigrate;
 mod backfill;
 #[cfg(feature = "test")]
@@ -17,6 +18,7 @@ mod c;
 mod changes_vtab;
 mod changes_vtab_read;
 mod changes_vtab_write;
+mod changeset;
 mod compare_values;
 mod config;
 mod consts;
@@ -29,11 +31,13 @@ mod db_version;
 mod ext_data;
 mod is_crr;
 mod local_writes;
+mod merge_stats;
 #[cfg(feature = "test")]
 pub mod pack_columns;
 #[cfg(not(feature = "test"))]
 mod pack_columns;
 mod sha;
+mod site_id_cache;
 mod stmt_cache;
 #[cfg(feature = "test")]
 pub mod tableinfo;
@@ -51,9 +55,11 @@ use core::mem;
 use core::ptr::null_mut;
 extern crate alloc;
 use alter::crsql_compact_post_alter;
+use apply_changes::crsql_apply_changes;
 use automigrate::*;
 use backfill::*;
 use c::{crsql_freeExtData, crsql_newExtData};
+use changeset::crsql_changeset;
 use config::{crsql_config_get, crsql_config_set};
 use core::ffi::{c_int, c_void, CStr};
 use create_crr::create_crr;
@@ -61,7 +67,10 @@ use db_version::{crsql_fill_db_version_if_needed, crsql_next_db_version};
 use is_crr::*;
 use local_writes::after_delete::x_crsql_after_delete;
 use local_writes::after_insert::x_crsql_after_insert;
-use local_writes::after_update::x_crsql_after_update;
+use local_writes::after_update::{
+    x_crsql_after_update, x_crsql_after_update_column, x_crsql_after_update_key,
+};
+use local_writes::captured_updates::x_crsql_after_update_captured;
 use sqlite::{Destructor, ResultCode};
 use sqlite_nostd as sqlite;
 use sqlite_nostd::{Connection, Context, Value};
@@ -97,6 +106,7 @@ pub extern "C" fn crsql_as_table(
 
 fn crsql_as_table_impl(db: *mut sqlite::sqlite3, table: &str) -> Result<ResultCode, ResultCode> {
     remove_crr_clock_table_if_exists(db, table)?;
+    tableinfo::remove_table_modes(db, table)?;
     remove_crr_triggers_if_exist(db, table)
 }
 
@@ -161,11 +171,6 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
-    let rc = create_cl_set_vtab::create_module(db).unwrap_or(ResultCode::ERROR);
-    if rc != ResultCode::OK {
-        return null_mut();
-    }
-
     let rc = crate::bootstrap::crsql_init_peer_tracking_table(db);
     if rc != ResultCode::OK as c_int {
         return null_mut();
@@ -217,6 +222,8 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         // no need to free the site id buffer here, this is cleaned up already.
         return null_mut();
     }
+    // merges flip the sync bit directly rather than through `crsql_internal_sync_bit`
+    unsafe { (*ext_data).pSyncBit = sync_bit_ptr };
 
     let rc = db
         .create_function_v2(
@@ -306,7 +313,7 @@ pub extern "C" fn sqlite3_crsqlcore_init(
     let rc = db
         .create_function_v2(
             "crsql_increment_and_get_seq",
-            0,
+            -1,
             sqlite::UTF8 | sqlite::INNOCUOUS,
             Some(ext_data as *mut c_void),
             Some(x_crsql_increment_and_get_seq),
@@ -342,7 +349,7 @@ pub extern "C" fn sqlite3_crsqlcore_init(
             "crsql_as_crr",
             -1,
             sqlite::UTF8 | sqlite::DETERMINISTIC,
-            None,
+            Some(ext_data as *mut c_void),
             Some(x_crsql_as_crr),
             None,
             None,
@@ -422,6 +429,57 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
+    let rc = db
+        .create_function_v2(
+            "crsql_after_update_key",
+            -1,
+            sqlite::UTF8 | sqlite::INNOCUOUS,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_after_update_key),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_after_update_column",
+            -1,
+            sqlite::UTF8 | sqlite::INNOCUOUS,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_after_update_column),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_after_update_captured",
+            -1,
+            sqlite::UTF8 | sqlite::INNOCUOUS,
+            Some(ext_data as *mut c_void),
+            Some(x_crsql_after_update_captured),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
     let rc = db
         .create_function_v2(
             "crsql_after_insert",
@@ -473,6 +531,52 @@ pub extern "C" fn sqlite3_crsqlcore_init(
         return null_mut();
     }
 
+    let rc = db
+        .create_function_v2(
+            "crsql_apply_changes",
+            -1,
+            sqlite::UTF8,
+            Some(ext_data as *mut c_void),
+            Some(crsql_apply_changes),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = merge_stats::create_module(db, ext_data).unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = create_cl_set_vtab::create_module(db, ext_data).unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
+    let rc = db
+        .create_function_v2(
+            "crsql_changeset",
+            -1,
+            sqlite::UTF8,
+            Some(ext_data as *mut c_void),
+            Some(crsql_changeset),
+            None,
+            None,
+            None,
+        )
+        .unwrap_or(ResultCode::ERROR);
+    if rc != ResultCode::OK {
+        unsafe { crsql_freeExtData(ext_data) };
+        return null_mut();
+    }
+
     let rc = db
         .create_function_v2(
             "crsql_config_set",
@@ -539,6 +643,10 @@ unsafe extern "C" fn x_crsql_finalize(
  * Takes a table name and turns it into a CRR.
  *
  * This allows users to create and modify tables as normal.
+ *
+ * `crsql_as_crr(schema, table, 'row')` makes a CRR that merges whole rows,
+ * last writer wins, keeping one clock per row rather than one per column.
+ * `'column'`, the default, merges column by column.
  */
 unsafe extern "C" fn x_crsql_as_crr(
     ctx: *mut sqlite::context,
@@ -554,12 +662,27 @@ unsafe extern "C" fn x_crsql_as_crr(
     }
 
     let args = sqlite::args!(argc, argv);
-    let (schema_name, table_name) = if argc == 2 {
+    let (schema_name, table_name) = if argc >= 2 {
         (args[0].text(), args[1].text())
     } else {
-        ("main\0", args[0].text())
+        ("main", args[0].text())
+    };
+    let row_lww = if argc >= 3 {
+        match args[2].text() {
+            "row" => true,
+            "column" => false,
+            _ => {
+                ctx.result_error(
+                    "The merge granularity passed to crsql_as_crr must be 'row' or 'column'.",
+                );
+                return;
+            }
+        }
+    } else {
+        false
     };
 
+    let ext_data = ctx.user_data() as *mut c::crsql_ExtData;
     let db = ctx.db_handle();
     let mut err_msg = null_mut();
     let rc = db.exec_safe("SAVEPOINT as_crr");
@@ -567,17 +690,20 @@ unsafe extern "C" fn x_crsql_as_crr(
         ctx.result_error("failed to start as_crr savepoint");
         return;
     }
-    let rc = crsql_create_crr(
+    let rc = create_crr(
         db,
-        schema_name.as_ptr() as *const c_char,
-        table_name.as_ptr() as *const c_char,
-        0,
-        0,
+        ext_data,
+        schema_name,
+        table_name,
+        false,
+        false,
+        row_lww,
         &mut err_msg as *mut _,
-    );
-    if rc != ResultCode::OK as c_int {
+    )
+    .unwrap_or_else(|err| err);
+    if rc != ResultCode::OK {
         sqlite::result_error(ctx, err_msg, -1);
-        sqlite::result_error_code(ctx, rc);
+        sqlite::result_error_code(ctx, rc as c_int);
         let _ = db.exec_safe("ROLLBACK");
         return;
     }
@@ -667,14 +793,17 @@ unsafe extern "C" fn x_crsql_commit_alter(
     );
 
     let rc = if rc == ResultCode::OK as c_int {
-        crsql_create_crr(
+        create_crr(
             db,
-            schema_name.as_ptr() as *const c_char,
-            table_name.as_ptr() as *const c_char,
-            1,
-            0,
+            ext_data,
+            schema_name,
+            table_name,
+            true,
+            false,
+            false,
             &mut err_msg as *mut _,
         )
+        .unwrap_or_else(|err| err) as c_int
     } else {
         rc
     };
@@ -701,14 +830,24 @@ unsafe extern "C" fn x_crsql_get_seq(
     ctx.result_int((*ext_data).seq);
 }
 
+/**
+ * `select crsql_increment_and_get_seq()` or `select crsql_increment_and_get_seq(n)`
+ *
+ * Returns the current seq and advances it by one, or by `n` when reserving a run of seqs.
+ */
 unsafe extern "C" fn x_crsql_increment_and_get_seq(
     ctx: *mut sqlite::context,
-    _argc: i32,
-    _argv: *mut *mut sqlite::value,
+    argc: i32,
+    argv: *mut *mut sqlite::value,
 ) {
     let ext_data = ctx.user_data() as *mut c::crsql_ExtData;
+    let n = if argc == 1 {
+        sqlite::args!(argc, argv)[0].int()
+    } else {
+        1
+    };
     ctx.result_int((*ext_data).seq);
-    (*ext_data).seq += 1;
+    (*ext_data).seq += n;
 }
 
 /**
@@ -850,6 +989,7 @@ pub extern "C" fn crsql_is_table_compatible(
 #[no_mangle]
 pub extern "C" fn crsql_create_crr(
     db: *mut sqlite::sqlite3,
+    ext_data: *mut c::crsql_ExtData,
     schema: *const c_char,
     table: *const c_char,
     is_commit_alter: c_int,
@@ -860,10 +1000,17 @@ pub extern "C" fn crsql_create_crr(
     let table = unsafe { CStr::from_ptr(table).to_str() };
 
     return match (table, schema) {
-        (Ok(table), Ok(schema)) => {
-            create_crr(db, schema, table, is_commit_alter != 0, no_tx != 0, err)
-                .unwrap_or_else(|err| err) as c_int
-        }
+        (Ok(table), Ok(schema)) => create_crr(
+            db,
+            ext_data,
+            schema,
+            table,
+            is_commit_alter != 0,
+            no_tx != 0,
+            false,
+            err,
+        )
+        .unwrap_or_else(|err| err) as c_int,
         _ => ResultCode::NOMEM as c_int,
     };
 }
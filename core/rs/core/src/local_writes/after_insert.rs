@@ -1,9 +1,11 @@
+use alloc::format;
 use alloc::string::String;
 use core::ffi::c_int;
 use sqlite::sqlite3;
 use sqlite::value;
 use sqlite::Context;
 use sqlite::ResultCode;
+use sqlite::Value;
 use sqlite_nostd as sqlite;
 
 use crate::{c::crsql_ExtData, tableinfo::TableInfo};
@@ -12,7 +14,10 @@ use super::bump_seq;
 use super::trigger_fn_preamble;
 
 /**
- * crsql_after_insert("table", pk_values...)
+ * crsql_after_insert("table", pk_values..., [non_pk_not_default...])
+ *
+ * Tables with sparse clocks also pass, for each non primary key column,
+ * whether it was inserted with something other than its default.
  */
 pub unsafe extern "C" fn x_crsql_after_insert(
     ctx: *mut sqlite::context,
@@ -20,7 +25,26 @@ pub unsafe extern "C" fn x_crsql_after_insert(
     argv: *mut *mut sqlite::value,
 ) {
     let result = trigger_fn_preamble(ctx, argc, argv, |table_info, values, ext_data| {
-        after_insert(ctx.db_handle(), ext_data, table_info, &values[1..])
+        let num_pks = table_info.pks.len();
+        let not_default = match values.len() - 1 - num_pks {
+            0 => None,
+            n if n == table_info.non_pks.len() => Some(&values[1 + num_pks..]),
+            _ => {
+                return Err(format!(
+                    "expected {} or {} values, got {}",
+                    1 + num_pks,
+                    1 + num_pks + table_info.non_pks.len(),
+                    values.len()
+                ))
+            }
+        };
+        after_insert(
+            ctx.db_handle(),
+            ext_data,
+            table_info,
+            &values[1..1 + num_pks],
+            not_default,
+        )
     });
 
     match result {
@@ -38,6 +62,7 @@ fn after_insert(
     ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
     pks_new: &[*mut value],
+    not_default: Option<&[*mut value]>,
 ) -> Result<ResultCode, String> {
     let db_version = crate::db_version::next_db_version(db, ext_data, None)?;
     let (create_record_existed, key_new) = tbl_info
@@ -53,8 +78,29 @@ fn after_insert(
         update_create_record(db, tbl_info, key_new, db_version, seq)?;
     }
 
+    // Tables merged as whole rows have one clock for all of their columns
+    if let Some(row_clock) = &tbl_info.row_clock {
+        let seq = bump_seq(ext_data);
+        return super::mark_locally_updated(db, tbl_info, key_new, row_clock, db_version, seq);
+    }
+
+    // A row new to us has no clocks yet. Columns left at their default don't get one
+    // and the sentinel records the row instead, which peers insert with defaults.
+    // Anything else could be overwriting a value peers have so every column is recorded.
+    let skip_column = |i: usize| match not_default {
+        Some(not_default) if !create_record_existed => not_default[i].int() == 0,
+        _ => false,
+    };
+    if (0..tbl_info.non_pks.len()).any(skip_column) {
+        let seq = bump_seq(ext_data);
+        super::mark_new_pk_row_created(db, tbl_info, key_new, db_version, seq)?;
+    }
+
     // now for each non-pk column, create or update the column record
-    for col in tbl_info.non_pks.iter() {
+    for (i, col) in tbl_info.non_pks.iter().enumerate() {
+        if skip_column(i) {
+            continue;
+        }
         let seq = bump_seq(ext_data);
         super::mark_locally_updated(db, tbl_info, key_new, col, db_version, seq)?;
     }
@@ -2,10 +2,12 @@ use core::ffi::c_int;
 
 use alloc::format;
 use alloc::string::String;
-use sqlite::{sqlite3, value, Context, ResultCode};
+use sqlite::{sqlite3, value, Context, ResultCode, Value};
 use sqlite_nostd as sqlite;
 
+use crate::c::crsql_total_changes;
 use crate::compare_values::crsql_compare_sqlite_values;
+use crate::pack_columns::pack_columns;
 use crate::{c::crsql_ExtData, tableinfo::TableInfo};
 
 use super::trigger_fn_preamble;
@@ -25,8 +27,7 @@ pub unsafe extern "C" fn x_crsql_after_update(
             table_info,
             pks_new,
             pks_old,
-            non_pks_new,
-            non_pks_old,
+            |i| crsql_compare_sqlite_values(non_pks_new[i], non_pks_old[i]) != 0,
         )
     });
 
@@ -40,6 +41,117 @@ pub unsafe extern "C" fn x_crsql_after_update(
     }
 }
 
+/**
+ * crsql_after_update_key("table", new_pk_values..., old_pk_values..., new_non_pk_values..., old_non_pk_values...)
+ *
+ * The `UPDATE OF` primary keys trigger of tables with per column update
+ * triggers. Takes care of every column of updates that change a primary key,
+ * and of none of them otherwise.
+ */
+pub unsafe extern "C" fn x_crsql_after_update_key(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    let result = trigger_fn_preamble(ctx, argc, argv, |table_info, values, ext_data| {
+        let (pks_new, pks_old, non_pks_new, non_pks_old) =
+            partition_values(values, 1, table_info.pks.len(), table_info.non_pks.len())?;
+        if !crate::compare_values::any_value_changed(pks_new, pks_old)? {
+            return Ok(ResultCode::OK);
+        }
+
+        after_update(
+            ctx.db_handle(),
+            ext_data,
+            table_info,
+            pks_new,
+            pks_old,
+            |i| crsql_compare_sqlite_values(non_pks_new[i], non_pks_old[i]) != 0,
+        )
+    });
+
+    match result {
+        Ok(_) => {
+            ctx.result_int64(0);
+        }
+        Err(msg) => {
+            ctx.result_error(&msg);
+        }
+    }
+}
+
+/**
+ * crsql_after_update_column("table", "column", new_value, old_value, new_pk_values..., old_pk_values...)
+ *
+ * The `UPDATE OF` trigger of a single non primary key column. Updates that
+ * also change the primary key are left to `crsql_after_update_key`.
+ */
+pub unsafe extern "C" fn x_crsql_after_update_column(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    let result = trigger_fn_preamble(ctx, argc, argv, |table_info, values, ext_data| {
+        let num_pks = table_info.pks.len();
+        if values.len() != 4 + num_pks * 2 {
+            return Err(format!(
+                "expected {} values, got {}",
+                4 + num_pks * 2,
+                values.len()
+            ));
+        }
+        let col_name = values[1].text();
+        let col = match table_info.non_pks.iter().position(|c| c.name == col_name) {
+            Some(col) => col,
+            None => {
+                return Err(format!(
+                    "column {} not found in {}",
+                    col_name, table_info.tbl_name
+                ))
+            }
+        };
+        let (pks_new, pks_old) = values[4..].split_at(num_pks);
+        if crate::compare_values::any_value_changed(pks_new, pks_old)? {
+            return Ok(ResultCode::OK);
+        }
+
+        let db = ctx.db_handle();
+        let next_db_version = crate::db_version::next_db_version(db, ext_data, None)?;
+        if crsql_compare_sqlite_values(values[2], values[3]) == 0 {
+            return Ok(ResultCode::OK);
+        }
+        // The triggers of the columns an update sets run one after the other so
+        // the row's key is looked up by the first and reused by the rest.
+        let packed_pks = pack_columns(pks_new).or_else(|_| Err("failed packing primary keys"))?;
+        let key = match table_info.cached_update_key(&packed_pks, crsql_total_changes(db)) {
+            Some(key) => key,
+            None => table_info
+                .get_or_create_key_via_raw_values(db, pks_new)
+                .or_else(|_| Err("failed geteting or creating lookaside key"))?,
+        };
+        let next_seq = super::bump_seq(ext_data);
+        super::mark_locally_updated(
+            db,
+            table_info,
+            key,
+            &table_info.non_pks[col],
+            next_db_version,
+            next_seq,
+        )?;
+        table_info.set_update_key(packed_pks, key, crsql_total_changes(db));
+        Ok(ResultCode::OK)
+    });
+
+    match result {
+        Ok(_) => {
+            ctx.result_int64(0);
+        }
+        Err(msg) => {
+            ctx.result_error(&msg);
+        }
+    }
+}
+
 fn partition_values<T>(
     values: &[T],
     offset: usize,
@@ -62,15 +174,21 @@ fn partition_values<T>(
     ))
 }
 
-fn after_update(
+/**
+ * Records an update of a row. `changed(i)` tells whether the update changed
+ * the value of the non primary key column at position `i` of `non_pks`.
+ */
+pub(super) fn after_update<F>(
     db: *mut sqlite3,
     ext_data: *mut crsql_ExtData,
     tbl_info: &TableInfo,
     pks_new: &[*mut value],
     pks_old: &[*mut value],
-    non_pks_new: &[*mut value],
-    non_pks_old: &[*mut value],
-) -> Result<ResultCode, String> {
+    changed: F,
+) -> Result<ResultCode, String>
+where
+    F: Fn(usize) -> bool,
+{
     let next_db_version = crate::db_version::next_db_version(db, ext_data, None)?;
     let new_key = tbl_info
         .get_or_create_key_via_raw_values(db, pks_new)
@@ -97,14 +215,26 @@ fn after_update(
         // }
     }
 
+    // Tables merged as whole rows have one clock for all of their columns
+    if let Some(row_clock) = &tbl_info.row_clock {
+        if (0..tbl_info.non_pks.len()).any(&changed) {
+            let next_seq = super::bump_seq(ext_data);
+            super::mark_locally_updated(
+                db,
+                tbl_info,
+                new_key,
+                row_clock,
+                next_db_version,
+                next_seq,
+            )?;
+        }
+        return Ok(ResultCode::OK);
+    }
+
     // now for each non_pk_col we need to do an insert
     // where new value is not old value
-    for ((new, old), col_info) in non_pks_new
-        .iter()
-        .zip(non_pks_old.iter())
-        .zip(tbl_info.non_pks.iter())
-    {
-        if crsql_compare_sqlite_values(*new, *old) != 0 {
+    for (i, col_info) in tbl_info.non_pks.iter().enumerate() {
+        if changed(i) {
             let next_seq = super::bump_seq(ext_data);
             // we had a difference in new and old values
             // we need to track crdt metadata
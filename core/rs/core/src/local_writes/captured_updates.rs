@@ -0,0 +1,328 @@
+use alloc::boxed::Box;
+use alloc::format;
+use alloc::string::{String, ToString};
+use alloc::vec::Vec;
+use core::ffi::{c_char, c_int, c_void, CStr};
+use core::mem::ManuallyDrop;
+
+use sqlite::{value, Context};
+use sqlite_nostd as sqlite;
+
+use crate::c::{crsql_ExtData, crsql_set_preupdate_hook};
+use crate::compare_values::crsql_compare_sqlite_values;
+use crate::pack_columns::pack_columns;
+use crate::tableinfo::TableInfo;
+
+use super::after_update::after_update;
+use super::trigger_fn_preamble;
+
+/**
+ * Only called when SQLite was built with `SQLITE_ENABLE_PREUPDATE_HOOK`.
+ * Without it `capturedUpdates` stays null and tables can't be set up to have
+ * their updates captured.
+ *
+ * The hook itself is installed by `ensure_preupdate_hook` once a table captures
+ * its updates. A connection has a single preupdate hook so such tables can't be
+ * used alongside the session extension or another preupdate hook.
+ */
+#[no_mangle]
+pub extern "C" fn crsql_init_captured_updates(ext_data: *mut crsql_ExtData) {
+    let captured = CapturedUpdates::new();
+    unsafe { (*ext_data).capturedUpdates = Box::into_raw(Box::new(captured)) as *mut c_void }
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_drop_captured_updates(ext_data: *mut crsql_ExtData) {
+    unsafe {
+        if !(*ext_data).capturedUpdates.is_null() {
+            drop(Box::from_raw(
+                (*ext_data).capturedUpdates as *mut CapturedUpdates,
+            ));
+        }
+    }
+}
+
+/**
+ * Drops updates that never made it to their trigger, e.g. because the
+ * statement that made them failed. Called on commit and rollback.
+ */
+#[no_mangle]
+pub extern "C" fn crsql_clear_captured_updates(ext_data: *mut crsql_ExtData) {
+    if let Some(mut captured) = unsafe { captured_updates(ext_data) } {
+        captured.pending.clear();
+    }
+}
+
+pub fn captured_updates_available(ext_data: *mut crsql_ExtData) -> bool {
+    !ext_data.is_null() && unsafe { !(*ext_data).capturedUpdates.is_null() }
+}
+
+unsafe fn captured_updates(
+    ext_data: *mut crsql_ExtData,
+) -> Option<ManuallyDrop<Box<CapturedUpdates>>> {
+    if (*ext_data).capturedUpdates.is_null() {
+        return None;
+    }
+    Some(ManuallyDrop::new(Box::from_raw(
+        (*ext_data).capturedUpdates as *mut CapturedUpdates,
+    )))
+}
+
+struct CapturedUpdate {
+    tbl_name: String,
+    // the row's new primary key values, packed
+    key: Vec<u8>,
+    // positions, in `non_pks`, of the columns the update changed.
+    changed: Vec<usize>,
+}
+
+/**
+ * Updates seen by the preupdate hook whose `AFTER UPDATE` trigger has yet to run.
+ *
+ * The hook fires before the row is written and can't write clock rows itself
+ * so it records which columns changed. The row's trigger then runs, with
+ * nothing but primary keys as arguments, and takes the update back off.
+ * Writes made by other triggers in between have their own hook and trigger
+ * run to completion first, hence a stack.
+ *
+ * Triggers of the user's may update the same row again before or after the
+ * row's own trigger runs, depending on the order triggers were created in.
+ * Updates are matched to their trigger by table and primary key, and the
+ * first trigger to run for a row takes the changes of every update of the row
+ * still pending. Those left behind record no change.
+ *
+ * The hook may not capture an update its trigger expects, e.g. when the table
+ * infos it reads are yet to be loaded. The trigger then counts every column as changed.
+ */
+pub struct CapturedUpdates {
+    pending: Vec<CapturedUpdate>,
+    hook_installed: bool,
+}
+
+impl CapturedUpdates {
+    pub fn new() -> Self {
+        CapturedUpdates {
+            pending: Vec::new(),
+            hook_installed: false,
+        }
+    }
+}
+
+const HOOK_REPLACED: &str = "the preupdate hook was replaced. Tables made with capture-updates \
+    can't be used alongside the session extension or another preupdate hook";
+
+/**
+ * Installs the preupdate hook if it isn't yet. Called once the table infos
+ * loaded include a table that captures its updates. Fails if the connection
+ * already had another preupdate hook, which is now replaced.
+ */
+pub fn ensure_preupdate_hook(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<(), &'static str> {
+    let mut captured = match unsafe { captured_updates(ext_data) } {
+        Some(captured) => captured,
+        None => return Ok(()),
+    };
+    if captured.hook_installed {
+        return Ok(());
+    }
+    captured.hook_installed = true;
+    let prior = unsafe { crsql_set_preupdate_hook(db, ext_data) };
+    if !prior.is_null() && prior != ext_data as *mut c_void {
+        return Err(HOOK_REPLACED);
+    }
+    Ok(())
+}
+
+/**
+ * Whether another preupdate hook took the place of ours after it was installed.
+ * Checked when an update wasn't captured. Finding out means putting ours back.
+ */
+fn preupdate_hook_replaced(db: *mut sqlite::sqlite3, ext_data: *mut crsql_ExtData) -> bool {
+    match unsafe { captured_updates(ext_data) } {
+        Some(captured) if captured.hook_installed => unsafe {
+            crsql_set_preupdate_hook(db, ext_data) != ext_data as *mut c_void
+        },
+        _ => false,
+    }
+}
+
+/**
+ * Whether updates to `tbl` should be handed to `crsql_capture_update`.
+ * Called from the preupdate hook before it reads any values.
+ *
+ * The hook runs in the middle of the user's statement so this runs no SQL.
+ */
+#[no_mangle]
+pub extern "C" fn crsql_captures_updates(
+    ext_data: *mut crsql_ExtData,
+    tbl: *const c_char,
+) -> c_int {
+    match unsafe { find_capturing_table(ext_data, tbl) } {
+        Some(_) => 1,
+        None => 0,
+    }
+}
+
+/**
+ * Records which non primary key columns of a row of `tbl` are about to change.
+ * `new_values` and `old_values` hold every column of the row, by cid.
+ */
+#[no_mangle]
+pub extern "C" fn crsql_capture_update(
+    ext_data: *mut crsql_ExtData,
+    tbl: *const c_char,
+    num_cols: c_int,
+    new_values: *mut *mut value,
+    old_values: *mut *mut value,
+) {
+    unsafe {
+        let (tbl_info, mut captured) = match (
+            find_capturing_table(ext_data, tbl),
+            captured_updates(ext_data),
+        ) {
+            (Some(tbl_info), Some(captured)) => (tbl_info, captured),
+            _ => return,
+        };
+        let new_values = core::slice::from_raw_parts(new_values, num_cols as usize);
+        let old_values = core::slice::from_raw_parts(old_values, num_cols as usize);
+        // The table infos aren't refreshed here so may predate a column being
+        // added or dropped, after which cids no longer line up. The row's trigger
+        // then finds nothing to take and counts every column as changed.
+        if tbl_info.pks.len() + tbl_info.non_pks.len() != new_values.len() {
+            return;
+        }
+        let pk_values = tbl_info
+            .pks
+            .iter()
+            .map(|col| new_values[col.cid as usize])
+            .collect::<Vec<_>>();
+        let key = match pack_columns(&pk_values) {
+            Ok(key) => key,
+            Err(_) => return,
+        };
+        let changed = tbl_info
+            .non_pks
+            .iter()
+            .enumerate()
+            .filter(|(_, col)| {
+                let cid = col.cid as usize;
+                crsql_compare_sqlite_values(new_values[cid], old_values[cid]) != 0
+            })
+            .map(|(i, _)| i)
+            .collect();
+        captured.pending.push(CapturedUpdate {
+            tbl_name: tbl_info.tbl_name.to_string(),
+            key,
+            changed,
+        });
+    }
+}
+
+unsafe fn find_capturing_table<'a>(
+    ext_data: *mut crsql_ExtData,
+    tbl: *const c_char,
+) -> Option<&'a TableInfo> {
+    if !captured_updates_available(ext_data) {
+        return None;
+    }
+    let tbl = match CStr::from_ptr(tbl).to_str() {
+        Ok(tbl) => tbl,
+        Err(_) => return None,
+    };
+    // Only the table infos already loaded. Refreshing them would run SQL and could
+    // finalize statements of the trigger about to fire.
+    let table_infos = (*ext_data).tableInfos as *const Vec<TableInfo>;
+    if table_infos.is_null() {
+        return None;
+    }
+    (*table_infos)
+        .iter()
+        .find(|t| t.captured_updates && t.tbl_name == tbl)
+}
+
+/**
+ * The columns changed by the updates captured for the row of `tbl_name`
+ * identified by `key`, merged. The latest of them is taken off and the others
+ * are left recording no change, for their own triggers to find. Anything
+ * captured after the latest never had its trigger run, e.g. because the table
+ * stopped capturing before its table infos were refreshed, and is dropped.
+ */
+fn take_captured_update(
+    captured: &mut CapturedUpdates,
+    tbl_name: &str,
+    key: &[u8],
+) -> Option<Vec<usize>> {
+    let pos = captured
+        .pending
+        .iter()
+        .rposition(|update| update.tbl_name == tbl_name && update.key == key)?;
+    let mut merged = Vec::new();
+    for update in captured
+        .pending
+        .iter_mut()
+        .filter(|update| update.tbl_name == tbl_name && update.key == key)
+    {
+        for i in core::mem::take(&mut update.changed) {
+            if !merged.contains(&i) {
+                merged.push(i);
+            }
+        }
+    }
+    captured.pending.truncate(pos);
+    Some(merged)
+}
+
+/**
+ * crsql_after_update_captured("table", new_pk_values..., old_pk_values...)
+ *
+ * The update trigger of tables whose changed columns are captured by the
+ * preupdate hook.
+ */
+pub unsafe extern "C" fn x_crsql_after_update_captured(
+    ctx: *mut sqlite::context,
+    argc: c_int,
+    argv: *mut *mut sqlite::value,
+) {
+    let result = trigger_fn_preamble(ctx, argc, argv, |table_info, values, ext_data| {
+        let num_pks = table_info.pks.len();
+        if values.len() != 1 + num_pks * 2 {
+            return Err(format!(
+                "expected {} values, got {}",
+                1 + num_pks * 2,
+                values.len()
+            ));
+        }
+        let key = pack_columns(&values[1..1 + num_pks])
+            .or_else(|_| Err("failed packing primary keys"))?;
+        let changed = match captured_updates(ext_data) {
+            Some(mut captured) => take_captured_update(&mut captured, &table_info.tbl_name, &key),
+            None => None,
+        };
+        if changed.is_none() && preupdate_hook_replaced(ctx.db_handle(), ext_data) {
+            return Err(HOOK_REPLACED.to_string());
+        }
+
+        after_update(
+            ctx.db_handle(),
+            ext_data,
+            table_info,
+            &values[1..1 + num_pks],
+            &values[1 + num_pks..],
+            |i| match &changed {
+                Some(changed) => changed.contains(&i),
+                None => true,
+            },
+        )
+    });
+
+    match result {
+        Ok(_) => {
+            ctx.result_int64(0);
+        }
+        Err(msg) => {
+            ctx.result_error(&msg);
+        }
+    }
+}
@@ -18,6 +18,7 @@ use crate::tableinfo::{crsql_ensure_table_infos_are_up_to_date, ColumnInfo, Tabl
 pub mod after_delete;
 pub mod after_insert;
 pub mod after_update;
+pub mod captured_updates;
 
 fn trigger_fn_preamble<F>(
     ctx: *mut sqlite::context,
@@ -130,8 +131,6 @@ fn mark_locally_updated(
         })
         .and_then(|_| mark_locally_updated_stmt.bind_int64(3, db_version))
         .and_then(|_| mark_locally_updated_stmt.bind_int(4, seq))
-        .and_then(|_| mark_locally_updated_stmt.bind_int64(5, db_version))
-        .and_then(|_| mark_locally_updated_stmt.bind_int(6, seq))
         .or_else(|_| Err("failed binding to mark_locally_updated_stmt"))?;
     step_trigger_stmt(mark_locally_updated_stmt)
 }
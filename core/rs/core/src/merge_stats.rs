@@ -0,0 +1,351 @@
+extern crate alloc;
+
+use core::ffi::{c_char, c_int, c_void};
+use core::mem::ManuallyDrop;
+
+use alloc::boxed::Box;
+use alloc::collections::BTreeMap;
+use alloc::string::{String, ToString};
+use alloc::vec::Vec;
+use sqlite::{Connection, Context};
+use sqlite_nostd as sqlite;
+use sqlite_nostd::ResultCode;
+
+use crate::c::{crsql_ExtData, crsql_current_time_ms};
+
+#[no_mangle]
+pub extern "C" fn crsql_init_merge_stats(db: *mut sqlite::sqlite3, ext_data: *mut crsql_ExtData) {
+    let stats = MergeStats::new(db);
+    unsafe { (*ext_data).mergeStats = Box::into_raw(Box::new(stats)) as *mut c_void }
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_drop_merge_stats(ext_data: *mut crsql_ExtData) {
+    unsafe {
+        drop(Box::from_raw((*ext_data).mergeStats as *mut MergeStats));
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_commit_merge_stats(ext_data: *mut crsql_ExtData) {
+    unsafe { merge_stats(ext_data) }.commit();
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_rollback_merge_stats(ext_data: *mut crsql_ExtData) {
+    unsafe { merge_stats(ext_data) }.rollback();
+}
+
+pub unsafe fn merge_stats(ext_data: *mut crsql_ExtData) -> ManuallyDrop<Box<MergeStats>> {
+    ManuallyDrop::new(Box::from_raw((*ext_data).mergeStats as *mut MergeStats))
+}
+
+/**
+ * Counts an outcome of merging a change into `tbl`.
+ */
+pub unsafe fn record_merge(
+    ext_data: *mut crsql_ExtData,
+    tbl: &str,
+    record: impl FnOnce(&mut TableMergeStats),
+) {
+    record(merge_stats(ext_data).table(tbl));
+}
+
+/**
+ * What became of the changes merged into a table.
+ * A column change that resurrects its row, or wins a site id tie break,
+ * is counted as applied as well.
+ */
+#[derive(Clone, Copy, Default)]
+pub struct TableMergeStats {
+    // column changes written
+    pub applied: i64,
+    // column changes with a lower col_version than ours
+    pub lost_on_version: i64,
+    // column changes at our col_version that lost comparing values
+    pub lost_on_value: i64,
+    // column changes with our col_version and value, decided by comparing site ids
+    pub site_id_tie_breaks: i64,
+    pub resurrects: i64,
+    pub deletes: i64,
+    pub sentinel_only: i64,
+    // changes from a causal length we've already moved past or already have
+    pub stale: i64,
+    // milliseconds from the first merge into the table in a transaction to its commit,
+    // summed over transactions
+    pub merge_ms: i64,
+}
+
+impl TableMergeStats {
+    fn add(&mut self, other: &TableMergeStats) {
+        self.applied += other.applied;
+        self.lost_on_version += other.lost_on_version;
+        self.lost_on_value += other.lost_on_value;
+        self.site_id_tie_breaks += other.site_id_tie_breaks;
+        self.resurrects += other.resurrects;
+        self.deletes += other.deletes;
+        self.sentinel_only += other.sentinel_only;
+        self.stale += other.stale;
+        self.merge_ms += other.merge_ms;
+    }
+}
+
+/**
+ * Merge outcomes of this connection, per table, since it was opened.
+ * Read through `crsql_merge_stats`.
+ *
+ * Outcomes of the current transaction are kept in `pending`, folded in when
+ * it commits and dropped if it rolls back. Rolling back to a savepoint keeps
+ * them, so merges undone that way are still counted.
+ *
+ * Merges are timed by the clock of the vfs, which only has milliseconds, and
+ * only read when a transaction first merges into a table and when it commits.
+ * `merge_ms` is then the time a transaction spent from its first merge into
+ * a table to its commit, including anything else it did in between. Time the
+ * statements inserting into `crsql_changes` for finer timings.
+ */
+pub struct MergeStats {
+    db: *mut sqlite::sqlite3,
+    tables: BTreeMap<String, TableMergeStats>,
+    // along with when the transaction first merged into the table
+    pending: BTreeMap<String, (i64, TableMergeStats)>,
+}
+
+impl MergeStats {
+    pub fn new(db: *mut sqlite::sqlite3) -> Self {
+        MergeStats {
+            db,
+            tables: BTreeMap::new(),
+            pending: BTreeMap::new(),
+        }
+    }
+
+    pub fn table(&mut self, tbl: &str) -> &mut TableMergeStats {
+        if !self.pending.contains_key(tbl) {
+            let now = unsafe { crsql_current_time_ms(self.db) };
+            self.pending
+                .insert(tbl.to_string(), (now, TableMergeStats::default()));
+        }
+        // just inserted if it was missing
+        &mut self.pending.get_mut(tbl).unwrap().1
+    }
+
+    pub fn commit(&mut self) {
+        if self.pending.is_empty() {
+            return;
+        }
+        let now = unsafe { crsql_current_time_ms(self.db) };
+        for (tbl, (started, mut stats)) in core::mem::take(&mut self.pending) {
+            stats.merge_ms = (now - started).max(0);
+            self.tables.entry(tbl).or_default().add(&stats);
+        }
+    }
+
+    pub fn rollback(&mut self) {
+        self.pending.clear();
+    }
+}
+
+enum Columns {
+    Table = 0,
+    Applied = 1,
+    LostOnVersion = 2,
+    LostOnValue = 3,
+    SiteIdTieBreaks = 4,
+    Resurrects = 5,
+    Deletes = 6,
+    SentinelOnly = 7,
+    Stale = 8,
+    MergeMs = 9,
+}
+
+#[repr(C)]
+struct MergeStatsVtab {
+    base: sqlite::vtab,
+    ext_data: *mut crsql_ExtData,
+}
+
+extern "C" fn connect(
+    db: *mut sqlite::sqlite3,
+    aux: *mut c_void,
+    _argc: c_int,
+    _argv: *const *const c_char,
+    vtab: *mut *mut sqlite::vtab,
+    _err: *mut *mut c_char,
+) -> c_int {
+    if let Err(rc) = sqlite::declare_vtab(
+        db,
+        "CREATE TABLE x([table] TEXT, applied INTEGER, lost_on_version INTEGER, lost_on_value INTEGER, site_id_tie_breaks INTEGER, resurrects INTEGER, deletes INTEGER, sentinel_only INTEGER, stale INTEGER, merge_ms INTEGER);",
+    ) {
+        return rc as c_int;
+    }
+
+    unsafe {
+        let boxed = Box::new(MergeStatsVtab {
+            base: sqlite::vtab {
+                nRef: 0,
+                pModule: core::ptr::null(),
+                zErrMsg: core::ptr::null_mut(),
+                #[cfg(feature = "libsql")]
+                pLibsqlModule: core::ptr::null_mut(),
+            },
+            ext_data: aux as *mut crsql_ExtData,
+        });
+        *vtab = Box::into_raw(boxed).cast::<sqlite::vtab>();
+        let _ = sqlite::vtab_config(db, sqlite::INNOCUOUS);
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn disconnect(vtab: *mut sqlite::vtab) -> c_int {
+    unsafe {
+        drop(Box::from_raw(vtab.cast::<MergeStatsVtab>()));
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn best_index(_vtab: *mut sqlite::vtab, _index_info: *mut sqlite::index_info) -> c_int {
+    // one row per table merged into. Always a full scan.
+    ResultCode::OK as c_int
+}
+
+#[repr(C)]
+struct Cursor {
+    base: sqlite::vtab_cursor,
+    crsr: usize,
+    // copied out on filter so merges while reading don't move rows around
+    rows: Vec<(String, TableMergeStats)>,
+}
+
+extern "C" fn open(_vtab: *mut sqlite::vtab, cursor: *mut *mut sqlite::vtab_cursor) -> c_int {
+    unsafe {
+        let boxed = Box::new(Cursor {
+            base: sqlite::vtab_cursor {
+                pVtab: core::ptr::null_mut(),
+            },
+            crsr: 0,
+            rows: Vec::new(),
+        });
+        *cursor = Box::into_raw(boxed).cast::<sqlite::vtab_cursor>();
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn close(cursor: *mut sqlite::vtab_cursor) -> c_int {
+    unsafe {
+        drop(Box::from_raw(cursor.cast::<Cursor>()));
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn filter(
+    cursor: *mut sqlite::vtab_cursor,
+    _idx_num: c_int,
+    _idx_str: *const c_char,
+    _argc: c_int,
+    _argv: *mut *mut sqlite::value,
+) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    unsafe {
+        let tab = (*cursor).pVtab.cast::<MergeStatsVtab>();
+        let stats = merge_stats((*tab).ext_data);
+        (*crsr).rows = stats
+            .tables
+            .iter()
+            .map(|(tbl, stats)| (tbl.clone(), *stats))
+            .collect();
+        (*crsr).crsr = 0;
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn next(cursor: *mut sqlite::vtab_cursor) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    unsafe {
+        (*crsr).crsr += 1;
+    }
+    ResultCode::OK as c_int
+}
+
+extern "C" fn eof(cursor: *mut sqlite::vtab_cursor) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    unsafe { ((*crsr).crsr >= (*crsr).rows.len()) as c_int }
+}
+
+extern "C" fn column(
+    cursor: *mut sqlite::vtab_cursor,
+    ctx: *mut sqlite::context,
+    col_num: c_int,
+) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    let (tbl, stats) = unsafe { &(*crsr).rows[(*crsr).crsr] };
+    let count = match col_num {
+        x if x == Columns::Table as c_int => {
+            ctx.result_text_static(tbl);
+            return ResultCode::OK as c_int;
+        }
+        x if x == Columns::Applied as c_int => stats.applied,
+        x if x == Columns::LostOnVersion as c_int => stats.lost_on_version,
+        x if x == Columns::LostOnValue as c_int => stats.lost_on_value,
+        x if x == Columns::SiteIdTieBreaks as c_int => stats.site_id_tie_breaks,
+        x if x == Columns::Resurrects as c_int => stats.resurrects,
+        x if x == Columns::Deletes as c_int => stats.deletes,
+        x if x == Columns::SentinelOnly as c_int => stats.sentinel_only,
+        x if x == Columns::Stale as c_int => stats.stale,
+        x if x == Columns::MergeMs as c_int => stats.merge_ms,
+        _ => return ResultCode::MISUSE as c_int,
+    };
+    ctx.result_int64(count);
+    ResultCode::OK as c_int
+}
+
+extern "C" fn rowid(cursor: *mut sqlite::vtab_cursor, row_id: *mut sqlite::int64) -> c_int {
+    let crsr = cursor.cast::<Cursor>();
+    unsafe { *row_id = (*crsr).crsr as i64 }
+    ResultCode::OK as c_int
+}
+
+static MODULE: sqlite_nostd::module = sqlite_nostd::module {
+    iVersion: 0,
+    xCreate: None,
+    xConnect: Some(connect),
+    xBestIndex: Some(best_index),
+    xDisconnect: Some(disconnect),
+    xDestroy: None,
+    xOpen: Some(open),
+    xClose: Some(close),
+    xFilter: Some(filter),
+    xNext: Some(next),
+    xEof: Some(eof),
+    xColumn: Some(column),
+    xRowid: Some(rowid),
+    xUpdate: None,
+    xBegin: None,
+    xSync: None,
+    xCommit: None,
+    xRollback: None,
+    xFindFunction: None,
+    xRename: None,
+    xSavepoint: None,
+    xRelease: None,
+    xRollbackTo: None,
+    xShadowName: None,
+    xIntegrity: None,
+};
+
+/**
+ * SELECT * FROM crsql_merge_stats;
+ */
+pub fn create_module(
+    db: *mut sqlite::sqlite3,
+    ext_data: *mut crsql_ExtData,
+) -> Result<ResultCode, ResultCode> {
+    db.create_module_v2(
+        "crsql_merge_stats",
+        &MODULE,
+        Some(ext_data as *mut c_void),
+        None,
+    )?;
+
+    Ok(ResultCode::OK)
+}
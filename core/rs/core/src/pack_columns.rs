@@ -28,7 +28,7 @@ pub extern "C" fn crsql_pack_columns(
     }
 }
 
-fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
+pub fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
     let mut buf = vec![];
     /*
      * Format:
@@ -46,38 +46,7 @@ fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
     if let Ok(len) = len_result {
         buf.put_u8(len);
         for value in args {
-            match value.value_type() {
-                ColumnType::Blob => {
-                    let len = value.bytes();
-                    let num_bytes_for_len = num_bytes_needed_i32(len);
-                    let type_byte = num_bytes_for_len << 3 | (ColumnType::Blob as u8);
-                    buf.put_u8(type_byte);
-                    buf.put_int(len as i64, num_bytes_for_len as usize);
-                    buf.put_slice(value.blob());
-                }
-                ColumnType::Null => {
-                    buf.put_u8(ColumnType::Null as u8);
-                }
-                ColumnType::Float => {
-                    buf.put_u8(ColumnType::Float as u8);
-                    buf.put_f64(value.double());
-                }
-                ColumnType::Integer => {
-                    let val = value.int64();
-                    let num_bytes_for_int = num_bytes_needed_i64(val);
-                    let type_byte = num_bytes_for_int << 3 | (ColumnType::Integer as u8);
-                    buf.put_u8(type_byte);
-                    buf.put_int(val, num_bytes_for_int as usize);
-                }
-                ColumnType::Text => {
-                    let len = value.bytes();
-                    let num_bytes_for_len = num_bytes_needed_i32(len);
-                    let type_byte = num_bytes_for_len << 3 | (ColumnType::Text as u8);
-                    buf.put_u8(type_byte);
-                    buf.put_int(len as i64, num_bytes_for_len as usize);
-                    buf.put_slice(value.blob());
-                }
-            }
+            pack_value(&mut buf, *value);
         }
         Ok(buf)
     } else {
@@ -85,6 +54,44 @@ fn pack_columns(args: &[*mut sqlite::value]) -> Result<Vec<u8>, ResultCode> {
     }
 }
 
+/**
+ * Appends a single value, encoded the same way `pack_columns` encodes each column.
+ */
+pub fn pack_value(buf: &mut Vec<u8>, value: *mut sqlite::value) {
+    match value.value_type() {
+        ColumnType::Blob => {
+            let len = value.bytes();
+            let num_bytes_for_len = num_bytes_needed_i32(len);
+            let type_byte = num_bytes_for_len << 3 | (ColumnType::Blob as u8);
+            buf.put_u8(type_byte);
+            buf.put_int(len as i64, num_bytes_for_len as usize);
+            buf.put_slice(value.blob());
+        }
+        ColumnType::Null => {
+            buf.put_u8(ColumnType::Null as u8);
+        }
+        ColumnType::Float => {
+            buf.put_u8(ColumnType::Float as u8);
+            buf.put_f64(value.double());
+        }
+        ColumnType::Integer => {
+            let val = value.int64();
+            let num_bytes_for_int = num_bytes_needed_i64(val);
+            let type_byte = num_bytes_for_int << 3 | (ColumnType::Integer as u8);
+            buf.put_u8(type_byte);
+            buf.put_int(val, num_bytes_for_int as usize);
+        }
+        ColumnType::Text => {
+            let len = value.bytes();
+            let num_bytes_for_len = num_bytes_needed_i32(len);
+            let type_byte = num_bytes_for_len << 3 | (ColumnType::Text as u8);
+            buf.put_u8(type_byte);
+            buf.put_int(len as i64, num_bytes_for_len as usize);
+            buf.put_slice(value.blob());
+        }
+    }
+}
+
 fn num_bytes_needed_i32(val: i32) -> u8 {
     if val & 0xFF000000u32 as i32 != 0 {
         return 4;
@@ -123,63 +130,79 @@ pub enum ColumnValue {
 
 // TODO: make a table valued function that can be used to extract a row per packed column?
 pub fn unpack_columns(data: &[u8]) -> Result<Vec<ColumnValue>, ResultCode> {
-    let mut ret = vec![];
     let mut buf = data;
+    unpack_columns_from(&mut buf)
+}
+
+/**
+ * Unpacks the packed columns at the front of `buf` and advances `buf` past them.
+ * Used to read many packed records laid end to end.
+ */
+pub fn unpack_columns_from(buf: &mut &[u8]) -> Result<Vec<ColumnValue>, ResultCode> {
+    let mut ret = vec![];
+    if !buf.has_remaining() {
+        return Err(ResultCode::ABORT);
+    }
     let num_columns = buf.get_u8();
 
     for _i in 0..num_columns {
-        if !buf.has_remaining() {
-            return Err(ResultCode::ABORT);
-        }
-        let column_type_and_maybe_intlen = buf.get_u8();
-        let column_type = ColumnType::from_u8(column_type_and_maybe_intlen & 0x07);
-        let intlen = (column_type_and_maybe_intlen >> 3 & 0xFF) as usize;
-
-        match column_type {
-            Some(ColumnType::Blob) => {
-                if buf.remaining() < intlen {
-                    return Err(ResultCode::ABORT);
-                }
-                let len = buf.get_int(intlen) as usize;
-                if buf.remaining() < len {
-                    return Err(ResultCode::ABORT);
-                }
-                let bytes = buf.copy_to_bytes(len);
-                ret.push(ColumnValue::Blob(bytes.to_vec()));
+        ret.push(unpack_value(buf)?);
+    }
+
+    Ok(ret)
+}
+
+/**
+ * Reads a single value written by `pack_value` off the front of `buf`.
+ */
+pub fn unpack_value(buf: &mut &[u8]) -> Result<ColumnValue, ResultCode> {
+    if !buf.has_remaining() {
+        return Err(ResultCode::ABORT);
+    }
+    let column_type_and_maybe_intlen = buf.get_u8();
+    let column_type = ColumnType::from_u8(column_type_and_maybe_intlen & 0x07);
+    let intlen = (column_type_and_maybe_intlen >> 3 & 0xFF) as usize;
+
+    match column_type {
+        Some(ColumnType::Blob) => {
+            if buf.remaining() < intlen {
+                return Err(ResultCode::ABORT);
             }
-            Some(ColumnType::Float) => {
-                if buf.remaining() < 8 {
-                    return Err(ResultCode::ABORT);
-                }
-                ret.push(ColumnValue::Float(buf.get_f64()));
+            let len = buf.get_int(intlen) as usize;
+            if buf.remaining() < len {
+                return Err(ResultCode::ABORT);
             }
-            Some(ColumnType::Integer) => {
-                if buf.remaining() < intlen {
-                    return Err(ResultCode::ABORT);
-                }
-                ret.push(ColumnValue::Integer(buf.get_int(intlen)));
+            let bytes = buf.copy_to_bytes(len);
+            Ok(ColumnValue::Blob(bytes.to_vec()))
+        }
+        Some(ColumnType::Float) => {
+            if buf.remaining() < 8 {
+                return Err(ResultCode::ABORT);
             }
-            Some(ColumnType::Null) => {
-                ret.push(ColumnValue::Null);
+            Ok(ColumnValue::Float(buf.get_f64()))
+        }
+        Some(ColumnType::Integer) => {
+            if buf.remaining() < intlen {
+                return Err(ResultCode::ABORT);
             }
-            Some(ColumnType::Text) => {
-                if buf.remaining() < intlen {
-                    return Err(ResultCode::ABORT);
-                }
-                let len = buf.get_int(intlen) as usize;
-                if buf.remaining() < len {
-                    return Err(ResultCode::ABORT);
-                }
-                let bytes = buf.copy_to_bytes(len);
-                ret.push(ColumnValue::Text(unsafe {
-                    String::from_utf8_unchecked(bytes.to_vec())
-                }))
+            Ok(ColumnValue::Integer(buf.get_int(intlen)))
+        }
+        Some(ColumnType::Null) => Ok(ColumnValue::Null),
+        Some(ColumnType::Text) => {
+            if buf.remaining() < intlen {
+                return Err(ResultCode::ABORT);
             }
-            None => return Err(ResultCode::MISUSE),
+            let len = buf.get_int(intlen) as usize;
+            if buf.remaining() < len {
+                return Err(ResultCode::ABORT);
+            }
+            let bytes = buf.copy_to_bytes(len);
+            Ok(ColumnValue::Text(unsafe {
+                String::from_utf8_unchecked(bytes.to_vec())
+            }))
         }
+        None => Err(ResultCode::MISUSE),
     }
-
-    Ok(ret)
 }
 
 pub fn bind_package_to_stmt(
@@ -193,7 +216,7 @@ pub fn bind_package_to_stmt(
     Ok(ResultCode::OK)
 }
 
-fn bind_slot(
+pub fn bind_slot(
     slot_num: usize,
     val: &ColumnValue,
     stmt: *mut sqlite::stmt,
@@ -0,0 +1,200 @@
+extern crate alloc;
+use alloc::boxed::Box;
+use alloc::collections::BTreeMap;
+use alloc::vec::Vec;
+use core::ffi::c_void;
+use core::mem::ManuallyDrop;
+
+use sqlite::{ResultCode, Stmt};
+use sqlite_nostd as sqlite;
+
+use crate::c::crsql_ExtData;
+
+#[no_mangle]
+pub extern "C" fn crsql_init_site_id_cache(ext_data: *mut crsql_ExtData) {
+    let cache = SiteIdCache::new();
+    unsafe { (*ext_data).siteIdCache = Box::into_raw(Box::new(cache)) as *mut c_void }
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_drop_site_id_cache(ext_data: *mut crsql_ExtData) {
+    unsafe {
+        drop(Box::from_raw((*ext_data).siteIdCache as *mut SiteIdCache));
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_commit_site_id_cache(ext_data: *mut crsql_ExtData) {
+    unsafe { site_id_cache(ext_data) }.commit();
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_rollback_site_id_cache(ext_data: *mut crsql_ExtData) {
+    unsafe { site_id_cache(ext_data) }.rollback();
+}
+
+pub unsafe fn site_id_cache(ext_data: *mut crsql_ExtData) -> ManuallyDrop<Box<SiteIdCache>> {
+    ManuallyDrop::new(Box::from_raw((*ext_data).siteIdCache as *mut SiteIdCache))
+}
+
+/**
+ * The `site_id <-> ordinal` mappings of `crsql_site_id`, kept on the connection.
+ *
+ * Clock tables record the ordinal of the site that wrote a change rather than its id.
+ * Merging a change needs the ordinal of its site and reading a change needs the id back.
+ * Rather than hitting `crsql_site_id` for every change we remember what we've seen.
+ *
+ * Ordinals are only ever appended so a committed mapping never changes. An ordinal
+ * assigned by the current transaction, however, is given out again if that transaction
+ * or the savepoint it was assigned under rolls back. Mappings that may not be committed
+ * are kept in `pending` which is dropped on rollback and folded in on commit.
+ */
+pub struct SiteIdCache {
+    ordinals: BTreeMap<Vec<u8>, i64>,
+    site_ids: BTreeMap<i64, Vec<u8>>,
+    pending: BTreeMap<Vec<u8>, i64>,
+    // set once this transaction assigns an ordinal. Until it ends anything
+    // read from `crsql_site_id` could be uncommitted.
+    assigned_this_tx: bool,
+    // holds a site id read while `assigned_this_tx` since those can't be cached
+    scratch: Vec<u8>,
+}
+
+impl SiteIdCache {
+    pub fn new() -> Self {
+        SiteIdCache {
+            ordinals: BTreeMap::new(),
+            site_ids: BTreeMap::new(),
+            pending: BTreeMap::new(),
+            assigned_this_tx: false,
+            scratch: Vec::new(),
+        }
+    }
+
+    /**
+     * The ordinal of `site_id`, assigning it one if the site is new to us.
+     */
+    pub fn get_or_create_ordinal(
+        &mut self,
+        ext_data: *mut crsql_ExtData,
+        site_id: &[u8],
+    ) -> Result<i64, ResultCode> {
+        if let Some(ordinal) = self.get_ordinal(ext_data, site_id)? {
+            return Ok(ordinal);
+        }
+
+        let stmt = unsafe { (*ext_data).pSetSiteIdOrdinalStmt };
+        stmt.bind_blob(1, site_id, sqlite::Destructor::STATIC)?;
+        let rc = stmt.step();
+        let ordinal = match rc {
+            Ok(ResultCode::ROW) => Ok(stmt.column_int64(0)),
+            Ok(_) => Err(ResultCode::ABORT),
+            Err(rc) => Err(rc),
+        };
+        stmt.clear_bindings()?;
+        stmt.reset()?;
+        let ordinal = ordinal?;
+
+        self.assigned_this_tx = true;
+        self.pending.insert(site_id.to_vec(), ordinal);
+        Ok(ordinal)
+    }
+
+    /**
+     * The ordinal of `site_id` or None if it has not been assigned one.
+     */
+    pub fn get_ordinal(
+        &mut self,
+        ext_data: *mut crsql_ExtData,
+        site_id: &[u8],
+    ) -> Result<Option<i64>, ResultCode> {
+        if let Some(ordinal) = self.ordinals.get(site_id) {
+            return Ok(Some(*ordinal));
+        }
+        if let Some(ordinal) = self.pending.get(site_id) {
+            return Ok(Some(*ordinal));
+        }
+
+        let stmt = unsafe { (*ext_data).pSelectSiteIdOrdinalStmt };
+        stmt.bind_blob(1, site_id, sqlite::Destructor::STATIC)?;
+        let rc = stmt.step();
+        let ordinal = match rc {
+            Ok(ResultCode::ROW) => Ok(Some(stmt.column_int64(0))),
+            Ok(_) => Ok(None),
+            Err(rc) => Err(rc),
+        };
+        stmt.clear_bindings()?;
+        stmt.reset()?;
+        let ordinal = ordinal?;
+
+        if let Some(ordinal) = ordinal {
+            if self.assigned_this_tx {
+                self.pending.insert(site_id.to_vec(), ordinal);
+            } else {
+                self.insert(site_id.to_vec(), ordinal);
+            }
+        }
+        Ok(ordinal)
+    }
+
+    /**
+     * The site id with the given ordinal or None if there is no such ordinal.
+     */
+    pub fn get_site_id(
+        &mut self,
+        ext_data: *mut crsql_ExtData,
+        ordinal: i64,
+    ) -> Result<Option<&[u8]>, ResultCode> {
+        if self.site_ids.contains_key(&ordinal) {
+            return Ok(self.site_ids.get(&ordinal).map(|x| &x[..]));
+        }
+
+        let stmt = unsafe { (*ext_data).pSelectSiteIdByOrdinalStmt };
+        stmt.bind_int64(1, ordinal)?;
+        let rc = stmt.step();
+        let site_id = match rc {
+            Ok(ResultCode::ROW) => Ok(Some(stmt.column_blob(0)?.to_vec())),
+            Ok(_) => Ok(None),
+            Err(rc) => Err(rc),
+        };
+        stmt.clear_bindings()?;
+        stmt.reset()?;
+
+        match site_id? {
+            Some(site_id) if self.assigned_this_tx => {
+                self.scratch = site_id;
+                Ok(Some(&self.scratch[..]))
+            }
+            Some(site_id) => {
+                self.insert(site_id, ordinal);
+                Ok(self.site_ids.get(&ordinal).map(|x| &x[..]))
+            }
+            None => Ok(None),
+        }
+    }
+
+    fn insert(&mut self, site_id: Vec<u8>, ordinal: i64) {
+        self.site_ids.insert(ordinal, site_id.clone());
+        self.ordinals.insert(site_id, ordinal);
+    }
+
+    pub fn commit(&mut self) {
+        for (site_id, ordinal) in core::mem::take(&mut self.pending) {
+            self.insert(site_id, ordinal);
+        }
+        self.assigned_this_tx = false;
+    }
+
+    pub fn rollback(&mut self) {
+        self.pending.clear();
+        self.assigned_this_tx = false;
+    }
+
+    /**
+     * Forgets mappings that may be undone by rolling back to a savepoint.
+     * The transaction has still assigned ordinals so nothing new is treated as committed.
+     */
+    pub fn rollback_to_savepoint(&mut self) {
+        self.pending.clear();
+    }
+}
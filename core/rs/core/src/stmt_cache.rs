@@ -1,9 +1,11 @@
 extern crate alloc;
+use alloc::string::String;
 use alloc::vec::Vec;
+use core::ffi::c_void;
 use core::mem::ManuallyDrop;
 
 use alloc::boxed::Box;
-use sqlite::Stmt;
+use sqlite::{ManagedStmt, Stmt};
 use sqlite_nostd as sqlite;
 use sqlite_nostd::ResultCode;
 
@@ -22,6 +24,76 @@ pub extern "C" fn crsql_clear_stmt_cache(ext_data: *mut crsql_ExtData) {
         // TODO: return an error.
         let _ = tbl_info.clear_stmts();
     }
+    let mut changes_stmts = unsafe {
+        ManuallyDrop::new(Box::from_raw(
+            (*ext_data).changesStmtCache as *mut ChangesStmtCache,
+        ))
+    };
+    changes_stmts.clear();
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_init_changes_stmt_cache(ext_data: *mut crsql_ExtData) {
+    let cache = ChangesStmtCache::new();
+    unsafe { (*ext_data).changesStmtCache = Box::into_raw(Box::new(cache)) as *mut c_void }
+}
+
+#[no_mangle]
+pub extern "C" fn crsql_drop_changes_stmt_cache(ext_data: *mut crsql_ExtData) {
+    unsafe {
+        drop(Box::from_raw(
+            (*ext_data).changesStmtCache as *mut ChangesStmtCache,
+        ));
+    }
+}
+
+const MAX_CACHED_CHANGES_STMTS: usize = 16;
+
+/**
+ * Statements used to read from `crsql_changes`, keyed by their sql.
+ *
+ * Sync loops poll `crsql_changes` with the same handful of queries
+ * over and over. Caching the statements skips re-parsing and re-planning
+ * the union over every clock table on each poll.
+ *
+ * A statement is removed from the cache while a cursor is using it so
+ * that nested or concurrent queries against `crsql_changes` never share one.
+ * The cache is cleared whenever table infos are re-pulled since the set of
+ * tables, and thus the sql, will have changed.
+ */
+pub struct ChangesStmtCache {
+    // least recently used first
+    stmts: Vec<(String, ManagedStmt)>,
+}
+
+impl ChangesStmtCache {
+    pub fn new() -> Self {
+        ChangesStmtCache { stmts: Vec::new() }
+    }
+
+    pub fn take(&mut self, sql: &str) -> Option<(String, ManagedStmt)> {
+        let pos = self.stmts.iter().position(|(x, _)| x == sql)?;
+        Some(self.stmts.remove(pos))
+    }
+
+    pub fn put(&mut self, sql: String, stmt: ManagedStmt) {
+        // A statement that can't be reset is in a bad state. Let it be finalized.
+        if reset_cached_stmt(stmt.stmt).is_err() {
+            return;
+        }
+        // Another cursor may have prepared its own copy while this one was in use.
+        if self.stmts.iter().any(|(x, _)| *x == sql) {
+            return;
+        }
+        if self.stmts.len() >= MAX_CACHED_CHANGES_STMTS {
+            self.stmts.remove(0);
+        }
+        self.stmts.push((sql, stmt));
+    }
+
+    pub fn clear(&mut self) {
+        self.stmts.clear();
+    }
 }
 
 pub fn reset_cached_stmt(stmt: *mut sqlite::stmt) -> Result<ResultCode, ResultCode> {
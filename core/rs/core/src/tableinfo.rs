@@ -2,9 +2,10 @@ use crate::alloc::string::ToString;
 use crate::c::crsql_ExtData;
 use crate::c::crsql_fetchPragmaSchemaVersion;
 use crate::c::TABLE_INFO_SCHEMA_VERSION;
+use crate::local_writes::captured_updates::ensure_preupdate_hook;
 use crate::pack_columns::bind_package_to_stmt;
 use crate::pack_columns::ColumnValue;
-use crate::stmt_cache::reset_cached_stmt;
+use crate::stmt_cache::{reset_cached_stmt, ChangesStmtCache};
 use crate::util::Countable;
 use alloc::boxed::Box;
 use alloc::format;
@@ -16,6 +17,7 @@ use core::cell::RefCell;
 use core::ffi::c_char;
 use core::ffi::c_int;
 use core::ffi::c_void;
+use core::mem;
 use core::mem::forget;
 use num_traits::ToPrimitive;
 use sqlite::sqlite3;
@@ -27,10 +29,26 @@ use sqlite_nostd::ResultCode;
 use sqlite_nostd::Stmt;
 use sqlite_nostd::StrRef;
 
+// Bounds each of the caches of statements built for a particular set of columns.
+// Rows from peers usually change the same few sets of columns.
+const MAX_CACHED_MERGE_STMTS: usize = 8;
+
 pub struct TableInfo {
     pub tbl_name: String,
     pub pks: Vec<ColumnInfo>,
     pub non_pks: Vec<ColumnInfo>,
+    // true if the `__crsql_pks` lookaside stores the packed primary key
+    // of each row in `__crsql_packed`
+    pub packed_pks: bool,
+    // true if the `__crsql_pks` lookaside keeps the causal length of each row
+    // in `__crsql_cl`
+    pub pks_cl: bool,
+    // true if the preupdate hook works out which columns an update to the table
+    // changed. See `crate::local_writes::captured_updates`.
+    pub captured_updates: bool,
+    // Set for tables merged as whole rows, see `crate::consts::ROW_CLOCK`.
+    // Such tables keep a single clock row per row, under this pseudo column.
+    pub row_clock: Option<ColumnInfo>,
 
     // Lookaside --
     // insert returning?
@@ -40,6 +58,7 @@ pub struct TableInfo {
     select_key_stmt: RefCell<Option<ManagedStmt>>,
     insert_key_stmt: RefCell<Option<ManagedStmt>>,
     insert_or_ignore_returning_key_stmt: RefCell<Option<ManagedStmt>>,
+    select_key_by_packed_stmt: RefCell<Option<ManagedStmt>>,
 
     // For merges --
     set_winner_clock_stmt: RefCell<Option<ManagedStmt>>,
@@ -56,6 +75,11 @@ pub struct TableInfo {
     // This also means that col_version is not always >= 1. A resurrected column,
     // which missed a delete event, will have a 0 version.
     zero_clocks_on_resurrect_stmt: RefCell<Option<ManagedStmt>>,
+    // Upserts of several columns of a row at once keyed by the positions,
+    // in `non_pks`, of the columns they write. Least recently used first.
+    merge_row_stmts: RefCell<Vec<(Vec<usize>, ManagedStmt)>>,
+    // Inserts of several clock rows at once keyed by the number of rows.
+    set_winner_clocks_stmts: RefCell<Vec<(usize, ManagedStmt)>>,
 
     // For local writes --
     mark_locally_deleted_stmt: RefCell<Option<ManagedStmt>>,
@@ -63,11 +87,49 @@ pub struct TableInfo {
     mark_locally_created_stmt: RefCell<Option<ManagedStmt>>,
     mark_locally_updated_stmt: RefCell<Option<ManagedStmt>>,
     maybe_mark_locally_reinserted_stmt: RefCell<Option<ManagedStmt>>,
+
+    // For reads --
+    // Selects every non-pk column of a row so all the column changes
+    // of that row can be served from a single lookup.
+    row_patch_data_stmt: RefCell<Option<ManagedStmt>>,
+    // Bounds of the clock and lookaside tables. Used when costing reads.
+    change_bounds_stmt: RefCell<Option<ManagedStmt>>,
+    // The last stats read and the db_version they were read at.
+    change_stats: RefCell<Option<(i64, ChangeStats)>>,
+    // The row the last per column update trigger wrote to: its packed primary keys,
+    // lookaside key and the connection's change count once written.
+    update_key: RefCell<Option<(Vec<u8>, sqlite::int64, c_int)>>,
+}
+
+/**
+ * Rough shape of the change history of a table.
+ * Used to cost queries against `crsql_changes`.
+ */
+#[derive(Clone, Copy)]
+pub struct ChangeStats {
+    // rows in the clock table
+    pub rows: f64,
+    // average number of clock rows that share a db_version
+    pub rows_per_version: f64,
+    pub min_db_version: i64,
+    pub max_db_version: i64,
+}
+
+/**
+ * Whether stats read at `read_at`, if ever, are due to be read again at `db_version`.
+ * They are once the db_version has grown by an eighth since, so a database
+ * taking writes rereads them less and less often.
+ */
+pub fn stats_are_due(read_at: Option<i64>, db_version: i64) -> bool {
+    match read_at {
+        Some(read_at) => db_version - read_at > read_at / 8,
+        None => true,
+    }
 }
 
 impl TableInfo {
     fn find_non_pk_col(&self, col_name: &str) -> Result<&ColumnInfo, ResultCode> {
-        for col in &self.non_pks {
+        for col in self.non_pks.iter().chain(self.row_clock.iter()) {
             if col.name == col_name {
                 return Ok(col);
             }
@@ -80,25 +142,74 @@ impl TableInfo {
         db: *mut sqlite3,
         pks: &Vec<ColumnValue>,
     ) -> Result<sqlite::int64, ResultCode> {
+        match self.get_key(db, pks)? {
+            Some(key) => Ok(key),
+            None => self.create_key(db, pks),
+        }
+    }
+
+    /**
+     * Looks up the key of a primary key without creating one if it is missing.
+     */
+    pub fn get_key(
+        &self,
+        db: *mut sqlite3,
+        pks: &Vec<ColumnValue>,
+    ) -> Result<Option<sqlite::int64>, ResultCode> {
         let stmt_ref = self.get_select_key_stmt(db)?;
         let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
-        bind_package_to_stmt(stmt.stmt, pks, 0)?;
+        if let Err(rc) = bind_package_to_stmt(stmt.stmt, pks, 0) {
+            reset_cached_stmt(stmt.stmt)?;
+            return Err(rc);
+        }
         match stmt.step() {
             Ok(ResultCode::DONE) => {
-                // create it
                 reset_cached_stmt(stmt.stmt)?;
-                let ret = self.create_key(db, pks)?;
-                return Ok(ret);
+                Ok(None)
             }
             Ok(ResultCode::ROW) => {
-                // return it
                 let ret = stmt.column_int64(0);
                 reset_cached_stmt(stmt.stmt)?;
-                return Ok(ret);
+                Ok(Some(ret))
             }
             Ok(rc) | Err(rc) => {
                 reset_cached_stmt(stmt.stmt)?;
-                return Err(rc);
+                Err(rc)
+            }
+        }
+    }
+
+    /**
+     * Looks the key up by the packed primary key it was sent with, falling back
+     * to the unpacked columns if the lookaside does not store packed keys or the
+     * sender packed them differently than we would have.
+     */
+    pub fn get_key_via_packed(
+        &self,
+        db: *mut sqlite3,
+        packed_pks: &[u8],
+        pks: &Vec<ColumnValue>,
+    ) -> Result<Option<sqlite::int64>, ResultCode> {
+        if !self.packed_pks {
+            return self.get_key(db, pks);
+        }
+
+        let stmt_ref = self.get_select_key_by_packed_stmt(db)?;
+        let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
+        stmt.bind_blob(1, packed_pks, sqlite::Destructor::STATIC)?;
+        match stmt.step() {
+            Ok(ResultCode::DONE) => {
+                reset_cached_stmt(stmt.stmt)?;
+                self.get_key(db, pks)
+            }
+            Ok(ResultCode::ROW) => {
+                let ret = stmt.column_int64(0);
+                reset_cached_stmt(stmt.stmt)?;
+                Ok(Some(ret))
+            }
+            Ok(rc) | Err(rc) => {
+                reset_cached_stmt(stmt.stmt)?;
+                Err(rc)
             }
         }
     }
@@ -178,7 +289,7 @@ impl TableInfo {
         }
     }
 
-    fn create_key(
+    pub fn create_key(
         &self,
         db: *mut sqlite3,
         pks: &Vec<ColumnValue>,
@@ -241,16 +352,49 @@ impl TableInfo {
         Ok(self.select_key_stmt.try_borrow()?)
     }
 
+    pub fn get_select_key_by_packed_stmt(
+        &self,
+        db: *mut sqlite3,
+    ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
+        if self.select_key_by_packed_stmt.try_borrow()?.is_none() {
+            let sql = format!(
+                "SELECT __crsql_key FROM \"{table_name}__crsql_pks\" WHERE __crsql_packed = ?",
+                table_name = crate::util::escape_ident(&self.tbl_name),
+            );
+            let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
+            *self.select_key_by_packed_stmt.try_borrow_mut()? = Some(ret);
+        }
+        Ok(self.select_key_by_packed_stmt.try_borrow()?)
+    }
+
+    /**
+     * Columns and bindings for inserting a new key into the lookaside.
+     * The packed primary key, if stored, is computed from the bound primary key values.
+     */
+    fn insert_key_cols_and_bindings(&self) -> Result<(String, String), ResultCode> {
+        let pk_list = crate::util::as_identifier_list(&self.pks, None)?;
+        if self.packed_pks {
+            let pk_bindings = crate::util::numbered_binding_list(self.pks.len());
+            Ok((
+                format!("{pk_list}, __crsql_packed"),
+                format!("{pk_bindings}, crsql_pack_columns({pk_bindings})"),
+            ))
+        } else {
+            Ok((pk_list, crate::util::binding_list(self.pks.len())))
+        }
+    }
+
     pub fn get_insert_key_stmt(
         &self,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.insert_key_stmt.try_borrow()?.is_none() {
+            let (pk_list, pk_bindings) = self.insert_key_cols_and_bindings()?;
             let sql = format!(
                 "INSERT INTO \"{table_name}__crsql_pks\" ({pk_list}) VALUES ({pk_bindings}) RETURNING __crsql_key",
                 table_name = crate::util::escape_ident(&self.tbl_name),
-                pk_list = crate::util::as_identifier_list(&self.pks, None)?,
-                pk_bindings = crate::util::binding_list(self.pks.len()),
+                pk_list = pk_list,
+                pk_bindings = pk_bindings,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
             *self.insert_key_stmt.try_borrow_mut()? = Some(ret);
@@ -267,11 +411,12 @@ impl TableInfo {
             .try_borrow()?
             .is_none()
         {
+            let (pk_list, pk_bindings) = self.insert_key_cols_and_bindings()?;
             let sql = format!(
                 "INSERT OR IGNORE INTO \"{table_name}__crsql_pks\" ({pk_list}) VALUES ({pk_bindings}) RETURNING __crsql_key",
                 table_name = crate::util::escape_ident(&self.tbl_name),
-                pk_list = crate::util::as_identifier_list(&self.pks, None)?,
-                pk_bindings = crate::util::binding_list(self.pks.len()),
+                pk_list = pk_list,
+                pk_bindings = pk_bindings,
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
             *self.insert_or_ignore_returning_key_stmt.try_borrow_mut()? = Some(ret);
@@ -291,7 +436,7 @@ impl TableInfo {
                 ?,
                 ?,
                 ?,
-                crsql_next_db_version(?),
+                ?,
                 ?,
                 ?
               ) RETURNING key",
@@ -303,20 +448,120 @@ impl TableInfo {
         Ok(self.set_winner_clock_stmt.try_borrow()?)
     }
 
+    /**
+     * Takes the statement that upserts the non-pk columns at `cols` of a row.
+     * Primary keys are bound first, followed by a value for each of `cols` in order.
+     * Hand it back with `put_merge_row_stmt` once done with it.
+     */
+    pub fn take_merge_row_stmt(
+        &self,
+        db: *mut sqlite3,
+        cols: &[usize],
+    ) -> Result<ManagedStmt, ResultCode> {
+        let mut stmts = self.merge_row_stmts.try_borrow_mut()?;
+        if let Some(pos) = stmts.iter().position(|(x, _)| x == cols) {
+            return Ok(stmts.remove(pos).1);
+        }
+
+        let col_names = cols
+            .iter()
+            .map(|i| format!("\"{}\"", crate::util::escape_ident(&self.non_pks[*i].name)))
+            .collect::<Vec<_>>();
+        let sql = format!(
+            "INSERT INTO \"{table_name}\" ({pk_list}, {col_list})
+            VALUES ({bind_list})
+            ON CONFLICT DO UPDATE
+            SET {set_list}",
+            table_name = crate::util::escape_ident(&self.tbl_name),
+            pk_list = crate::util::as_identifier_list(&self.pks, None)?,
+            col_list = col_names.join(", "),
+            bind_list = crate::util::binding_list(self.pks.len() + cols.len()),
+            set_list = col_names
+                .iter()
+                .map(|x| format!("{x} = excluded.{x}"))
+                .collect::<Vec<_>>()
+                .join(", "),
+        );
+        db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)
+    }
+
+    pub fn put_merge_row_stmt(
+        &self,
+        cols: Vec<usize>,
+        stmt: ManagedStmt,
+    ) -> Result<(), ResultCode> {
+        reset_cached_stmt(stmt.stmt)?;
+        let mut stmts = self.merge_row_stmts.try_borrow_mut()?;
+        if stmts.len() >= MAX_CACHED_MERGE_STMTS {
+            stmts.remove(0);
+        }
+        stmts.push((cols, stmt));
+        Ok(())
+    }
+
+    /**
+     * Takes the statement that writes `num_rows` clock rows at once.
+     * Each row binds the same slots, in the same order, as `get_set_winner_clock_stmt`.
+     * Hand it back with `put_set_winner_clocks_stmt` once done with it.
+     */
+    pub fn take_set_winner_clocks_stmt(
+        &self,
+        db: *mut sqlite3,
+        num_rows: usize,
+    ) -> Result<ManagedStmt, ResultCode> {
+        let mut stmts = self.set_winner_clocks_stmts.try_borrow_mut()?;
+        if let Some(pos) = stmts.iter().position(|(x, _)| *x == num_rows) {
+            return Ok(stmts.remove(pos).1);
+        }
+
+        let sql = format!(
+            "INSERT OR REPLACE INTO \"{table_name}__crsql_clock\"
+              (key, col_name, col_version, db_version, seq, site_id)
+              VALUES {rows}",
+            table_name = crate::util::escape_ident(&self.tbl_name),
+            rows = core::iter::repeat("(?, ?, ?, ?, ?, ?)")
+                .take(num_rows)
+                .collect::<Vec<_>>()
+                .join(", "),
+        );
+        db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)
+    }
+
+    pub fn put_set_winner_clocks_stmt(
+        &self,
+        num_rows: usize,
+        stmt: ManagedStmt,
+    ) -> Result<(), ResultCode> {
+        reset_cached_stmt(stmt.stmt)?;
+        let mut stmts = self.set_winner_clocks_stmts.try_borrow_mut()?;
+        if stmts.len() >= MAX_CACHED_MERGE_STMTS {
+            stmts.remove(0);
+        }
+        stmts.push((num_rows, stmt));
+        Ok(())
+    }
+
     pub fn get_local_cl_stmt(
         &self,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.local_cl_stmt.try_borrow()?.is_none() {
             // prepare it
-            let sql = format!(
+            let sql = if self.pks_cl {
+                format!(
+                    "SELECT __crsql_cl FROM \"{table_name}__crsql_pks\" WHERE __crsql_key = ?",
+                    table_name = crate::util::escape_ident(&self.tbl_name),
+                )
+            } else {
+                format!(
               "SELECT COALESCE(
                 (SELECT col_version FROM \"{table_name}__crsql_clock\" WHERE key = ? AND col_name = '{delete_sentinel}'),
                 (SELECT 1 FROM \"{table_name}__crsql_clock\" WHERE key = ?)
               )",
               table_name = crate::util::escape_ident(&self.tbl_name),
               delete_sentinel = crate::c::DELETE_SENTINEL,
-            );
+            )
+            };
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
             *self.local_cl_stmt.try_borrow_mut()? = Some(ret);
         }
@@ -408,7 +653,7 @@ impl TableInfo {
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.zero_clocks_on_resurrect_stmt.try_borrow()?.is_none() {
             let sql = format!(
-              "UPDATE \"{table_name}__crsql_clock\" SET col_version = 0, db_version = crsql_next_db_version(?) WHERE key = ? AND col_name IS NOT '{sentinel}'",
+              "UPDATE \"{table_name}__crsql_clock\" SET col_version = 0, db_version = ? WHERE key = ? AND col_name IS NOT '{sentinel}'",
               table_name = crate::util::escape_ident(&self.tbl_name),
               sentinel = crate::c::INSERT_SENTINEL
             );
@@ -502,6 +747,15 @@ impl TableInfo {
         Ok(self.mark_locally_created_stmt.try_borrow()?)
     }
 
+    /**
+     * Writes the clock of a column changed locally.
+     *
+     * A column written more than once in the same transaction keeps the clock
+     * of its first write. Every write of the transaction shares its db_version
+     * and its changes only leave it as a whole so the later rewrites of the
+     * clock row would be indistinguishable to peers, save for a larger
+     * col_version.
+     */
     pub fn get_mark_locally_updated_stmt(
         &self,
         db: *mut sqlite3,
@@ -524,9 +778,10 @@ impl TableInfo {
               0 WHERE true
             ON CONFLICT DO UPDATE SET
               col_version = col_version + 1,
-              db_version = ?,
-              seq = ?,
-              site_id = 0;",
+              db_version = excluded.db_version,
+              seq = excluded.seq,
+              site_id = 0
+            WHERE db_version != excluded.db_version OR site_id IS NOT 0;",
                 table_name = crate::util::escape_ident(&self.tbl_name),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
@@ -577,13 +832,194 @@ impl TableInfo {
         col_info.get_merge_insert_stmt(self, db)
     }
 
-    pub fn get_row_patch_data_stmt(
+    pub fn get_col_conflict_stmt(
         &self,
         db: *mut sqlite3,
         col_name: &str,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         let col_info = self.find_non_pk_col(col_name)?;
-        col_info.get_row_patch_data_stmt(self, db)
+        col_info.get_conflict_stmt(self, db)
+    }
+
+    pub fn get_row_patch_data_stmt(
+        &self,
+        db: *mut sqlite3,
+    ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
+        if self.row_patch_data_stmt.try_borrow()?.is_none() {
+            let mut col_list = crate::util::as_identifier_list(&self.non_pks, None)?;
+            if let Some(row_clock) = &self.row_clock {
+                col_list = format!("{},{}", col_list, row_clock.value_expr(self, "")?);
+            }
+            let sql = format!(
+                "SELECT {col_list} FROM \"{table_name}\" WHERE {where_list}\0",
+                col_list = col_list,
+                table_name = crate::util::escape_ident(&self.tbl_name),
+                where_list = crate::util::where_list(&self.pks, None)?
+            );
+            let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
+            *self.row_patch_data_stmt.try_borrow_mut()? = Some(ret);
+        }
+        Ok(self.row_patch_data_stmt.try_borrow()?)
+    }
+
+    /**
+     * The position of `col_name` amongst the columns selected by `get_row_patch_data_stmt`
+     */
+    pub fn row_patch_data_col_idx(&self, col_name: &str) -> Option<usize> {
+        self.non_pks
+            .iter()
+            .chain(self.row_clock.iter())
+            .position(|x| x.name == col_name)
+    }
+
+    pub fn get_change_bounds_stmt(
+        &self,
+        db: *mut sqlite3,
+    ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
+        if self.change_bounds_stmt.try_borrow()?.is_none() {
+            // separate sub-selects so each min / max is a single index seek
+            let sql = format!(
+                "SELECT
+                  (SELECT min(db_version) FROM \"{table_name}__crsql_clock\"),
+                  (SELECT max(db_version) FROM \"{table_name}__crsql_clock\"),
+                  (SELECT max(__crsql_key) FROM \"{table_name}__crsql_pks\")",
+                table_name = crate::util::escape_ident(&self.tbl_name),
+            );
+            let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
+            *self.change_bounds_stmt.try_borrow_mut()? = Some(ret);
+        }
+        Ok(self.change_bounds_stmt.try_borrow()?)
+    }
+
+    /**
+     * Row counts come from `sqlite_stat1` if the clock table has been analyzed.
+     * `stat1_stmt` selects the `stat` of a table and index from `sqlite_stat1`
+     * and is `None` if that table does not exist.
+     * Otherwise the number of keys and non-pk columns stand in for the row count.
+     */
+    fn get_change_stats(
+        &self,
+        db: *mut sqlite3,
+        stat1_stmt: Option<&ManagedStmt>,
+    ) -> Result<ChangeStats, ResultCode> {
+        let stmt_ref = self.get_change_bounds_stmt(db)?;
+        let stmt = stmt_ref.as_ref().ok_or(ResultCode::ERROR)?;
+        let (min_db_version, max_db_version, max_key) = match stmt.step() {
+            Ok(ResultCode::ROW) => {
+                let ret = (
+                    stmt.column_int64(0),
+                    stmt.column_int64(1),
+                    stmt.column_int64(2),
+                );
+                reset_cached_stmt(stmt.stmt)?;
+                ret
+            }
+            Ok(rc) | Err(rc) => {
+                reset_cached_stmt(stmt.stmt)?;
+                return Err(rc);
+            }
+        };
+        let versions = (max_db_version - min_db_version + 1) as f64;
+
+        if let Some(stat1_stmt) = stat1_stmt {
+            stat1_stmt.bind_text(
+                1,
+                &format!("{}__crsql_clock", self.tbl_name),
+                sqlite::Destructor::TRANSIENT,
+            )?;
+            stat1_stmt.bind_text(
+                2,
+                &format!("{}__crsql_clock_dbv_idx", self.tbl_name),
+                sqlite::Destructor::TRANSIENT,
+            )?;
+            let stat = if stat1_stmt.step()? == ResultCode::ROW {
+                // "<rows> <rows per db_version> ..."
+                let mut parts = stat1_stmt
+                    .column_text(0)?
+                    .split_whitespace()
+                    .map(|x| x.parse::<f64>().ok());
+                match (parts.next().flatten(), parts.next().flatten()) {
+                    (Some(rows), Some(rows_per_version)) => Some((rows, rows_per_version)),
+                    _ => None,
+                }
+            } else {
+                None
+            };
+            stat1_stmt.reset()?;
+            if let Some((rows, rows_per_version)) = stat {
+                return Ok(ChangeStats {
+                    rows,
+                    rows_per_version,
+                    min_db_version,
+                    max_db_version,
+                });
+            }
+        }
+
+        let rows = (max_key * core::cmp::max(1, self.non_pks.len()) as i64) as f64;
+        Ok(ChangeStats {
+            rows,
+            rows_per_version: if versions > 1.0 {
+                rows / versions
+            } else {
+                rows
+            },
+            min_db_version,
+            max_db_version,
+        })
+    }
+
+    /**
+     * The stats last read by `refresh_change_stats`, if any.
+     * Planning reads these rather than running SQL.
+     */
+    pub fn cached_change_stats(&self) -> Option<ChangeStats> {
+        match self.change_stats.try_borrow() {
+            Ok(stats) => stats.map(|(_, stats)| stats),
+            Err(_) => None,
+        }
+    }
+
+    pub fn change_stats_are_stale(&self, db_version: i64) -> bool {
+        match self.change_stats.try_borrow() {
+            Ok(stats) => stats_are_due(stats.map(|(version, _)| version), db_version),
+            Err(_) => true,
+        }
+    }
+
+    /**
+     * Reads the change stats again and remembers them as of `db_version`.
+     */
+    pub fn refresh_change_stats(
+        &self,
+        db: *mut sqlite3,
+        db_version: i64,
+        stat1_stmt: Option<&ManagedStmt>,
+    ) -> Result<ResultCode, ResultCode> {
+        let stats = self.get_change_stats(db, stat1_stmt)?;
+        *self.change_stats.try_borrow_mut()? = Some((db_version, stats));
+        Ok(ResultCode::OK)
+    }
+
+    /**
+     * The lookaside key of the row identified by `packed_pks` if the last per
+     * column update trigger wrote to it and nothing was written since, going by
+     * `total_changes`. Anything written in between may have rolled back or
+     * created keys.
+     */
+    pub fn cached_update_key(&self, packed_pks: &[u8], total_changes: c_int) -> Option<i64> {
+        match &*self.update_key.try_borrow().ok()? {
+            Some((pks, key, changes)) if *changes == total_changes && pks == packed_pks => {
+                Some(*key)
+            }
+            _ => None,
+        }
+    }
+
+    pub fn set_update_key(&self, packed_pks: Vec<u8>, key: i64, total_changes: c_int) {
+        if let Ok(mut update_key) = self.update_key.try_borrow_mut() {
+            *update_key = Some((packed_pks, key, total_changes));
+        }
     }
 
     pub fn clear_stmts(&self) -> Result<ResultCode, ResultCode> {
@@ -618,9 +1054,17 @@ impl TableInfo {
         stmt.take();
         let mut stmt = self.select_key_stmt.try_borrow_mut()?;
         stmt.take();
+        let mut stmt = self.select_key_by_packed_stmt.try_borrow_mut()?;
+        stmt.take();
+        let mut stmt = self.row_patch_data_stmt.try_borrow_mut()?;
+        stmt.take();
+        let mut stmt = self.change_bounds_stmt.try_borrow_mut()?;
+        stmt.take();
+        self.merge_row_stmts.try_borrow_mut()?.clear();
+        self.set_winner_clocks_stmts.try_borrow_mut()?.clear();
 
         // primary key columns shouldn't have statements? right?
-        for col in &self.non_pks {
+        for col in self.non_pks.iter().chain(self.row_clock.iter()) {
             col.clear_stmts()?;
         }
 
@@ -650,10 +1094,39 @@ pub struct ColumnInfo {
     // have different "seen since" records for the old site_id.
     curr_value_stmt: RefCell<Option<ManagedStmt>>,
     merge_insert_stmt: RefCell<Option<ManagedStmt>>,
-    row_patch_data_stmt: RefCell<Option<ManagedStmt>>,
+    conflict_stmt: RefCell<Option<ManagedStmt>>,
 }
 
 impl ColumnInfo {
+    /**
+     * The pseudo column whose clock stands for a whole row.
+     * Its value is every non primary key column of the row, packed.
+     */
+    pub fn row_clock() -> Self {
+        ColumnInfo {
+            name: crate::consts::ROW_CLOCK.to_string(),
+            cid: -1,
+            pk: 0,
+            curr_value_stmt: RefCell::new(None),
+            merge_insert_stmt: RefCell::new(None),
+            conflict_stmt: RefCell::new(None),
+        }
+    }
+
+    fn value_expr(&self, tbl_info: &TableInfo, prefix: &str) -> Result<String, ResultCode> {
+        if self.cid < 0 {
+            return Ok(format!(
+                "crsql_pack_columns({})",
+                crate::util::as_identifier_list(&tbl_info.non_pks, Some(prefix))?
+            ));
+        }
+        Ok(format!(
+            "{}\"{}\"",
+            prefix,
+            crate::util::escape_ident(&self.name)
+        ))
+    }
+
     fn get_curr_value_stmt(
         &self,
         tbl_info: &TableInfo,
@@ -661,8 +1134,8 @@ impl ColumnInfo {
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
         if self.curr_value_stmt.try_borrow()?.is_none() {
             let sql = format!(
-                "SELECT \"{col_name}\" FROM \"{table_name}\" WHERE {pk_where_list}",
-                col_name = crate::util::escape_ident(&self.name),
+                "SELECT {col_value} FROM \"{table_name}\" WHERE {pk_where_list}",
+                col_value = self.value_expr(tbl_info, "")?,
                 table_name = crate::util::escape_ident(&tbl_info.tbl_name),
                 pk_where_list = crate::util::where_list(&tbl_info.pks, None)?,
             );
@@ -672,44 +1145,65 @@ impl ColumnInfo {
         Ok(self.curr_value_stmt.try_borrow()?)
     }
 
-    fn get_merge_insert_stmt(
+    /**
+     * The local col_version, current value and the site_id that wrote it, in one probe.
+     * Returns nothing if either the clock entry or the row itself is missing.
+     */
+    fn get_conflict_stmt(
         &self,
         tbl_info: &TableInfo,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
-        if self.merge_insert_stmt.try_borrow()?.is_none() {
+        if self.conflict_stmt.try_borrow()?.is_none() {
+            let pk_join = tbl_info
+                .pks
+                .iter()
+                .map(|c| {
+                    format!(
+                        "base.\"{col_name}\" IS pk_tbl.\"{col_name}\"",
+                        col_name = crate::util::escape_ident(&c.name)
+                    )
+                })
+                .collect::<Vec<_>>()
+                .join(" AND ");
             let sql = format!(
-                "INSERT INTO \"{table_name}\" ({pk_list}, \"{col_name}\")
-                VALUES ({pk_bind_list}, ?)
-                ON CONFLICT DO UPDATE
-                SET \"{col_name}\" = ?",
+                "SELECT t1.col_version, {col_value}, site_tbl.site_id
+                FROM \"{table_name}__crsql_clock\" AS t1
+                JOIN \"{table_name}__crsql_pks\" AS pk_tbl ON pk_tbl.__crsql_key = t1.key
+                JOIN \"{table_name}\" AS base ON {pk_join}
+                LEFT JOIN crsql_site_id AS site_tbl ON site_tbl.ordinal = t1.site_id
+                WHERE t1.key = ? AND t1.col_name = '{col_name_val}'",
+                col_value = self.value_expr(tbl_info, "base.")?,
                 table_name = crate::util::escape_ident(&tbl_info.tbl_name),
-                pk_list = crate::util::as_identifier_list(&tbl_info.pks, None)?,
-                col_name = crate::util::escape_ident(&self.name),
-                pk_bind_list = crate::util::binding_list(tbl_info.pks.len()),
+                pk_join = pk_join,
+                col_name_val = crate::util::escape_ident_as_value(&self.name),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.merge_insert_stmt.try_borrow_mut()? = Some(ret);
+            *self.conflict_stmt.try_borrow_mut()? = Some(ret);
         }
-        Ok(self.merge_insert_stmt.try_borrow()?)
+        Ok(self.conflict_stmt.try_borrow()?)
     }
 
-    fn get_row_patch_data_stmt(
+    fn get_merge_insert_stmt(
         &self,
         tbl_info: &TableInfo,
         db: *mut sqlite3,
     ) -> Result<Ref<Option<ManagedStmt>>, ResultCode> {
-        if self.row_patch_data_stmt.try_borrow()?.is_none() {
+        if self.merge_insert_stmt.try_borrow()?.is_none() {
             let sql = format!(
-                "SELECT \"{col_name}\" FROM \"{table_name}\" WHERE {where_list}\0",
-                col_name = crate::util::escape_ident(&self.name),
+                "INSERT INTO \"{table_name}\" ({pk_list}, \"{col_name}\")
+                VALUES ({pk_bind_list}, ?)
+                ON CONFLICT DO UPDATE
+                SET \"{col_name}\" = ?",
                 table_name = crate::util::escape_ident(&tbl_info.tbl_name),
-                where_list = crate::util::where_list(&tbl_info.pks, None)?
+                pk_list = crate::util::as_identifier_list(&tbl_info.pks, None)?,
+                col_name = crate::util::escape_ident(&self.name),
+                pk_bind_list = crate::util::binding_list(tbl_info.pks.len()),
             );
             let ret = db.prepare_v3(&sql, sqlite::PREPARE_PERSISTENT)?;
-            *self.row_patch_data_stmt.try_borrow_mut()? = Some(ret);
+            *self.merge_insert_stmt.try_borrow_mut()? = Some(ret);
         }
-        Ok(self.row_patch_data_stmt.try_borrow()?)
+        Ok(self.merge_insert_stmt.try_borrow()?)
     }
 
     pub fn clear_stmts(&self) -> Result<ResultCode, ResultCode> {
@@ -717,7 +1211,7 @@ impl ColumnInfo {
         stmt.take();
         let mut stmt = self.merge_insert_stmt.try_borrow_mut()?;
         stmt.take();
-        let mut stmt = self.row_patch_data_stmt.try_borrow_mut()?;
+        let mut stmt = self.conflict_stmt.try_borrow_mut()?;
         stmt.take();
 
         Ok(ResultCode::OK)
@@ -765,13 +1259,27 @@ pub extern "C" fn crsql_ensure_table_infos_are_up_to_date(
     let mut table_infos = unsafe { Box::from_raw((*ext_data).tableInfos as *mut Vec<TableInfo>) };
 
     if schema_changed > 0 || table_infos.len() == 0 {
+        // statements over the old set of tables are no longer of use
+        let mut changes_stmts = unsafe {
+            mem::ManuallyDrop::new(Box::from_raw(
+                (*ext_data).changesStmtCache as *mut ChangesStmtCache,
+            ))
+        };
+        changes_stmts.clear();
         match pull_all_table_infos(db, ext_data, err) {
             Ok(new_table_infos) => {
                 *table_infos = new_table_infos;
+                let captures = table_infos.iter().any(|t| t.captured_updates);
                 forget(table_infos);
                 unsafe {
                     (*ext_data).updatedTableInfosThisTx = 1;
                 }
+                if captures {
+                    if let Err(msg) = ensure_preupdate_hook(db, ext_data) {
+                        err.set(msg);
+                        return ResultCode::ERROR as c_int;
+                    }
+                }
                 return ResultCode::OK as c_int;
             }
             Err(e) => {
@@ -861,7 +1369,7 @@ pub fn pull_table_info(
                     pk: stmt.column_int(2),
                     curr_value_stmt: RefCell::new(None),
                     merge_insert_stmt: RefCell::new(None),
-                    row_patch_data_stmt: RefCell::new(None),
+                    conflict_stmt: RefCell::new(None),
                 });
             }
 
@@ -879,11 +1387,21 @@ pub fn pull_table_info(
 
     let (mut pks, non_pks): (Vec<_>, Vec<_>) = column_infos.into_iter().partition(|x| x.pk > 0);
     pks.sort_by_key(|x| x.pk);
+    // tables yet to be made into crrs have none of the modes
+    let modes = read_table_modes(db, table)?.unwrap_or_default();
 
     return Ok(TableInfo {
         tbl_name: table.to_string(),
         pks,
         non_pks,
+        packed_pks: modes.packed_pks,
+        pks_cl: modes.pks_cl,
+        captured_updates: modes.captured_updates,
+        row_clock: if modes.row_lww {
+            Some(ColumnInfo::row_clock())
+        } else {
+            None
+        },
         set_winner_clock_stmt: RefCell::new(None),
         local_cl_stmt: RefCell::new(None),
         col_version_stmt: RefCell::new(None),
@@ -892,20 +1410,125 @@ pub fn pull_table_info(
         select_key_stmt: RefCell::new(None),
         insert_key_stmt: RefCell::new(None),
         insert_or_ignore_returning_key_stmt: RefCell::new(None),
+        select_key_by_packed_stmt: RefCell::new(None),
 
         merge_pk_only_insert_stmt: RefCell::new(None),
         merge_delete_stmt: RefCell::new(None),
         merge_delete_drop_clocks_stmt: RefCell::new(None),
         zero_clocks_on_resurrect_stmt: RefCell::new(None),
+        merge_row_stmts: RefCell::new(Vec::new()),
+        set_winner_clocks_stmts: RefCell::new(Vec::new()),
 
         mark_locally_deleted_stmt: RefCell::new(None),
         move_non_sentinels_stmt: RefCell::new(None),
         mark_locally_created_stmt: RefCell::new(None),
         mark_locally_updated_stmt: RefCell::new(None),
         maybe_mark_locally_reinserted_stmt: RefCell::new(None),
+
+        row_patch_data_stmt: RefCell::new(None),
+        change_bounds_stmt: RefCell::new(None),
+        change_stats: RefCell::new(None),
+        update_key: RefCell::new(None),
     });
 }
 
+/**
+ * How a crr is laid out and which triggers it has, decided when it was made.
+ * See the settings of the same names in `crate::config`. `row_lww` is set for
+ * tables merged as whole rows, see `crate::consts::ROW_CLOCK`.
+ *
+ * Kept in `crsql_master` under `modes.<table>` as a comma separated list of
+ * the modes that are on.
+ */
+#[derive(Clone, Copy, Default)]
+pub struct TableModes {
+    pub packed_pks: bool,
+    pub pks_cl: bool,
+    pub captured_updates: bool,
+    pub column_triggers: bool,
+    pub sparse_clocks: bool,
+    pub row_lww: bool,
+}
+
+const ROW_LWW_MODE: &str = "row";
+
+impl TableModes {
+    fn names(&self) -> [(&'static str, bool); 6] {
+        [
+            (crate::config::PACKED_PKS, self.packed_pks),
+            (crate::config::PKS_CL, self.pks_cl),
+            (crate::config::CAPTURE_UPDATES, self.captured_updates),
+            (crate::config::COLUMN_TRIGGERS, self.column_triggers),
+            (crate::config::SPARSE_CLOCKS, self.sparse_clocks),
+            (ROW_LWW_MODE, self.row_lww),
+        ]
+    }
+
+    fn from_text(text: &str) -> Self {
+        let mut modes = TableModes::default();
+        for name in text.split(',') {
+            match name {
+                crate::config::PACKED_PKS => modes.packed_pks = true,
+                crate::config::PKS_CL => modes.pks_cl = true,
+                crate::config::CAPTURE_UPDATES => modes.captured_updates = true,
+                crate::config::COLUMN_TRIGGERS => modes.column_triggers = true,
+                crate::config::SPARSE_CLOCKS => modes.sparse_clocks = true,
+                ROW_LWW_MODE => modes.row_lww = true,
+                _ => {}
+            }
+        }
+        modes
+    }
+
+    fn to_text(&self) -> String {
+        self.names()
+            .iter()
+            .filter(|(_, on)| *on)
+            .map(|(name, _)| *name)
+            .collect::<Vec<_>>()
+            .join(",")
+    }
+}
+
+fn table_modes_key(table: &str) -> String {
+    format!("modes.{table}")
+}
+
+/**
+ * The modes recorded for `table`, if it has been made into a crr.
+ */
+pub fn read_table_modes(
+    db: *mut sqlite::sqlite3,
+    table: &str,
+) -> Result<Option<TableModes>, ResultCode> {
+    let stmt = db.prepare_v2("SELECT value FROM crsql_master WHERE key = ?")?;
+    stmt.bind_text(1, &table_modes_key(table), sqlite::Destructor::TRANSIENT)?;
+    if stmt.step()? == ResultCode::ROW {
+        Ok(Some(TableModes::from_text(stmt.column_text(0)?)))
+    } else {
+        Ok(None)
+    }
+}
+
+pub fn write_table_modes(
+    db: *mut sqlite::sqlite3,
+    table: &str,
+    modes: &TableModes,
+) -> Result<ResultCode, ResultCode> {
+    let stmt = db.prepare_v2("INSERT OR REPLACE INTO crsql_master VALUES (?, ?)")?;
+    stmt.bind_text(1, &table_modes_key(table), sqlite::Destructor::TRANSIENT)?;
+    stmt.bind_text(2, &modes.to_text(), sqlite::Destructor::TRANSIENT)?;
+    stmt.step()?;
+    Ok(ResultCode::OK)
+}
+
+pub fn remove_table_modes(db: *mut sqlite::sqlite3, table: &str) -> Result<ResultCode, ResultCode> {
+    let stmt = db.prepare_v2("DELETE FROM crsql_master WHERE key = ?")?;
+    stmt.bind_text(1, &table_modes_key(table), sqlite::Destructor::TRANSIENT)?;
+    stmt.step()?;
+    Ok(ResultCode::OK)
+}
+
 pub fn is_table_compatible(
     db: *mut sqlite::sqlite3,
     table: &str,
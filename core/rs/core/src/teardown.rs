@@ -2,6 +2,8 @@ use sqlite_nostd as sqlite;
 use sqlite_nostd::{Connection, ResultCode};
 extern crate alloc;
 use alloc::format;
+use alloc::string::ToString;
+use alloc::vec;
 
 pub fn remove_crr_clock_table_if_exists(
     db: *mut sqlite::sqlite3,
@@ -34,6 +36,29 @@ pub fn remove_crr_triggers_if_exist(
         table = escaped_table
     ))?;
 
+    db.exec_safe(&format!(
+        "DROP TRIGGER IF EXISTS \"{table}__crsql_cutrig\"",
+        table = escaped_table
+    ))?;
+
+    // per column update triggers, whatever columns the table had when they were made
+    let stmt = db.prepare_v2(
+        "SELECT name FROM sqlite_master WHERE type = 'trigger' AND tbl_name = ? AND substr(name, 1, length(?2)) = ?2",
+    )?;
+    stmt.bind_text(1, table, sqlite::Destructor::STATIC)?;
+    let prefix = format!("{table}__crsql_utrig_");
+    stmt.bind_text(2, &prefix, sqlite::Destructor::STATIC)?;
+    let mut col_triggers = vec![];
+    while stmt.step()? == ResultCode::ROW {
+        col_triggers.push(stmt.column_text(0)?.to_string());
+    }
+    for trigger in col_triggers {
+        db.exec_safe(&format!(
+            "DROP TRIGGER IF EXISTS \"{trigger}\"",
+            trigger = crate::util::escape_ident(&trigger)
+        ))?;
+    }
+
     // get all columns of table
     // iterate pk cols
     // drop triggers against those pk cols
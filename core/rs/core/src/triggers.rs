@@ -1,5 +1,6 @@
 extern crate alloc;
 use alloc::format;
+use alloc::string::String;
 use sqlite::Connection;
 
 use core::ffi::c_char;
@@ -7,31 +8,49 @@ use core::ffi::c_char;
 use sqlite::{sqlite3, ResultCode};
 use sqlite_nostd as sqlite;
 
-use crate::tableinfo::TableInfo;
+use crate::tableinfo::{TableInfo, TableModes};
 
 pub fn create_triggers(
     db: *mut sqlite3,
     table_info: &TableInfo,
+    modes: &TableModes,
     err: *mut *mut c_char,
 ) -> Result<ResultCode, ResultCode> {
-    create_insert_trigger(db, table_info, err)?;
-    create_update_trigger(db, table_info, err)?;
+    create_insert_trigger(db, table_info, modes, err)?;
+    create_update_trigger(db, table_info, modes, err)?;
     create_delete_trigger(db, table_info, err)
 }
 
 fn create_insert_trigger(
     db: *mut sqlite3,
     table_info: &TableInfo,
+    modes: &TableModes,
     _err: *mut *mut c_char,
 ) -> Result<ResultCode, ResultCode> {
+    let mut args = crate::util::as_identifier_list(&table_info.pks, Some("NEW."))?;
+    if modes.sparse_clocks {
+        // whether each column was inserted with something other than its default.
+        // Compared as binary so values that only a collation thinks are equal get clocks.
+        for col in table_info.non_pks.iter() {
+            let differs = match crate::util::get_dflt_value(db, &table_info.tbl_name, &col.name)? {
+                Some(dflt) if crate::util::is_literal_dflt_value(&dflt) => format!(
+                    "NEW.\"{col_name}\" IS NOT ({dflt}) COLLATE BINARY",
+                    col_name = crate::util::escape_ident(&col.name),
+                ),
+                _ => String::from("1"),
+            };
+            args.push_str(", ");
+            args.push_str(&differs);
+        }
+    }
+
     let create_trigger_sql = format!(
         "CREATE TRIGGER IF NOT EXISTS \"{table_name}__crsql_itrig\"
       AFTER INSERT ON \"{table_name}\" WHEN crsql_internal_sync_bit() = 0
       BEGIN
-        VALUES (crsql_after_insert('{table_name}', {pk_new_list}));
+        VALUES (crsql_after_insert('{table_name}', {args}));
       END;",
         table_name = crate::util::escape_ident_as_value(&table_info.tbl_name),
-        pk_new_list = crate::util::as_identifier_list(&table_info.pks, Some("NEW."))?
     );
 
     db.exec_safe(&create_trigger_sql)
@@ -40,6 +59,7 @@ fn create_insert_trigger(
 fn create_update_trigger(
     db: *mut sqlite3,
     table_info: &TableInfo,
+    modes: &TableModes,
     _err: *mut *mut c_char,
 ) -> Result<ResultCode, ResultCode> {
     let table_name = &table_info.tbl_name;
@@ -48,6 +68,26 @@ fn create_update_trigger(
     let pk_new_list = crate::util::as_identifier_list(pk_columns, Some("NEW."))?;
     let pk_old_list = crate::util::as_identifier_list(pk_columns, Some("OLD."))?;
 
+    if modes.captured_updates {
+        // The preupdate hook records which columns changed so only the primary keys
+        // are passed along.
+        return db.exec_safe(&format!(
+            "CREATE TRIGGER IF NOT EXISTS \"{table_name}__crsql_cutrig\"
+          AFTER UPDATE ON \"{table_name}\" WHEN crsql_internal_sync_bit() = 0
+          BEGIN
+            VALUES (crsql_after_update_captured('{table_name_val}', {pk_new_list}, {pk_old_list}));
+          END;",
+            table_name = crate::util::escape_ident(table_name),
+            table_name_val = crate::util::escape_ident_as_value(table_name),
+            pk_new_list = pk_new_list,
+            pk_old_list = pk_old_list,
+        ));
+    }
+
+    if modes.column_triggers {
+        return create_column_update_triggers(db, table_info);
+    }
+
     let trigger_body = if non_pk_columns.is_empty() {
         format!(
             "VALUES (crsql_after_update('{table_name}', {pk_new_list}, {pk_old_list}))",
@@ -75,6 +115,58 @@ fn create_update_trigger(
     ))
 }
 
+/**
+ * One `UPDATE OF` trigger per non primary key column, passing just that column,
+ * and one for the primary keys. Updates run the triggers of the columns they set
+ * so their cost no longer grows with the width of the table.
+ *
+ * A change of primary key moves the row's clocks over to the new key before
+ * marking columns. SQLite doesn't promise an order between triggers so the
+ * primary key trigger does all of the work of those updates and the column
+ * triggers none of it.
+ */
+fn create_column_update_triggers(
+    db: *mut sqlite3,
+    table_info: &TableInfo,
+) -> Result<ResultCode, ResultCode> {
+    let table_name = &table_info.tbl_name;
+    let pk_new_list = crate::util::as_identifier_list(&table_info.pks, Some("NEW."))?;
+    let pk_old_list = crate::util::as_identifier_list(&table_info.pks, Some("OLD."))?;
+
+    db.exec_safe(&format!(
+        "CREATE TRIGGER IF NOT EXISTS \"{table_name}__crsql_utrig\"
+      AFTER UPDATE OF {pk_list} ON \"{table_name}\" WHEN crsql_internal_sync_bit() = 0
+      BEGIN
+        VALUES (crsql_after_update_key('{table_name_val}', {pk_new_list}, {pk_old_list}, {non_pk_new_list}, {non_pk_old_list}));
+      END;",
+        table_name = crate::util::escape_ident(table_name),
+        table_name_val = crate::util::escape_ident_as_value(table_name),
+        pk_list = crate::util::as_identifier_list(&table_info.pks, None)?,
+        pk_new_list = pk_new_list,
+        pk_old_list = pk_old_list,
+        non_pk_new_list = crate::util::as_identifier_list(&table_info.non_pks, Some("NEW."))?,
+        non_pk_old_list = crate::util::as_identifier_list(&table_info.non_pks, Some("OLD."))?,
+    ))?;
+
+    for col in table_info.non_pks.iter() {
+        db.exec_safe(&format!(
+            "CREATE TRIGGER IF NOT EXISTS \"{table_name}__crsql_utrig_{col_name}\"
+          AFTER UPDATE OF \"{col_name}\" ON \"{table_name}\" WHEN crsql_internal_sync_bit() = 0
+          BEGIN
+            VALUES (crsql_after_update_column('{table_name_val}', '{col_name_val}', NEW.\"{col_name}\", OLD.\"{col_name}\", {pk_new_list}, {pk_old_list}));
+          END;",
+            table_name = crate::util::escape_ident(table_name),
+            table_name_val = crate::util::escape_ident_as_value(table_name),
+            col_name = crate::util::escape_ident(&col.name),
+            col_name_val = crate::util::escape_ident_as_value(&col.name),
+            pk_new_list = pk_new_list,
+            pk_old_list = pk_old_list,
+        ))?;
+    }
+
+    Ok(ResultCode::OK)
+}
+
 fn create_delete_trigger(
     db: *mut sqlite3,
     table_info: &TableInfo,
@@ -42,6 +42,43 @@ pub fn get_dflt_value(
     return Ok(Some(String::from(stmt.column_text(0)?)));
 }
 
+/**
+ * Whether a column's default, as reported by `get_dflt_value`, is a literal
+ * and so comes out the same at every site. Expressions such as
+ * `CURRENT_TIMESTAMP` or `(random())` do not.
+ */
+pub fn is_literal_dflt_value(dflt: &str) -> bool {
+    let mut dflt = dflt.trim();
+    while dflt.len() >= 2 && dflt.starts_with('(') && dflt.ends_with(')') {
+        dflt = dflt[1..dflt.len() - 1].trim();
+    }
+    if ["NULL", "TRUE", "FALSE"]
+        .iter()
+        .any(|kw| dflt.eq_ignore_ascii_case(kw))
+    {
+        return true;
+    }
+
+    let quoted = if dflt.starts_with("x'") || dflt.starts_with("X'") {
+        &dflt[1..]
+    } else {
+        dflt
+    };
+    if quoted.len() >= 2 && quoted.starts_with('\'') && quoted.ends_with('\'') {
+        // a single string literal, quotes within it doubled
+        return !quoted[1..quoted.len() - 1].replace("''", "").contains('\'');
+    }
+
+    let num = dflt
+        .strip_prefix('-')
+        .or(dflt.strip_prefix('+'))
+        .unwrap_or(dflt);
+    num.starts_with(|c: char| c.is_ascii_digit() || c == '.')
+        && num
+            .chars()
+            .all(|c| c.is_ascii_alphanumeric() || c == '.' || c == '+' || c == '-')
+}
+
 pub fn get_db_version_union_query(tbl_names: &Vec<String>) -> String {
     let unions_str = tbl_names
         .iter()
@@ -99,6 +136,17 @@ pub fn binding_list(num_slots: usize) -> String {
         .join(", ")
 }
 
+/**
+ * Like `binding_list` but numbers the slots so they can be referenced again
+ * later in the same statement.
+ */
+pub fn numbered_binding_list(num_slots: usize) -> String {
+    (1..=num_slots)
+        .map(|i| format!("?{}", i))
+        .collect::<Vec<_>>()
+        .join(", ")
+}
+
 pub fn as_identifier_list(
     columns: &Vec<ColumnInfo>,
     prefix: Option<&str>,
@@ -159,6 +207,26 @@ mod tests {
         assert_eq!(baz_slab, 3 + crate::consts::ROWID_SLAB_SIZE * 2);
     }
 
+    #[test]
+    fn test_is_literal_dflt_value() {
+        for dflt in [
+            "NULL", "null", "TRUE", "0", "-1", "+2.5", "1e10", "0x1F", "'abc'", "'it''s'",
+            "X'00ff'", "(1)", "('a')",
+        ] {
+            assert!(is_literal_dflt_value(dflt), "{}", dflt);
+        }
+        for dflt in [
+            "CURRENT_TIMESTAMP",
+            "(random())",
+            "(datetime('now'))",
+            "'a' || 'b'",
+            "abs(1)",
+            "",
+        ] {
+            assert!(!is_literal_dflt_value(dflt), "{}", dflt);
+        }
+    }
+
     #[test]
     fn test_get_db_version_union_query() {
         let tbl_names = vec!["foo".to_string(), "bar".to_string(), "baz".to_string()];
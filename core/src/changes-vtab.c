@@ -28,7 +28,8 @@ static int changesConnect(sqlite3 *db, void *pAux, int argc,
       "CREATE TABLE x([table] TEXT NOT NULL, [pk] BLOB NOT NULL, [cid] TEXT "
       "NOT NULL, [val] ANY, [col_version] INTEGER NOT NULL, [db_version] "
       "INTEGER NOT NULL, [site_id] BLOB NOT NULL, [cl] INTEGER NOT NULL, [seq] "
-      "INTEGER NOT NULL)");
+      "INTEGER NOT NULL, [after_db_version] INTEGER HIDDEN, [after_seq] "
+      "INTEGER HIDDEN)");
   if (rc != SQLITE_OK) {
     *pzErr = sqlite3_mprintf("Could not define the table");
     return rc;
@@ -83,22 +84,7 @@ static int changesOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
   return SQLITE_OK;
 }
 
-static int changesCrsrFinalize(crsql_Changes_cursor *crsr) {
-  // Assign pointers to null after freeing
-  // since we can get into this twice for the same cursor object.
-  int rc = SQLITE_OK;
-  rc += sqlite3_finalize(crsr->pChangesStmt);
-  crsr->pChangesStmt = 0;
-  if (crsr->pRowStmt != 0) {
-    rc += sqlite3_clear_bindings(crsr->pRowStmt);
-    rc += sqlite3_reset(crsr->pRowStmt);
-  }
-  crsr->pRowStmt = 0;
-
-  crsr->dbVersion = MIN_POSSIBLE_DB_VERSION;
-
-  return rc;
-}
+int crsql_changes_crsr_finalize(crsql_Changes_cursor *crsr);
 
 /**
  * Called to reclaim all of the resources allocated in `changesOpen`
@@ -107,7 +93,7 @@ static int changesCrsrFinalize(crsql_Changes_cursor *crsr) {
  * We, of course, do not de-allocated the `pTab` reference
  * given `pTab` must persist for the life of the connection.
  *
- * `pChangesStmt` and `pRowStmt` must be finalized.
+ * `pChangesStmt` (or `pChangesMerge`) and `pRowStmt` must be finalized.
  *
  * `colVrsns` does not need to be freed as it comes from
  * `pChangesStmt` thus finalizing `pChangesStmt` will
@@ -115,11 +101,42 @@ static int changesCrsrFinalize(crsql_Changes_cursor *crsr) {
  */
 static int changesClose(sqlite3_vtab_cursor *cur) {
   crsql_Changes_cursor *pCur = (crsql_Changes_cursor *)cur;
-  changesCrsrFinalize(pCur);
+  crsql_changes_crsr_finalize(pCur);
   sqlite3_free(pCur);
   return SQLITE_OK;
 }
 
+/**
+ * `sqlite3_vtab_in` and friends are not exposed to the Rust side of the
+ * extension. These thin wrappers let `crsql_changes_best_index` and
+ * `crsql_changes_filter` process `tbl IN (...)` constraints all at once.
+ */
+int crsql_changes_vtab_in(sqlite3_index_info *pIdxInfo, int iCons,
+                          int bHandle) {
+  return sqlite3_vtab_in(pIdxInfo, iCons, bHandle);
+}
+
+int crsql_changes_vtab_in_first(sqlite3_value *pVal, sqlite3_value **ppOut) {
+  return sqlite3_vtab_in_first(pVal, ppOut);
+}
+
+int crsql_changes_vtab_in_next(sqlite3_value *pVal, sqlite3_value **ppOut) {
+  return sqlite3_vtab_in_next(pVal, ppOut);
+}
+
+/**
+ * Used by `crsql_changes_best_index` to cost constraints against the
+ * statistics of the clock tables and to decide how rows must be grouped.
+ */
+int crsql_changes_vtab_rhs_value(sqlite3_index_info *pIdxInfo, int iCons,
+                                 sqlite3_value **ppVal) {
+  return sqlite3_vtab_rhs_value(pIdxInfo, iCons, ppVal);
+}
+
+int crsql_changes_vtab_distinct(sqlite3_index_info *pIdxInfo) {
+  return sqlite3_vtab_distinct(pIdxInfo);
+}
+
 /**
  * Invoked to kick off the pulling of rows from the virtual table.
  * Provides the constraints with which the vtab can work with
@@ -135,7 +152,6 @@ int crsql_changes_filter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
 ** that uses the virtual table.  This routine needs to create
 ** a query plan for each invocation and compute an estimated cost for that
 ** plan.
-** TODO: should we support `where table` filters?
 */
 int crsql_changes_best_index(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo);
 
@@ -144,6 +160,8 @@ int crsql_changes_update(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
 // If xBegin is not defined xCommit is not called.
 int crsql_changes_begin(sqlite3_vtab *pVTab);
 int crsql_changes_commit(sqlite3_vtab *pVTab);
+int crsql_changes_savepoint(sqlite3_vtab *pVTab, int iSavepoint);
+int crsql_changes_rollback_to(sqlite3_vtab *pVTab, int iSavepoint);
 int crsql_changes_rowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid);
 int crsql_changes_column(
     sqlite3_vtab_cursor *cur, /* The cursor */
@@ -153,7 +171,7 @@ int crsql_changes_column(
 int crsql_changes_eof(sqlite3_vtab_cursor *cur);
 
 sqlite3_module crsql_changesModule = {
-    /* iVersion    */ 0,
+    /* iVersion    */ 2,
     /* xCreate     */ 0,
     /* xConnect    */ changesConnect,
     /* xBestIndex  */ crsql_changes_best_index,
@@ -173,9 +191,9 @@ sqlite3_module crsql_changesModule = {
     /* xRollback   */ 0,
     /* xFindMethod */ 0,
     /* xRename     */ 0,
-    /* xSavepoint  */ 0,
+    /* xSavepoint  */ crsql_changes_savepoint,
     /* xRelease    */ 0,
-    /* xRollbackTo */ 0,
+    /* xRollbackTo */ crsql_changes_rollback_to,
     /* xShadowName */ 0
 #ifdef LIBSQL
     ,
@@ -85,7 +85,7 @@ struct crsql_Changes_vtab {
  * from the physical row.
  *
  * Everything allocated here must be constructed in
- * changesOpen and released in changesCrsrFinalize
+ * changesOpen and released in crsql_changes_crsr_finalize
  */
 #define ROW_TYPE_UPDATE 0
 #define ROW_TYPE_DELETE 1
@@ -105,6 +105,24 @@ struct crsql_Changes_cursor {
 
   sqlite3_int64 changesRowid;
   int tblInfoIdx;
+
+  // When pulling from many tables in version order, each table is pulled by
+  // its own statement and the results are merged. `pChangesStmt` then points
+  // to whichever of those statements holds the current row.
+  void *pChangesMerge;
+
+  // `pRowStmt` selects every column of the row being read and stays on that
+  // row while consecutive changes are for it. This is the column of
+  // `pRowStmt` that holds the value of the current change.
+  int rowColIdx;
 };
 
+int crsql_changes_vtab_in(sqlite3_index_info *pIdxInfo, int iCons,
+                          int bHandle);
+int crsql_changes_vtab_in_first(sqlite3_value *pVal, sqlite3_value **ppOut);
+int crsql_changes_vtab_in_next(sqlite3_value *pVal, sqlite3_value **ppOut);
+int crsql_changes_vtab_rhs_value(sqlite3_index_info *pIdxInfo, int iCons,
+                                 sqlite3_value **ppVal);
+int crsql_changes_vtab_distinct(sqlite3_index_info *pIdxInfo);
+
 #endif
\ No newline at end of file
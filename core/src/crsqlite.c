@@ -23,6 +23,12 @@ LIBSQL_EXTENSION_INIT1
 unsigned char __rust_no_alloc_shim_is_unstable;
 #endif
 
+void crsql_commit_site_id_cache(crsql_ExtData *pExtData);
+void crsql_rollback_site_id_cache(crsql_ExtData *pExtData);
+void crsql_commit_merge_stats(crsql_ExtData *pExtData);
+void crsql_rollback_merge_stats(crsql_ExtData *pExtData);
+void crsql_clear_captured_updates(crsql_ExtData *pExtData);
+
 int crsql_compact_post_alter(sqlite3 *db, const char *tblName,
                              crsql_ExtData *pExtData, char **errmsg);
 
@@ -39,6 +45,10 @@ static int commitHook(void *pUserData) {
   pExtData->pendingDbVersion = -1;
   pExtData->seq = 0;
   pExtData->updatedTableInfosThisTx = 0;
+  pExtData->dbVersionCheckedThisTx = 0;
+  crsql_commit_site_id_cache(pExtData);
+  crsql_commit_merge_stats(pExtData);
+  crsql_clear_captured_updates(pExtData);
   return SQLITE_OK;
 }
 
@@ -48,6 +58,101 @@ static void rollbackHook(void *pUserData) {
   pExtData->pendingDbVersion = -1;
   pExtData->seq = 0;
   pExtData->updatedTableInfosThisTx = 0;
+  pExtData->dbVersionCheckedThisTx = 0;
+  crsql_rollback_site_id_cache(pExtData);
+  crsql_rollback_merge_stats(pExtData);
+  crsql_clear_captured_updates(pExtData);
+}
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+void crsql_init_captured_updates(crsql_ExtData *pExtData);
+int crsql_captures_updates(crsql_ExtData *pExtData, const char *zTbl);
+void crsql_capture_update(crsql_ExtData *pExtData, const char *zTbl, int nCol,
+                          sqlite3_value **apNew, sqlite3_value **apOld);
+
+#define CAPTURE_STACK_COLS 64
+
+// Hands the values of updated rows to tables whose update trigger only passes
+// primary keys. See `local_writes/captured_updates.rs`.
+static void preupdateHook(void *pUserData, sqlite3 *db, int op,
+                          char const *zDb, char const *zName,
+                          sqlite3_int64 iKey1, sqlite3_int64 iKey2) {
+  crsql_ExtData *pExtData = (crsql_ExtData *)pUserData;
+  sqlite3_value *apStack[2 * CAPTURE_STACK_COLS];
+  sqlite3_value **apValues = apStack;
+
+  // inserts and deletes already only pass primary keys to their triggers.
+  // merges don't run triggers at all.
+  if (op != SQLITE_UPDATE || (pExtData->pSyncBit && *pExtData->pSyncBit)) {
+    return;
+  }
+  // crrs are only made in the main database. Captures of attached tables of
+  // the same name would never be taken back off by a trigger.
+  if (strcmp(zDb, "main") != 0) {
+    return;
+  }
+  // our own clock, lookaside and bookkeeping tables
+  if (strstr(zName, "__crsql_") != 0 || strncmp(zName, "crsql_", 6) == 0) {
+    return;
+  }
+  if (!crsql_captures_updates(pExtData, zName)) {
+    return;
+  }
+
+  int nCol = sqlite3_preupdate_count(db);
+  if (nCol > CAPTURE_STACK_COLS) {
+    apValues = sqlite3_malloc64(sizeof(sqlite3_value *) * 2 * nCol);
+    if (apValues == 0) {
+      // the update's trigger fails for want of a captured update
+      return;
+    }
+  }
+  for (int i = 0; i < nCol; ++i) {
+    sqlite3_preupdate_new(db, i, &apValues[i]);
+    sqlite3_preupdate_old(db, i, &apValues[nCol + i]);
+  }
+  crsql_capture_update(pExtData, zName, nCol, apValues, apValues + nCol);
+  if (apValues != apStack) {
+    sqlite3_free(apValues);
+  }
+}
+#endif
+
+// Rows changed by statements that ran to completion. Lets the per column update
+// triggers tell whether anything ran between them.
+int crsql_total_changes(sqlite3 *db) { return sqlite3_total_changes(db); }
+
+// Milliseconds since the julian epoch going by the vfs of the main database.
+// Used to time merges, see `merge_stats.rs`.
+sqlite3_int64 crsql_current_time_ms(sqlite3 *db) {
+  sqlite3_vfs *pVfs = 0;
+  if (sqlite3_file_control(db, "main", SQLITE_FCNTL_VFS_POINTER, &pVfs) !=
+          SQLITE_OK ||
+      pVfs == 0) {
+    pVfs = sqlite3_vfs_find(0);
+  }
+  if (pVfs == 0) {
+    return 0;
+  }
+  sqlite3_int64 now = 0;
+  if (pVfs->iVersion >= 2 && pVfs->xCurrentTimeInt64 != 0) {
+    pVfs->xCurrentTimeInt64(pVfs, &now);
+  } else {
+    double days = 0;
+    pVfs->xCurrentTime(pVfs, &days);
+    now = (sqlite3_int64)(days * 86400000.0);
+  }
+  return now;
+}
+
+// Installs the preupdate hook, returning whatever the hook was given before.
+// Called from `local_writes/captured_updates.rs` once a table captures updates.
+void *crsql_set_preupdate_hook(sqlite3 *db, crsql_ExtData *pExtData) {
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  return sqlite3_preupdate_hook(db, preupdateHook, pExtData);
+#else
+  return 0;
+#endif
 }
 
 #ifdef LIBSQL
@@ -99,6 +204,10 @@ __declspec(dllexport)
     // it?
     sqlite3_commit_hook(db, commitHook, pExtData);
     sqlite3_rollback_hook(db, rollbackHook, pExtData);
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+    // the hook itself is only installed once a table captures its updates
+    crsql_init_captured_updates(pExtData);
+#endif
   }
 
   return rc;
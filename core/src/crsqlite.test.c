@@ -607,6 +607,86 @@ static void testPullingOnlyLocalChanges() {
   printf("\t\e[0;32mSuccess\e[0m\n");
 }
 
+static sqlite3_int64 selectInt64(sqlite3 *db, const char *zSql) {
+  sqlite3_stmt *pStmt;
+  sqlite3_int64 ret = -1;
+  int rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  assert(rc == SQLITE_OK);
+  if (sqlite3_step(pStmt) == SQLITE_ROW) {
+    ret = sqlite3_column_int64(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  return ret;
+}
+
+// Tables made into crrs with `capture-updates` set leave working out which
+// columns an update changed to the preupdate hook.
+static void testCapturedUpdates() {
+  printf("CapturedUpdates\n");
+  sqlite3 *db;
+  int rc = SQLITE_OK;
+
+  rc = sqlite3_open(":memory:", &db);
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  rc += sqlite3_exec(db, "SELECT crsql_config_set('capture-updates', 1)", 0, 0,
+                     0);
+  rc += sqlite3_exec(db, "CREATE TABLE foo (a primary key not null, b, c)", 0,
+                     0, 0);
+  rc += sqlite3_exec(db, "SELECT crsql_as_crr('foo')", 0, 0, 0);
+  assert(rc == SQLITE_OK);
+  assert(selectInt64(db,
+                     "SELECT count(*) FROM sqlite_master WHERE type = "
+                     "'trigger' AND name = 'foo__crsql_cutrig'") == 1);
+
+  rc += sqlite3_exec(db, "INSERT INTO foo VALUES (1, 1, 1)", 0, 0, 0);
+  rc += sqlite3_exec(db, "UPDATE foo SET b = 2 WHERE a = 1", 0, 0, 0);
+  // setting a column to the value it has is not a change
+  rc += sqlite3_exec(db, "UPDATE foo SET c = 1 WHERE a = 1", 0, 0, 0);
+  rc += sqlite3_exec(db, "UPDATE foo SET b = 3, c = 3", 0, 0, 0);
+  assert(rc == SQLITE_OK);
+  assert(selectInt64(db,
+                     "SELECT col_version FROM crsql_changes WHERE pk = "
+                     "crsql_pack_columns(1) AND cid = 'b'") == 3);
+  assert(selectInt64(db,
+                     "SELECT col_version FROM crsql_changes WHERE pk = "
+                     "crsql_pack_columns(1) AND cid = 'c'") == 2);
+
+  // a new primary key deletes the old row and moves its clocks
+  rc += sqlite3_exec(db, "UPDATE foo SET a = 2 WHERE a = 1", 0, 0, 0);
+  assert(rc == SQLITE_OK);
+  assert(selectInt64(db,
+                     "SELECT cl FROM crsql_changes WHERE pk = "
+                     "crsql_pack_columns(1) AND cid = '-1'") == 2);
+  assert(selectInt64(db,
+                     "SELECT col_version FROM crsql_changes WHERE pk = "
+                     "crsql_pack_columns(2) AND cid = 'b'") == 3);
+
+  // a table of the same name in another database is not captured
+  rc += sqlite3_exec(db, "ATTACH ':memory:' AS aux", 0, 0, 0);
+  rc += sqlite3_exec(db, "CREATE TABLE aux.foo (a primary key not null, b, c)",
+                     0, 0, 0);
+  rc += sqlite3_exec(db, "INSERT INTO aux.foo VALUES (2, 1, 1)", 0, 0, 0);
+  rc += sqlite3_exec(db,
+                     "BEGIN; UPDATE aux.foo SET b = 5; UPDATE foo SET c = 4 "
+                     "WHERE a = 2; COMMIT;",
+                     0, 0, 0);
+  assert(rc == SQLITE_OK);
+  assert(selectInt64(db,
+                     "SELECT col_version FROM crsql_changes WHERE pk = "
+                     "crsql_pack_columns(2) AND cid = 'b'") == 3);
+  assert(selectInt64(db,
+                     "SELECT col_version FROM crsql_changes WHERE pk = "
+                     "crsql_pack_columns(2) AND cid = 'c'") == 3);
+#else
+  rc = sqlite3_exec(db, "SELECT crsql_config_set('capture-updates', 1)", 0, 0,
+                    0);
+  assert(rc != SQLITE_OK);
+#endif
+
+  crsql_close(db);
+  printf("\t\e[0;32mSuccess\e[0m\n");
+}
+
 // static void testModifySinglePK()
 // {
 // }
@@ -625,6 +705,7 @@ void crsqlTestSuite() {
   testLamportCondition();
   noopsDoNotMoveClocks();
   testPullingOnlyLocalChanges();
+  testCapturedUpdates();
 
   // testIdempotence();
   // testColumnAdds();
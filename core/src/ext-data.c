@@ -8,6 +8,13 @@
 void crsql_clear_stmt_cache(crsql_ExtData *pExtData);
 void crsql_init_table_info_vec(crsql_ExtData *pExtData);
 void crsql_drop_table_info_vec(crsql_ExtData *pExtData);
+void crsql_init_changes_stmt_cache(crsql_ExtData *pExtData);
+void crsql_drop_changes_stmt_cache(crsql_ExtData *pExtData);
+void crsql_init_site_id_cache(crsql_ExtData *pExtData);
+void crsql_drop_site_id_cache(crsql_ExtData *pExtData);
+void crsql_init_merge_stats(sqlite3 *db, crsql_ExtData *pExtData);
+void crsql_drop_merge_stats(crsql_ExtData *pExtData);
+void crsql_drop_captured_updates(crsql_ExtData *pExtData);
 
 crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
   crsql_ExtData *pExtData = sqlite3_malloc(sizeof *pExtData);
@@ -22,12 +29,8 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
   rc += sqlite3_prepare_v3(db, "PRAGMA data_version", -1,
                            SQLITE_PREPARE_PERSISTENT,
                            &(pExtData->pPragmaDataVersionStmt), 0);
-  pExtData->pSetSyncBitStmt = 0;
-  rc += sqlite3_prepare_v3(db, SET_SYNC_BIT, -1, SQLITE_PREPARE_PERSISTENT,
-                           &(pExtData->pSetSyncBitStmt), 0);
-  pExtData->pClearSyncBitStmt = 0;
-  rc += sqlite3_prepare_v3(db, CLEAR_SYNC_BIT, -1, SQLITE_PREPARE_PERSISTENT,
-                           &(pExtData->pClearSyncBitStmt), 0);
+  pExtData->pSyncBit = 0;
+  pExtData->dbVersionCheckedThisTx = 0;
 
   pExtData->pSetSiteIdOrdinalStmt = 0;
   rc += sqlite3_prepare_v3(
@@ -39,6 +42,11 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
       db, "SELECT ordinal FROM crsql_site_id WHERE site_id = ?", -1,
       SQLITE_PREPARE_PERSISTENT, &(pExtData->pSelectSiteIdOrdinalStmt), 0);
 
+  pExtData->pSelectSiteIdByOrdinalStmt = 0;
+  rc += sqlite3_prepare_v3(
+      db, "SELECT site_id FROM crsql_site_id WHERE ordinal = ?", -1,
+      SQLITE_PREPARE_PERSISTENT, &(pExtData->pSelectSiteIdByOrdinalStmt), 0);
+
   pExtData->pSelectClockTablesStmt = 0;
   rc +=
       sqlite3_prepare_v3(db, CLOCK_TABLES_SELECT, -1, SQLITE_PREPARE_PERSISTENT,
@@ -55,6 +63,16 @@ crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer) {
   pExtData->rowsImpacted = 0;
   pExtData->updatedTableInfosThisTx = 0;
   crsql_init_table_info_vec(pExtData);
+  pExtData->changesStmtCache = 0;
+  crsql_init_changes_stmt_cache(pExtData);
+  pExtData->siteIdCache = 0;
+  crsql_init_site_id_cache(pExtData);
+  pExtData->mergeStats = 0;
+  crsql_init_merge_stats(db, pExtData);
+  // allocated by the extension's init if it installs the preupdate hook
+  pExtData->capturedUpdates = 0;
+  pExtData->siteCount = 0;
+  pExtData->siteCountDbVersion = -1;
 
   sqlite3_stmt *pStmt;
 
@@ -105,13 +123,16 @@ void crsql_freeExtData(crsql_ExtData *pExtData) {
   sqlite3_finalize(pExtData->pDbVersionStmt);
   sqlite3_finalize(pExtData->pPragmaSchemaVersionStmt);
   sqlite3_finalize(pExtData->pPragmaDataVersionStmt);
-  sqlite3_finalize(pExtData->pSetSyncBitStmt);
-  sqlite3_finalize(pExtData->pClearSyncBitStmt);
   sqlite3_finalize(pExtData->pSetSiteIdOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectSiteIdOrdinalStmt);
+  sqlite3_finalize(pExtData->pSelectSiteIdByOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectClockTablesStmt);
   crsql_clear_stmt_cache(pExtData);
   crsql_drop_table_info_vec(pExtData);
+  crsql_drop_changes_stmt_cache(pExtData);
+  crsql_drop_site_id_cache(pExtData);
+  crsql_drop_merge_stats(pExtData);
+  crsql_drop_captured_updates(pExtData);
   sqlite3_free(pExtData);
 }
 
@@ -124,19 +145,17 @@ void crsql_finalize(crsql_ExtData *pExtData) {
   sqlite3_finalize(pExtData->pDbVersionStmt);
   sqlite3_finalize(pExtData->pPragmaSchemaVersionStmt);
   sqlite3_finalize(pExtData->pPragmaDataVersionStmt);
-  sqlite3_finalize(pExtData->pSetSyncBitStmt);
-  sqlite3_finalize(pExtData->pClearSyncBitStmt);
   sqlite3_finalize(pExtData->pSetSiteIdOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectSiteIdOrdinalStmt);
+  sqlite3_finalize(pExtData->pSelectSiteIdByOrdinalStmt);
   sqlite3_finalize(pExtData->pSelectClockTablesStmt);
   crsql_clear_stmt_cache(pExtData);
   pExtData->pDbVersionStmt = 0;
   pExtData->pPragmaSchemaVersionStmt = 0;
   pExtData->pPragmaDataVersionStmt = 0;
-  pExtData->pSetSyncBitStmt = 0;
-  pExtData->pClearSyncBitStmt = 0;
   pExtData->pSetSiteIdOrdinalStmt = 0;
   pExtData->pSelectSiteIdOrdinalStmt = 0;
+  pExtData->pSelectSiteIdByOrdinalStmt = 0;
   pExtData->pSelectClockTablesStmt = 0;
 }
 
@@ -37,13 +37,37 @@ struct crsql_ExtData {
 
   int seq;
 
-  sqlite3_stmt *pSetSyncBitStmt;
-  sqlite3_stmt *pClearSyncBitStmt;
+  // the bit read by `crsql_internal_sync_bit()` to keep triggers from firing
+  // while merging. owned by that function.
+  int *pSyncBit;
+  // set once a merge has checked dbVersion against storage in the current
+  // transaction. reset on transaction commit or rollback.
+  int dbVersionCheckedThisTx;
   sqlite3_stmt *pSetSiteIdOrdinalStmt;
   sqlite3_stmt *pSelectSiteIdOrdinalStmt;
   sqlite3_stmt *pSelectClockTablesStmt;
 
   int mergeEqualValues;
+
+  // statements used to read from crsql_changes, keyed by their sql.
+  // cleared whenever table infos are re-pulled.
+  void *changesStmtCache;
+
+  sqlite3_stmt *pSelectSiteIdByOrdinalStmt;
+  // site_id <-> ordinal mappings of crsql_site_id seen by this connection.
+  // mappings assigned in the current transaction are dropped on rollback.
+  void *siteIdCache;
+  // per table counts of how merged changes turned out. read via
+  // crsql_merge_stats.
+  void *mergeStats;
+  // updates seen by the preupdate hook awaiting their trigger. null unless
+  // SQLite was built with SQLITE_ENABLE_PREUPDATE_HOOK.
+  void *capturedUpdates;
+
+  // rows in crsql_site_id as of dbVersion siteCountDbVersion. read when
+  // costing crsql_changes queries which, unlike reading them, runs no sql.
+  sqlite3_int64 siteCount;
+  sqlite3_int64 siteCountDbVersion;
 };
 
 crsql_ExtData *crsql_newExtData(sqlite3 *db, unsigned char *siteIdBuffer);
@@ -35,6 +35,14 @@ static void textNewExtData() {
   assert(pExtData->pDbVersionStmt == 0);
   // table info allocated to an empty vec
   assert(pExtData->tableInfos != 0);
+  // changes statement cache allocated empty
+  assert(pExtData->changesStmtCache != 0);
+  // site id cache allocated empty
+  assert(pExtData->siteIdCache != 0);
+  // merge stats allocated empty
+  assert(pExtData->mergeStats != 0);
+  // only allocated when the preupdate hook is installed
+  assert(pExtData->capturedUpdates == 0);
 
   // data version should have been fetched
   assert(pExtData->pragmaDataVersion != -1);
@@ -16,7 +16,8 @@ int crsql_init_peer_tracking_table(sqlite3 *db);
 int crsql_create_schema_table_if_not_exists(sqlite3 *db);
 int crsql_maybe_update_db(sqlite3 *db, char **pzErrMsg);
 int crsql_is_table_compatible(sqlite3 *db, const char *tblName, char **err);
-int crsql_create_crr(sqlite3 *db, const char *schemaName, const char *tblName,
+int crsql_create_crr(sqlite3 *db, crsql_ExtData *pExtData,
+                     const char *schemaName, const char *tblName,
                      int isCommitAlter, int noTx, char **err);
 int crsql_ensure_table_infos_are_up_to_date(sqlite3 *db,
                                             crsql_ExtData *pExtData,
@@ -0,0 +1,113 @@
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
+import struct
+
+# Applies changes received from peers with the decoding done away from the
+# connection's thread. Each batch of changes, rows as read from crsql_changes,
+# is checked, grouped by row and packed for crsql_apply_changes by a worker
+# while the connection applies the batches before it.
+#
+# Python's sqlite3 releases the GIL while a statement runs, so a worker thread
+# prepares the next batch while the connection merges the last one. Pass a
+# process pool as `executor` to prepare several batches at once.
+
+SITE_ID_LEN = 16
+MAX_TBL_NAME_LEN = 2048
+
+NULL = 0
+INTEGER = 1
+FLOAT = 2
+TEXT = 3
+BLOB = 4
+
+
+def _num_bytes(val, size):
+    if val == 0:
+        return 0
+    if val < 0:
+        return size
+    return min(size, (val.bit_length() + 7) // 8)
+
+
+def pack_value(buf, value):
+    if value is None:
+        buf.append(NULL)
+    elif isinstance(value, int):
+        num_bytes = _num_bytes(value, 8)
+        buf.append(num_bytes << 3 | INTEGER)
+        buf += (value & (2 ** (8 * num_bytes) - 1)).to_bytes(num_bytes, "big")
+    elif isinstance(value, float):
+        buf.append(FLOAT)
+        buf += struct.pack(">d", value)
+    else:
+        if isinstance(value, str):
+            value, value_type = value.encode("utf-8"), TEXT
+        else:
+            value, value_type = bytes(value), BLOB
+        num_bytes = _num_bytes(len(value), 4)
+        buf.append(num_bytes << 3 | value_type)
+        buf += len(value).to_bytes(num_bytes, "big")
+        buf += value
+
+
+def pack_columns(values):
+    """The same bytes as `crsql_pack_columns(*values)`."""
+    buf = bytearray([len(values)])
+    for value in values:
+        pack_value(buf, value)
+    return bytes(buf)
+
+
+def prepare_batch(changes):
+    """
+    Packs `changes`, each `[table], pk, cid, val, col_version, db_version,
+    site_id, cl, seq`, into a batch for crsql_apply_changes. Changes to the
+    same row are placed next to each other, keeping their order, so the batch
+    merges a row at a time without a sort window.
+    """
+    rows = {}
+    for change in changes:
+        if len(change) != 9:
+            raise ValueError("a change must have 9 columns")
+        tbl, pk, cid, site_id = change[0], change[1], change[2], change[6]
+        if len(tbl.encode("utf-8")) > MAX_TBL_NAME_LEN:
+            raise ValueError("table name exceeded max length")
+        if len(cid.encode("utf-8")) > MAX_TBL_NAME_LEN:
+            raise ValueError("column name exceeded max length")
+        if site_id is not None and len(site_id) > SITE_ID_LEN:
+            raise ValueError("site id exceeded max length")
+        rows.setdefault((tbl, bytes(pk)), []).append(pack_columns(change))
+    return b"".join(record for records in rows.values() for record in records)
+
+
+def apply_pipelined(c, batches, executor=None, depth=4):
+    """
+    Applies each of `batches` to `c` with crsql_apply_changes, in order, while
+    up to `depth` of the batches after it are prepared by `executor`. Each batch
+    is applied whole or not at all. Returns the number of rows impacted.
+    The caller commits.
+    """
+    own_executor = executor is None
+    if own_executor:
+        executor = ThreadPoolExecutor(1)
+    rows_impacted = 0
+    pending = deque()
+    try:
+        for batch in batches:
+            pending.append(executor.submit(prepare_batch, batch))
+            if len(pending) > depth:
+                rows_impacted += _apply(c, pending.popleft().result())
+        while pending:
+            rows_impacted += _apply(c, pending.popleft().result())
+    finally:
+        for future in pending:
+            future.cancel()
+        if own_executor:
+            executor.shutdown()
+    return rows_impacted
+
+
+def _apply(c, batch):
+    if not batch:
+        return 0
+    return c.execute("SELECT crsql_apply_changes(?)", (batch,)).fetchone()[0]
@@ -0,0 +1,152 @@
+from crsql_correctness import connect, close
+import pytest
+
+# `crsql_apply_changes` merges a whole batch of packed changes in one call.
+# It must end up in the same state as inserting each change into crsql_changes.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+packed_changes_query = "SELECT crsql_pack_columns([table], pk, cid, val, col_version, db_version, site_id, cl, seq) FROM crsql_changes"
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT, c REAL)")
+    c.execute("CREATE TABLE bar (a NOT NULL, b NOT NULL, c, PRIMARY KEY(a, b))")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def write_rows(c, offset):
+    c.execute("INSERT INTO foo VALUES (?, 'one', 1.5), (2, ?, NULL), (300000, 'big', ?)",
+              (1 + offset, "two-{}".format(offset), 0.25 + offset))
+    c.execute("INSERT INTO bar VALUES (1, 'x', x'0102'), (2.5, ?, 2), ('s', 3, 3)",
+              ("y-{}".format(offset),))
+    c.commit()
+    c.execute("UPDATE foo SET b = ? WHERE a = 2", ("uno-{}".format(offset),))
+    c.execute("DELETE FROM bar WHERE a = 2.5")
+    c.execute("UPDATE bar SET a = 10 WHERE a = 1")
+    c.commit()
+
+
+def changeset(c, since=0):
+    return b"".join([row[0] for row in c.execute(
+        packed_changes_query + " WHERE db_version > ?", (since,)).fetchall()])
+
+
+def test_apply_matches_changes_inserts():
+    source = make_db()
+    write_rows(source, 0)
+    via_vtab = make_db()
+    via_apply = make_db()
+
+    for change in source.execute(changes_query).fetchall():
+        via_vtab.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    via_vtab.commit()
+    via_apply.execute("SELECT crsql_apply_changes(?)", (changeset(source),))
+    via_apply.commit()
+
+    for tbl in ["foo", "bar"]:
+        expected = source.execute(
+            "SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall()
+        assert (via_vtab.execute(
+            "SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall() == expected)
+        assert (via_apply.execute(
+            "SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall() == expected)
+    assert (via_apply.execute(changes_query).fetchall() ==
+            via_vtab.execute(changes_query).fetchall())
+    close(source)
+    close(via_vtab)
+    close(via_apply)
+
+
+def test_rows_impacted_per_batch():
+    source = make_db()
+    write_rows(source, 0)
+    target = make_db()
+
+    expected = len(source.execute(changes_query).fetchall())
+    batch = changeset(source)
+    assert (target.execute("SELECT crsql_apply_changes(?)",
+            (batch,)).fetchone()[0] > 0)
+    # nothing left to merge the second time around
+    assert (target.execute("SELECT crsql_apply_changes(?)",
+            (batch,)).fetchone() == (0,))
+    assert (target.execute("SELECT crsql_apply_changes(?)",
+            (b"",)).fetchone() == (0,))
+    target.commit()
+    assert (len(target.execute(changes_query).fetchall()) == expected)
+    close(source)
+    close(target)
+
+
+def test_conflicting_values():
+    a = make_db()
+    b = make_db()
+    write_rows(a, 0)
+    write_rows(b, 1)
+
+    a_changes = changeset(a)
+    b_changes = changeset(b)
+    a.execute("SELECT crsql_apply_changes(?)", (b_changes,))
+    a.commit()
+    b.execute("SELECT crsql_apply_changes(?)", (a_changes,))
+    b.commit()
+
+    for tbl in ["foo", "bar"]:
+        assert (a.execute("SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall() ==
+                b.execute("SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall())
+    close(a)
+    close(b)
+
+
+def test_bad_batch_applies_nothing():
+    source = make_db()
+    write_rows(source, 0)
+    target = make_db()
+
+    bad = target.execute(
+        "SELECT crsql_pack_columns('nope', crsql_pack_columns(1), 'b', 1, 1, 1, NULL, 1, 0)").fetchone()[0]
+    with pytest.raises(Exception):
+        target.execute("SELECT crsql_apply_changes(?)",
+                       (changeset(source) + bad,))
+    target.commit()
+    assert (target.execute("SELECT count(*) FROM foo").fetchone() == (0,))
+
+    with pytest.raises(Exception):
+        target.execute("SELECT crsql_apply_changes(?)",
+                       (changeset(source)[:-3],))
+    close(source)
+    close(target)
+
+
+def test_sort_window():
+    a = make_db()
+    b = make_db()
+    for i in range(3):
+        write_rows(a, i)
+        write_rows(b, i + 10)
+    batch = changeset(a)
+    # versions given to merged changes depend on the order they're merged in
+    state_query = "SELECT [table], pk, cid, val, col_version, site_id, cl FROM crsql_changes ORDER BY [table], pk, cid"
+
+    expected = None
+    for window in [0, 1, 3, 7, 1000]:
+        target = make_db()
+        for i in range(3):
+            write_rows(target, i + 10)
+        assert (target.execute("SELECT crsql_apply_changes(?, ?)", (batch, window)).fetchone()[0] > 0)
+        target.commit()
+        state = [target.execute("SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall()
+                 for tbl in ["foo", "bar"]] + [target.execute(state_query).fetchall()]
+        if expected is None:
+            expected = state
+        assert (state == expected)
+        close(target)
+
+    with pytest.raises(Exception):
+        b.execute("SELECT crsql_apply_changes(?, -1)", (batch,))
+    close(a)
+    close(b)
@@ -0,0 +1,112 @@
+from concurrent.futures import ProcessPoolExecutor
+from crsql_correctness import connect, close
+from crsql_correctness.pipeline import apply_pipelined, pack_columns
+import os
+import time
+
+# Merges the same long history through crsql_changes inserts and through
+# crsql_apply_changes, in arrival order and sorted by row. Each must end up
+# in the same state as the inserts. Prints how long each took.
+# `apply_pipelined` prepares batches on other threads or processes while
+# earlier batches merge.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+packed_changes_query = "SELECT crsql_pack_columns([table], pk, cid, val, col_version, db_version, site_id, cl, seq) FROM crsql_changes"
+# versions given to merged changes depend on the order they're merged in
+state_query = "SELECT [table], pk, cid, val, col_version, site_id, cl FROM crsql_changes ORDER BY [table], pk, cid"
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE issue (id INTEGER PRIMARY KEY NOT NULL, title TEXT, owner TEXT, status INTEGER, body TEXT)")
+    c.execute("CREATE TABLE label (issue INTEGER NOT NULL, name TEXT NOT NULL, color TEXT, PRIMARY KEY (issue, name))")
+    c.execute("SELECT crsql_as_crr('issue')")
+    c.execute("SELECT crsql_as_crr('label')")
+    c.commit()
+    return c
+
+
+def write_history(c):
+    for i in range(5_000):
+        c.execute("INSERT INTO issue VALUES (?, ?, ?, ?, ?)",
+                  (i, "title-{}".format(i), "owner-{}".format(i % 7), i % 3, "body-{}".format(i)))
+        c.execute("INSERT INTO label VALUES (?, 'bug', 'red')", (i,))
+        if i % 100 == 0:
+            c.commit()
+    c.commit()
+    # later edits interleave tables and rows
+    for i in range(0, 5_000, 3):
+        c.execute("UPDATE issue SET status = 9 WHERE id = ?", (i,))
+        c.execute("UPDATE label SET color = 'blue' WHERE issue = ?", (4_999 - i,))
+    c.commit()
+
+
+def state(c):
+    return [c.execute("SELECT * FROM issue ORDER BY id").fetchall(),
+            c.execute("SELECT * FROM label ORDER BY issue, name").fetchall(),
+            c.execute(state_query).fetchall()]
+
+
+def test_apply_matches_inserts_over_long_history():
+    source = make_db()
+    write_history(source)
+    changes = source.execute(changes_query + " ORDER BY db_version, seq").fetchall()
+    batch = b"".join([row[0] for row in source.execute(
+        packed_changes_query + " ORDER BY db_version, seq").fetchall()])
+
+    target = make_db()
+    start_time = time.time()
+    for change in changes:
+        target.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    target.commit()
+    print(f"crsql_changes inserts: {len(changes) / (time.time() - start_time)} changes/s")
+    expected = state(target)
+    assert (expected[:2] == state(source)[:2])
+    close(target)
+
+    for args, label in [((batch,), "in arrival order"), ((batch, 1_000), "sorted by row")]:
+        target = make_db()
+        start_time = time.time()
+        target.execute("SELECT crsql_apply_changes({})".format(
+            ", ".join(["?"] * len(args))), args)
+        target.commit()
+        print(f"crsql_apply_changes {label}: {len(changes) / (time.time() - start_time)} changes/s")
+        assert (state(target) == expected)
+        close(target)
+    close(source)
+
+
+def test_pack_columns_matches_extension():
+    c = connect(":memory:")
+    for values in [(1,), (0, -1, 128, 2 ** 40, -2 ** 63), (None, 1.5, "text", "", b"\x00\x01"),
+                   ("x" * 70_000, b"y" * 300)]:
+        assert (pack_columns(values) == c.execute("SELECT crsql_pack_columns({})".format(
+            ", ".join(["?"] * len(values))), values).fetchone()[0])
+    close(c)
+
+
+def test_pipelined_apply_matches_inserts():
+    source = make_db()
+    write_history(source)
+    changes = source.execute(changes_query + " ORDER BY db_version, seq").fetchall()
+    batches = [changes[i:i + 1_000] for i in range(0, len(changes), 1_000)]
+
+    target = make_db()
+    for change in changes:
+        target.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    target.commit()
+    expected = state(target)
+    close(target)
+
+    with ProcessPoolExecutor(max(2, (os.cpu_count() or 2) - 1)) as pool:
+        for executor, label in [(None, "a worker thread"), (pool, "worker processes")]:
+            target = make_db()
+            start_time = time.time()
+            apply_pipelined(target, batches, executor)
+            target.commit()
+            print(f"apply_pipelined on {label}: {len(changes) / (time.time() - start_time)} changes/s")
+            assert (state(target) == expected)
+            close(target)
+    close(source)
@@ -0,0 +1,121 @@
+from crsql_correctness import connect, close
+import os
+import pytest
+import time
+
+# Builds linked against SQLite with SQLITE_ENABLE_PREUPDATE_HOOK can have the
+# preupdate hook work out which columns an update changed rather than passing
+# every column, old and new, to the update trigger. Times both when available.
+# `make correctness_preupdate` builds such an extension and sets
+# CRSQL_EXPECT_CAPTURE so these tests fail rather than skip without the hook.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, cl, seq FROM crsql_changes"
+columns = ["c{}".format(i) for i in range(40)]
+
+
+def capture_available():
+    c = connect(":memory:")
+    try:
+        c.execute("SELECT crsql_config_set('capture-updates', 1)")
+        return True
+    except Exception:
+        return False
+    finally:
+        close(c)
+
+
+def skip_without_capture():
+    if capture_available():
+        return
+    assert not os.environ.get("CRSQL_EXPECT_CAPTURE"), "built without the preupdate hook"
+    pytest.skip("built without the preupdate hook")
+
+
+def make_db(capture):
+    c = connect(":memory:")
+    if capture:
+        c.execute("SELECT crsql_config_set('capture-updates', 1)")
+    c.execute("CREATE TABLE wide (id INTEGER PRIMARY KEY NOT NULL, {})".format(
+        ", ".join(columns)))
+    c.execute("SELECT crsql_as_crr('wide')")
+    c.commit()
+    return c
+
+
+def write_rows(c):
+    for i in range(1_000):
+        c.execute("INSERT INTO wide VALUES (?, {})".format(", ".join(["?"] * len(columns))),
+                  [i] + ["{}-{}".format(i, x) for x in columns])
+    c.commit()
+    start_time = time.time()
+    for n in range(10):
+        c.execute("UPDATE wide SET c3 = ?, c17 = c17", (n,))
+    c.commit()
+    return time.time() - start_time
+
+
+def test_capture_needs_preupdate_hook():
+    if capture_available():
+        pytest.skip("built with the preupdate hook")
+    c = connect(":memory:")
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_config_set('capture-updates', 1)")
+    assert (c.execute("SELECT crsql_config_get('capture-updates')").fetchone() == (0,))
+    close(c)
+
+
+def test_captured_updates_match_triggers():
+    skip_without_capture()
+    triggers = make_db(False)
+    trigger_time = write_rows(triggers)
+    print(f"update trigger: {10_000 / trigger_time} rows/s")
+
+    captured = make_db(True)
+    capture_time = write_rows(captured)
+    print(f"preupdate hook: {10_000 / capture_time} rows/s")
+    assert (captured.execute(changes_query + " ORDER BY pk, cid").fetchall() ==
+            triggers.execute(changes_query + " ORDER BY pk, cid").fetchall())
+    close(triggers)
+    close(captured)
+
+
+def make_self_updating_db(capture, user_trigger_first):
+    c = connect(":memory:")
+    if capture:
+        c.execute("SELECT crsql_config_set('capture-updates', 1)")
+    c.execute("CREATE TABLE item (id INTEGER PRIMARY KEY NOT NULL, a TEXT, b TEXT, touched INTEGER)")
+    user_trigger = """CREATE TRIGGER item_touch AFTER UPDATE ON item BEGIN
+        UPDATE item SET touched = coalesce(touched, 0) + 1 WHERE id = NEW.id;
+        UPDATE item SET touched = coalesce(touched, 0) + 1 WHERE id = NEW.id + 100;
+      END"""
+    # SQLite runs the triggers created last first
+    if user_trigger_first:
+        c.execute("SELECT crsql_as_crr('item')")
+        c.execute(user_trigger)
+    else:
+        c.execute(user_trigger)
+        c.execute("SELECT crsql_as_crr('item')")
+    c.execute("INSERT INTO item VALUES (1, 'a', 'b', NULL), (101, 'a', 'b', NULL)")
+    c.commit()
+    c.execute("UPDATE item SET a = 'aa' WHERE id = 1")
+    c.commit()
+    return c
+
+
+@pytest.mark.parametrize("user_trigger_first", [True, False])
+def test_self_updating_user_trigger(user_trigger_first):
+    skip_without_capture()
+    triggers = make_self_updating_db(False, user_trigger_first)
+    captured = make_self_updating_db(True, user_trigger_first)
+    # seq follows the order triggers run in so isn't compared
+    clocks = "SELECT pk, cid, val, col_version, db_version, cl FROM crsql_changes ORDER BY pk, cid"
+    assert (captured.execute(clocks).fetchall() == triggers.execute(clocks).fetchall())
+    assert ([row[:2] + row[3:4] for row in captured.execute(clocks).fetchall()] == [
+        (b'\x01\x09\x01', 'a', 2),
+        (b'\x01\x09\x01', 'b', 1),
+        (b'\x01\x09\x01', 'touched', 2),
+        (b'\x01\x09\x65', 'a', 1),
+        (b'\x01\x09\x65', 'b', 1),
+        (b'\x01\x09\x65', 'touched', 2)])
+    close(triggers)
+    close(captured)
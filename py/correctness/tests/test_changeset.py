@@ -0,0 +1,116 @@
+from crsql_correctness import connect, close, get_site_id
+
+# `crsql_changeset` encodes the same rows as crsql_changes into one compact blob
+# which `crsql_apply_changes` can merge directly.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+packed_changes_query = "SELECT crsql_pack_columns([table], pk, cid, val, col_version, db_version, site_id, cl, seq) FROM crsql_changes"
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT, c REAL)")
+    c.execute("CREATE TABLE bar (a NOT NULL, b NOT NULL, c, PRIMARY KEY(a, b))")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def write_rows(c):
+    for i in range(20):
+        c.execute("INSERT INTO foo VALUES (?, ?, ?)", (i, "b-{}".format(i), i / 3))
+        c.execute("INSERT INTO bar VALUES (?, ?, ?)",
+                  (i, "k", bytes([i, 255 - i]) if i % 2 == 0 else None))
+        if i % 3 == 0:
+            c.commit()
+    c.execute("UPDATE foo SET b = NULL WHERE a < 5")
+    c.execute("DELETE FROM bar WHERE a > 15")
+    c.execute("UPDATE foo SET c = -9223372036854775808 WHERE a = 7")
+    c.commit()
+
+
+def assert_same_tables(l, r):
+    for tbl in ["foo", "bar"]:
+        assert (l.execute("SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall() ==
+                r.execute("SELECT * FROM {} ORDER BY a, b".format(tbl)).fetchall())
+
+
+def test_round_trip():
+    source = make_db()
+    write_rows(source)
+    target = make_db()
+
+    changeset = source.execute("SELECT crsql_changeset(0)").fetchone()[0]
+    target.execute("SELECT crsql_apply_changes(?)", (changeset,))
+    target.commit()
+
+    assert_same_tables(source, target)
+    assert (target.execute(changes_query).fetchall() ==
+            source.execute(changes_query).fetchall())
+    close(source)
+    close(target)
+
+
+def test_smaller_than_packed_rows():
+    source = make_db()
+    write_rows(source)
+
+    changeset = source.execute("SELECT crsql_changeset(0)").fetchone()[0]
+    packed = b"".join([row[0] for row in source.execute(
+        packed_changes_query).fetchall()])
+    assert (len(changeset) < len(packed))
+    close(source)
+
+
+def test_since_and_exclude_site():
+    a = make_db()
+    b = make_db()
+    write_rows(a)
+    b.execute("INSERT INTO foo VALUES (100, 'from b', 1.0)")
+    b.commit()
+
+    b.execute("SELECT crsql_apply_changes(?)",
+              (a.execute("SELECT crsql_changeset(0)").fetchone()[0],))
+    b.commit()
+
+    # everything b has minus what it got from a is only its own write
+    changeset = b.execute("SELECT crsql_changeset(0, ?)",
+                          (get_site_id(a),)).fetchone()[0]
+    c = make_db()
+    c.execute("SELECT crsql_apply_changes(?)", (changeset,))
+    c.commit()
+    assert (c.execute("SELECT * FROM foo").fetchall() == [(100, 'from b', 1.0)])
+    assert (c.execute("SELECT count(*) FROM bar").fetchone() == (0,))
+
+    # changes after a db_version match the rows crsql_changes has after it
+    since = a.execute("SELECT max(db_version) / 2 FROM crsql_changes").fetchone()[0]
+    changeset = a.execute("SELECT crsql_changeset(?)", (since,)).fetchone()[0]
+    d = make_db()
+    d.execute("SELECT crsql_apply_changes(?)", (changeset,))
+    d.commit()
+    assert (len(d.execute(changes_query).fetchall()) ==
+            len(a.execute(changes_query + " WHERE db_version > ?", (since,)).fetchall()))
+    close(a)
+    close(b)
+    close(c)
+    close(d)
+
+
+def test_empty_and_corrupt():
+    c = make_db()
+    empty = c.execute("SELECT crsql_changeset(0)").fetchone()[0]
+    assert (c.execute("SELECT crsql_apply_changes(?)", (empty,)).fetchone() == (0,))
+
+    source = make_db()
+    write_rows(source)
+    changeset = source.execute("SELECT crsql_changeset(0)").fetchone()[0]
+    try:
+        c.execute("SELECT crsql_apply_changes(?)", (changeset[:-2],))
+        assert (False)
+    except Exception:
+        pass
+    c.commit()
+    assert (c.execute("SELECT count(*) FROM foo").fetchone() == (0,))
+    close(c)
+    close(source)
@@ -0,0 +1,173 @@
+from crsql_correctness import connect, close
+import time
+
+# With the `column-triggers` config set, tables made into crrs get an update
+# trigger per column so an update only passes along the columns it sets.
+# Clocks must come out the same as with the single update trigger.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, cl, seq FROM crsql_changes"
+trigger_query = "SELECT name FROM sqlite_master WHERE type = 'trigger' AND tbl_name = 'foo' ORDER BY name"
+columns = ["c{}".format(i) for i in range(120)]
+
+
+def make_db(column_triggers):
+    c = connect(":memory:")
+    if column_triggers:
+        c.execute("SELECT crsql_config_set('column-triggers', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER NOT NULL, b TEXT NOT NULL, c TEXT, d INTEGER, PRIMARY KEY (a, b))")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def write_rows(c):
+    c.execute("INSERT INTO foo VALUES (1, 'one', 'x', 1), (2, 'two', 'y', 2), (3, 'three', 'z', 3)")
+    c.commit()
+    c.execute("UPDATE foo SET c = 'xx' WHERE a = 1")
+    c.execute("UPDATE foo SET c = 'yy', d = d WHERE a = 2")
+    c.commit()
+    # primary key set to itself alongside a column
+    c.execute("UPDATE foo SET a = a, d = 30 WHERE a = 3")
+    c.commit()
+    # primary key changes with and without other columns
+    c.execute("UPDATE foo SET a = 10 WHERE a = 1")
+    c.execute("UPDATE foo SET b = 'deux', c = 'yyy' WHERE a = 2")
+    c.commit()
+    c.execute("UPDATE foo SET c = NULL")
+    c.commit()
+
+
+def test_config():
+    c = connect(":memory:")
+    assert (c.execute("SELECT crsql_config_get('column-triggers')").fetchone() == (0,))
+    assert (c.execute("SELECT crsql_config_set('column-triggers', 1)").fetchone() == (1,))
+    assert (c.execute("SELECT crsql_config_get('column-triggers')").fetchone() == (1,))
+    close(c)
+
+
+def test_triggers_made_and_dropped():
+    c = make_db(True)
+    assert (c.execute(trigger_query).fetchall() == [
+        ('foo__crsql_dtrig',),
+        ('foo__crsql_itrig',),
+        ('foo__crsql_utrig',),
+        ('foo__crsql_utrig_c',),
+        ('foo__crsql_utrig_d',)])
+
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN e INTEGER")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    assert (('foo__crsql_utrig_e',) in c.execute(trigger_query).fetchall())
+
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo DROP COLUMN e")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    assert (('foo__crsql_utrig_e',) not in c.execute(trigger_query).fetchall())
+
+    c.execute("SELECT crsql_as_table('foo')")
+    assert (c.execute(trigger_query).fetchall() == [])
+    close(c)
+
+
+def test_alter_keeps_mode():
+    # the setting is read when the table is made into a crr, not when it is altered
+    c = make_db(True)
+    c.execute("SELECT crsql_config_set('column-triggers', 0)")
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN e INTEGER")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    assert (('foo__crsql_utrig_e',) in c.execute(trigger_query).fetchall())
+    close(c)
+
+    c = make_db(False)
+    c.execute("SELECT crsql_config_set('column-triggers', 1)")
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN e INTEGER")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    assert (c.execute(trigger_query).fetchall() == [
+        ('foo__crsql_dtrig',),
+        ('foo__crsql_itrig',),
+        ('foo__crsql_utrig',)])
+    close(c)
+
+
+def test_changes_same_as_update_trigger():
+    column_triggers = make_db(True)
+    update_trigger = make_db(False)
+    write_rows(column_triggers)
+    write_rows(update_trigger)
+    assert (column_triggers.execute(changes_query + " ORDER BY db_version, seq").fetchall() ==
+            update_trigger.execute(changes_query + " ORDER BY db_version, seq").fetchall())
+    close(column_triggers)
+    close(update_trigger)
+
+
+def test_narrow_updates_of_wide_table():
+    for column_triggers in [False, True]:
+        c = connect(":memory:")
+        if column_triggers:
+            c.execute("SELECT crsql_config_set('column-triggers', 1)")
+        c.execute("CREATE TABLE wide (id INTEGER PRIMARY KEY NOT NULL, {})".format(
+            ", ".join(columns)))
+        c.execute("SELECT crsql_as_crr('wide')")
+        for i in range(1_000):
+            c.execute("INSERT INTO wide VALUES (?, {})".format(", ".join(["?"] * len(columns))),
+                      [i] + ["{}".format(x) * 20 for x in columns])
+        c.commit()
+        start_time = time.time()
+        for n in range(10):
+            c.execute("UPDATE wide SET c3 = ?", (n,))
+            c.commit()
+        label = "per column triggers" if column_triggers else "update trigger"
+        print(f"{label}: {10_000 / (time.time() - start_time)} rows/s")
+        assert (c.execute("SELECT count(*) FROM crsql_changes WHERE cid = 'c3' AND col_version = 11").fetchone() == (1_000,))
+        close(c)
+
+
+def test_updates_after_rolled_back_keys():
+    # keys handed out in a rolled back savepoint are handed out again to other rows
+    def write(c):
+        c.execute("INSERT INTO foo VALUES (1, 'one', 'x', 1)")
+        c.commit()
+        c.execute("SAVEPOINT s")
+        c.execute("INSERT INTO foo VALUES (2, 'two', 'y', 2)")
+        c.execute("UPDATE foo SET c = 'yy', d = 22 WHERE a = 2")
+        c.execute("ROLLBACK TO s")
+        c.execute("INSERT INTO foo VALUES (3, 'three', 'z', 3)")
+        c.execute("INSERT INTO foo VALUES (2, 'two', 'y', 2)")
+        c.execute("UPDATE foo SET c = 'yy', d = 22 WHERE a = 2")
+        c.execute("RELEASE s")
+        c.commit()
+
+    column_triggers = make_db(True)
+    update_trigger = make_db(False)
+    write(column_triggers)
+    write(update_trigger)
+    assert (column_triggers.execute(changes_query + " ORDER BY db_version, seq").fetchall() ==
+            update_trigger.execute(changes_query + " ORDER BY db_version, seq").fetchall())
+    close(column_triggers)
+    close(update_trigger)
+
+
+def test_several_columns_of_wide_table():
+    # the row's key is looked up once however many column triggers run
+    for column_triggers in [False, True]:
+        c = connect(":memory:")
+        if column_triggers:
+            c.execute("SELECT crsql_config_set('column-triggers', 1)")
+        c.execute("CREATE TABLE wide (id INTEGER PRIMARY KEY NOT NULL, {})".format(
+            ", ".join(columns)))
+        c.execute("SELECT crsql_as_crr('wide')")
+        for i in range(1_000):
+            c.execute("INSERT INTO wide VALUES (?, {})".format(", ".join(["?"] * len(columns))),
+                      [i] + ["{}".format(x) * 20 for x in columns])
+        c.commit()
+        start_time = time.time()
+        for n in range(10):
+            c.execute("UPDATE wide SET {}".format(", ".join(
+                "{} = ?".format(col) for col in columns[:8])), [n] * 8)
+            c.commit()
+        label = "per column triggers" if column_triggers else "update trigger"
+        print(f"{label}, 8 columns: {10_000 / (time.time() - start_time)} rows/s")
+        assert (c.execute("SELECT count(*) FROM crsql_changes WHERE col_version = 11").fetchone() == (8_000,))
+        close(c)
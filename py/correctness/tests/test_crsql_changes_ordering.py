@@ -0,0 +1,77 @@
+from crsql_correctness import connect, close
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def setup_db():
+    c = connect(":memory:")
+    for tbl in ["foo", "bar", "baz"]:
+        c.execute(
+            "CREATE TABLE {} (id PRIMARY KEY NOT NULL, x INTEGER, y TEXT)".format(tbl))
+        c.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    c.commit()
+
+    # interleave writes across tables both within and across transactions
+    for i in range(10):
+        for tbl in ["baz", "foo", "bar"][i % 3:] + ["baz", "foo", "bar"][:i % 3]:
+            c.execute(
+                "INSERT INTO {} VALUES (?, ?, ?)".format(tbl), (i, i, tbl))
+        if i % 2 == 0:
+            c.commit()
+    c.execute("UPDATE foo SET x = 100 WHERE id = 1")
+    c.execute("DELETE FROM bar WHERE id = 2")
+    c.execute("UPDATE baz SET y = 'z' WHERE id = 3")
+    c.commit()
+    return c
+
+
+def test_default_order_is_version_order():
+    c = setup_db()
+    changes = c.execute(changes_query).fetchall()
+    assert (len(changes) > 0)
+    assert ([(row[5], row[8]) for row in changes] ==
+            sorted([(row[5], row[8]) for row in changes]))
+    close(c)
+
+
+def test_version_order_matches_sorted_union():
+    c = setup_db()
+    expected = sorted(c.execute(changes_query).fetchall(),
+                      key=lambda row: (row[5], row[8]))
+    for order_by in ["", " ORDER BY db_version", " ORDER BY db_version, seq", " ORDER BY db_version ASC, seq ASC"]:
+        assert (c.execute(changes_query + order_by).fetchall() == expected)
+
+    expected = [row for row in expected if row[5] > 3]
+    assert (c.execute(changes_query +
+            " WHERE db_version > 3 ORDER BY db_version, seq").fetchall() == expected)
+    close(c)
+
+
+def test_other_orderings():
+    c = setup_db()
+    all_changes = c.execute(changes_query).fetchall()
+
+    changes = c.execute(changes_query + " ORDER BY db_version DESC").fetchall()
+    assert ([row[5] for row in changes] == sorted(
+        [row[5] for row in all_changes], reverse=True))
+
+    changes = c.execute(changes_query + " ORDER BY seq, db_version").fetchall()
+    assert ([(row[8], row[5]) for row in changes] ==
+            sorted([(row[8], row[5]) for row in all_changes]))
+    close(c)
+
+
+def test_merge_with_empty_tables():
+    c = connect(":memory:")
+    for tbl in ["foo", "bar", "baz"]:
+        c.execute(
+            "CREATE TABLE {} (id PRIMARY KEY NOT NULL, x INTEGER)".format(tbl))
+        c.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    c.commit()
+    assert (c.execute(changes_query).fetchall() == [])
+
+    c.execute("INSERT INTO bar VALUES (1, 1)")
+    c.commit()
+    changes = c.execute(changes_query).fetchall()
+    assert ([(row[0], row[2]) for row in changes] == [('bar', 'x')])
+    close(c)
@@ -0,0 +1,106 @@
+from crsql_correctness import connect, close
+
+# LIMIT / OFFSET are pushed down into crsql_changes and reads can resume
+# after a given (db_version, seq) through the hidden after_db_version and after_seq columns.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def setup_db():
+    c = connect(":memory:")
+    for tbl in ["foo", "bar", "baz"]:
+        c.execute(
+            "CREATE TABLE {} (id PRIMARY KEY NOT NULL, x INTEGER, y TEXT)".format(tbl))
+        c.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    c.commit()
+
+    for i in range(15):
+        for tbl in ["baz", "foo", "bar"][i % 3:] + ["baz", "foo", "bar"][:i % 3]:
+            c.execute(
+                "INSERT INTO {} VALUES (?, ?, ?)".format(tbl), (i, i, tbl))
+        if i % 4 == 0:
+            c.commit()
+    c.execute("DELETE FROM foo WHERE id = 3")
+    c.commit()
+    return (c, c.execute(changes_query + " ORDER BY db_version, seq").fetchall())
+
+
+def test_limit_offset():
+    (c, all_changes) = setup_db()
+    for (limit, offset) in [(0, 0), (1, 0), (7, 0), (7, 5), (1000, 0), (5, 1000), (-1, 3)]:
+        expected = all_changes[offset:] if limit < 0 else all_changes[offset:offset + limit]
+        assert (c.execute(changes_query + " LIMIT ? OFFSET ?",
+                (limit, offset)).fetchall() == expected)
+        assert (c.execute(changes_query + " ORDER BY db_version, seq LIMIT ? OFFSET ?",
+                (limit, offset)).fetchall() == expected)
+    close(c)
+
+
+def test_limit_with_constraints():
+    (c, all_changes) = setup_db()
+    expected = [row for row in all_changes if row[0] in ['foo', 'bar'] and row[5] > 2]
+    assert (c.execute(changes_query + " WHERE [table] IN ('foo', 'bar') AND db_version > 2 LIMIT 4 OFFSET 2").fetchall() ==
+            expected[2:6])
+
+    # constraints crsql_changes can't handle must still be applied before the limit
+    expected = [row for row in all_changes if row[2] == 'x']
+    assert (c.execute(changes_query + " WHERE cid = 'x' LIMIT 5").fetchall() ==
+            expected[:5])
+    expected = [row for row in all_changes if row[3] == 'bar']
+    assert (c.execute(changes_query + " WHERE val = 'bar' LIMIT 3").fetchall() ==
+            expected[:3])
+
+    ordered = sorted(all_changes, key=lambda row: row[8])
+    assert ([row[8] for row in c.execute(changes_query + " ORDER BY seq LIMIT 5").fetchall()] ==
+            [row[8] for row in ordered[:5]])
+    close(c)
+
+
+def test_resume_pages():
+    (c, all_changes) = setup_db()
+    for page_size in [1, 4, 10, 1000]:
+        pages = []
+        rows = c.execute(changes_query + " LIMIT ?", (page_size,)).fetchall()
+        while len(rows) > 0:
+            pages.extend(rows)
+            last = rows[-1]
+            rows = c.execute(
+                changes_query + " WHERE after_db_version = ? AND after_seq = ? LIMIT ?", (last[5], last[8], page_size)).fetchall()
+        assert (pages == all_changes)
+    close(c)
+
+
+def test_resume_predicate():
+    (c, all_changes) = setup_db()
+    (dbv, seq) = (all_changes[10][5], all_changes[10][8])
+    assert (c.execute(changes_query + " WHERE after_db_version = ? AND after_seq = ?", (dbv, seq)).fetchall() ==
+            [row for row in all_changes if (row[5], row[8]) > (dbv, seq)])
+    assert (c.execute(changes_query + " WHERE after_db_version = ?", (dbv,)).fetchall() ==
+            [row for row in all_changes if row[5] > dbv])
+    assert (c.execute(changes_query + " WHERE [table] = 'bar' AND after_db_version = ? AND after_seq = ?", (dbv, seq)).fetchall() ==
+            [row for row in all_changes if (row[5], row[8]) > (dbv, seq) and row[0] == 'bar'])
+    close(c)
+
+
+def test_hidden_columns():
+    (c, all_changes) = setup_db()
+    assert (c.execute("SELECT * FROM crsql_changes").fetchall() == all_changes)
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_changes WHERE after_db_version IS NULL").fetchone() == (len(all_changes),))
+
+    # inserts without a column list only cover the visible columns
+    d = connect(":memory:")
+    for tbl in ["foo", "bar", "baz"]:
+        d.execute(
+            "CREATE TABLE {} (id PRIMARY KEY NOT NULL, x INTEGER, y TEXT)".format(tbl))
+        d.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    d.commit()
+    for change in all_changes:
+        d.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    d.commit()
+    for tbl in ["foo", "bar", "baz"]:
+        assert (d.execute("SELECT * FROM {} ORDER BY id".format(tbl)).fetchall() ==
+                c.execute("SELECT * FROM {} ORDER BY id".format(tbl)).fetchall())
+    close(c)
+    close(d)
@@ -0,0 +1,93 @@
+from crsql_correctness import connect, close
+
+# `pk = ?` is resolved to the lookaside key of each table and pushed into the
+# clock table lookups. The rows returned must match filtering every change by pk.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def setup_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id PRIMARY KEY NOT NULL, x, y)")
+    c.execute("CREATE TABLE bar (id PRIMARY KEY NOT NULL, x)")
+    c.execute("CREATE TABLE baz (a NOT NULL, b NOT NULL, x, PRIMARY KEY (a, b))")
+    for tbl in ["foo", "bar", "baz"]:
+        c.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    c.commit()
+
+    for i in range(10):
+        c.execute("INSERT INTO foo VALUES (?, ?, ?)", (i, i, "y"))
+        if i % 2 == 0:
+            c.execute("INSERT INTO bar VALUES (?, ?)", (i, i))
+        c.execute("INSERT INTO baz VALUES (?, 'k', ?)", (i, i))
+        c.commit()
+    c.execute("UPDATE foo SET x = 100 WHERE id = 4")
+    c.execute("DELETE FROM bar WHERE id = 6")
+    c.commit()
+    return c
+
+
+def pk_of(c, *values):
+    return c.execute("SELECT crsql_pack_columns({})".format(
+        ", ".join(["?"] * len(values))), values).fetchone()[0]
+
+
+def test_pk_equality():
+    c = setup_db()
+    all_changes = c.execute(changes_query).fetchall()
+    for id in [0, 4, 6, 7, 42]:
+        pk = pk_of(c, id)
+        expected = [row for row in all_changes if row[1] == pk]
+        assert (c.execute(changes_query + " WHERE pk = ?", (pk,)).fetchall() == expected)
+        for tbl in ["foo", "bar", "baz"]:
+            assert (c.execute(changes_query + " WHERE [table] = ? AND pk = ?", (tbl, pk)).fetchall() ==
+                    [row for row in expected if row[0] == tbl])
+
+    pk = pk_of(c, 3, 'k')
+    assert (c.execute(changes_query + " WHERE pk = ?", (pk,)).fetchall() ==
+            [row for row in all_changes if row[1] == pk])
+    assert (len(c.execute(changes_query + " WHERE pk = ?", (pk,)).fetchall()) > 0)
+    close(c)
+
+
+def test_pk_with_other_constraints_and_orderings():
+    c = setup_db()
+    all_changes = c.execute(changes_query).fetchall()
+    pk = pk_of(c, 4)
+    expected = [row for row in all_changes if row[1] == pk]
+
+    assert (c.execute(changes_query + " WHERE pk = ? AND db_version > 5", (pk,)).fetchall() ==
+            [row for row in expected if row[5] > 5])
+    assert (c.execute(changes_query + " WHERE pk = ? AND cid = 'x'", (pk,)).fetchall() ==
+            [row for row in expected if row[2] == 'x'])
+    assert (c.execute(changes_query + " WHERE pk = ? ORDER BY db_version DESC, seq DESC", (pk,)).fetchall() ==
+            sorted(expected, key=lambda row: (row[5], row[8]), reverse=True))
+    assert ([row[2] for row in c.execute(changes_query + " WHERE pk = ? ORDER BY cid", (pk,)).fetchall()] ==
+            sorted([row[2] for row in expected]))
+    assert (c.execute(changes_query + " WHERE pk = ? LIMIT 2", (pk,)).fetchall() ==
+            expected[:2])
+    counts = {}
+    for row in expected:
+        counts[row[0]] = counts.get(row[0], 0) + 1
+    assert (sorted(c.execute("SELECT [table], count(*) FROM crsql_changes WHERE pk = ? GROUP BY [table]", (pk,)).fetchall()) ==
+            sorted(counts.items()))
+    close(c)
+
+
+def test_pk_that_matches_nothing():
+    c = setup_db()
+    for pk in [None, b"", b"\x09", "text", 1, pk_of(c, 1, 2, 3)]:
+        assert (c.execute(changes_query + " WHERE pk = ?", (pk,)).fetchall() == [])
+    close(c)
+
+
+def test_pk_in_join():
+    c = setup_db()
+    all_changes = c.execute(changes_query).fetchall()
+    c.execute("CREATE TABLE hot (pk BLOB)")
+    hot = [pk_of(c, 2), pk_of(c, 5)]
+    c.executemany("INSERT INTO hot VALUES (?)", [(pk,) for pk in hot])
+    c.commit()
+    assert (sorted(c.execute("SELECT crsql_changes.* FROM hot JOIN crsql_changes ON crsql_changes.pk = hot.pk").fetchall()) ==
+            sorted([row for row in c.execute("SELECT * FROM crsql_changes").fetchall() if row[1] in hot]))
+    close(c)
@@ -0,0 +1,85 @@
+from crsql_correctness import connect, close
+
+# crsql_changes costs queries from the statistics of the clock tables
+# and drains tables one after the other when rows only need to be grouped by table.
+# Whatever plan gets picked, the results must not change.
+
+
+def setup_db():
+    c = connect(":memory:")
+    for tbl in ["foo", "bar", "baz"]:
+        c.execute(
+            "CREATE TABLE {} (id PRIMARY KEY NOT NULL, x INTEGER, y TEXT)".format(tbl))
+        c.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    c.commit()
+
+    for i in range(20):
+        for tbl in ["foo", "bar", "baz"][:1 + i % 3]:
+            c.execute(
+                "INSERT INTO {} VALUES (?, ?, ?)".format(tbl), (i, i, tbl))
+        c.commit()
+    c.execute("DELETE FROM bar WHERE id = 4")
+    c.commit()
+    return c
+
+
+def expected_counts(c):
+    counts = {}
+    for (tbl,) in c.execute("SELECT [table] FROM crsql_changes").fetchall():
+        counts[tbl] = counts.get(tbl, 0) + 1
+    return sorted(counts.items())
+
+
+def test_group_by_table():
+    c = setup_db()
+    for analyze in [False, True]:
+        if analyze:
+            c.execute("ANALYZE")
+        expected = expected_counts(c)
+        assert (c.execute(
+            "SELECT [table], count(*) FROM crsql_changes GROUP BY [table] ORDER BY [table]").fetchall() == expected)
+        assert (sorted(c.execute(
+            "SELECT [table], count(*) FROM crsql_changes GROUP BY [table]").fetchall()) == expected)
+        assert (sorted(c.execute(
+            "SELECT DISTINCT [table] FROM crsql_changes").fetchall()) == [(tbl,) for (tbl, _) in expected])
+        assert (c.execute(
+            "SELECT [table], count(*) FROM crsql_changes WHERE db_version > 10 GROUP BY [table] ORDER BY [table]").fetchall() ==
+            sorted([(tbl, n) for (tbl, n) in c.execute(
+                "SELECT [table], count(*) FROM (SELECT [table] FROM crsql_changes WHERE db_version > 10) GROUP BY [table]").fetchall()]))
+    close(c)
+
+
+def test_constraints_with_literals():
+    c = setup_db()
+    all_changes = c.execute(
+        "SELECT [table], pk, cid, db_version, seq FROM crsql_changes").fetchall()
+    for analyze in [False, True]:
+        if analyze:
+            c.execute("ANALYZE")
+        assert (c.execute("SELECT [table], pk, cid, db_version, seq FROM crsql_changes WHERE db_version > 15").fetchall() ==
+                [row for row in all_changes if row[3] > 15])
+        assert (c.execute("SELECT [table], pk, cid, db_version, seq FROM crsql_changes WHERE db_version <= 3").fetchall() ==
+                [row for row in all_changes if row[3] <= 3])
+        assert (c.execute("SELECT [table], pk, cid, db_version, seq FROM crsql_changes WHERE db_version = 7").fetchall() ==
+                [row for row in all_changes if row[3] == 7])
+        assert (c.execute("SELECT [table], pk, cid, db_version, seq FROM crsql_changes WHERE [table] = 'baz' AND db_version >= 1000").fetchall() ==
+                [])
+    close(c)
+
+
+def test_join_against_changes():
+    c = setup_db()
+    c.execute("CREATE TABLE wanted (v INTEGER PRIMARY KEY)")
+    c.executemany("INSERT INTO wanted VALUES (?)", [(2,), (9,), (14,)])
+    c.commit()
+    all_changes = c.execute(
+        "SELECT [table], pk, cid, db_version, seq FROM crsql_changes").fetchall()
+    expected = sorted([row for row in all_changes if row[3] in [2, 9, 14]])
+    for analyze in [False, True]:
+        if analyze:
+            c.execute("ANALYZE")
+        assert (sorted(c.execute(
+            "SELECT [table], pk, cid, db_version, seq FROM wanted JOIN crsql_changes ON db_version = wanted.v").fetchall()) == expected)
+        assert (sorted(c.execute(
+            "SELECT [table], pk, cid, db_version, seq FROM crsql_changes JOIN wanted ON db_version = wanted.v").fetchall()) == expected)
+    close(c)
@@ -0,0 +1,51 @@
+from crsql_correctness import connect, close
+
+# Values for all the column changes of a row are read with a single lookup.
+# Make sure each change still reports the value of its own column.
+
+
+def test_wide_row_values():
+    c = connect(":memory:")
+    cols = ["c{}".format(i) for i in range(20)]
+    c.execute("CREATE TABLE wide (id PRIMARY KEY NOT NULL, {})".format(
+        ", ".join(cols)))
+    c.execute("SELECT crsql_as_crr('wide')")
+    c.commit()
+
+    for id in range(3):
+        c.execute("INSERT INTO wide VALUES (?, {})".format(
+            ", ".join(["?"] * len(cols))), [id] + ["{}-{}".format(id, col) for col in cols])
+    c.commit()
+    c.execute("UPDATE wide SET c3 = 'x', c17 = 'y' WHERE id = 1")
+    c.commit()
+
+    changes = c.execute(
+        "SELECT pk, cid, val FROM crsql_changes WHERE [table] = 'wide'").fetchall()
+    assert (len(changes) == 3 * len(cols))
+    for (pk, cid, val) in changes:
+        id = c.execute(
+            "SELECT cell FROM crsql_unpack_columns(?)", (pk,)).fetchone()[0]
+        expected = c.execute(
+            "SELECT \"{}\" FROM wide WHERE id = ?".format(cid), (id,)).fetchone()[0]
+        assert (val == expected)
+    close(c)
+
+
+def test_sentinels_next_to_column_changes():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id PRIMARY KEY NOT NULL, a, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+
+    c.execute("INSERT INTO foo VALUES (1, 'a', 'b')")
+    c.execute("DELETE FROM foo WHERE id = 1")
+    c.execute("INSERT INTO foo VALUES (1, 'aa', 'bb')")
+    c.execute("INSERT INTO foo VALUES (2, 'a2', 'b2')")
+    c.execute("DELETE FROM foo WHERE id = 2")
+    c.commit()
+
+    changes = c.execute(
+        "SELECT cid, val, cl FROM crsql_changes ORDER BY db_version, seq").fetchall()
+    assert (sorted(changes, key=lambda x: (x[0], str(x[1]), x[2])) ==
+            [('-1', None, 2), ('-1', None, 3), ('a', 'aa', 3), ('b', 'bb', 3)])
+    close(c)
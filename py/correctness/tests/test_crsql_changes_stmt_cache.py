@@ -0,0 +1,64 @@
+from crsql_correctness import connect, close
+
+# Statements used to read crsql_changes are cached per connection.
+# Repeated, nested and post-schema-change queries must still see the right data.
+
+poll = "SELECT [table], pk, cid, val FROM crsql_changes WHERE db_version > ? AND site_id IS NOT ?"
+
+
+def test_repeated_polls_see_new_changes():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id PRIMARY KEY NOT NULL, x)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+
+    assert (c.execute(poll, (0, b'')).fetchall() == [])
+    for i in range(5):
+        c.execute("INSERT INTO foo VALUES (?, ?)", (i, i))
+        c.commit()
+        assert (len(c.execute(poll, (0, b'')).fetchall()) == i + 1)
+        assert (len(c.execute(poll, (i + 1, b'')).fetchall()) == 0)
+    close(c)
+
+
+def test_nested_queries():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id PRIMARY KEY NOT NULL, x)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    for i in range(3):
+        c.execute("INSERT INTO foo VALUES (?, ?)", (i, i))
+        c.commit()
+
+    outer = c.execute(poll, (0, b''))
+    for row in outer:
+        inner = c.cursor().execute(poll, (0, b'')).fetchall()
+        assert (len(inner) == 3)
+    # same query, self-joined
+    assert (c.execute(
+        "SELECT count(*) FROM crsql_changes a JOIN crsql_changes b ON a.pk = b.pk WHERE a.db_version > 0 AND b.db_version > 0").fetchone()[0] == 3)
+    close(c)
+
+
+def test_schema_change_invalidates():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (id PRIMARY KEY NOT NULL, x)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("INSERT INTO foo VALUES (1, 1)")
+    c.commit()
+    assert (c.execute(poll, (0, b'')).fetchall() == [('foo', b'\x01\t\x01', 'x', 1)])
+
+    c.execute("CREATE TABLE bar (id PRIMARY KEY NOT NULL, y)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.execute("INSERT INTO bar VALUES (1, 2)")
+    c.commit()
+    assert (sorted(c.execute(poll, (0, b'')).fetchall()) == [
+            ('bar', b'\x01\t\x01', 'y', 2), ('foo', b'\x01\t\x01', 'x', 1)])
+
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN z DEFAULT 3")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.execute("UPDATE foo SET z = 4")
+    c.commit()
+    assert (('foo', b'\x01\t\x01', 'z', 4) in c.execute(poll, (0, b'')).fetchall())
+    close(c)
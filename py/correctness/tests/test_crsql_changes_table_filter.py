@@ -0,0 +1,75 @@
+from crsql_correctness import connect, close
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def setup_db():
+    c = connect(":memory:")
+    for tbl in ["foo", "bar", "baz"]:
+        c.execute(
+            "CREATE TABLE {} (id PRIMARY KEY NOT NULL, x INTEGER, y TEXT)".format(tbl))
+        c.execute("SELECT crsql_as_crr('{}')".format(tbl))
+    c.commit()
+
+    for i in range(3):
+        for tbl in ["foo", "bar", "baz"]:
+            c.execute(
+                "INSERT INTO {} VALUES (?, ?, ?)".format(tbl), (i, i * 10, tbl))
+        c.commit()
+
+    c.execute("UPDATE bar SET x = 100 WHERE id = 1")
+    c.execute("DELETE FROM baz WHERE id = 2")
+    c.commit()
+
+    return (c, c.execute(changes_query + " ORDER BY db_version, seq ASC").fetchall())
+
+
+def test_table_eq():
+    (c, all_changes) = setup_db()
+    for tbl in ["foo", "bar", "baz"]:
+        changes = c.execute(
+            changes_query + " WHERE [table] = ? ORDER BY db_version, seq ASC", (tbl,)).fetchall()
+        assert (len(changes) > 0)
+        assert (changes == [row for row in all_changes if row[0] == tbl])
+    close(c)
+
+
+def test_table_in():
+    (c, all_changes) = setup_db()
+    changes = c.execute(
+        changes_query + " WHERE [table] IN ('foo', 'baz') ORDER BY db_version, seq ASC").fetchall()
+    assert (changes == [row for row in all_changes if row[0] in ['foo', 'baz']])
+
+    # duplicates in the in-list must not duplicate rows
+    changes = c.execute(
+        changes_query + " WHERE [table] IN ('bar', 'bar', 'nope') ORDER BY db_version, seq ASC").fetchall()
+    assert (changes == [row for row in all_changes if row[0] == 'bar'])
+    close(c)
+
+
+def test_table_and_version():
+    (c, all_changes) = setup_db()
+    changes = c.execute(
+        changes_query + " WHERE [table] IN ('bar', 'baz') AND db_version > ? AND site_id IS NOT ? ORDER BY db_version, seq ASC", (2, b'')).fetchall()
+    assert (changes == [row for row in all_changes if row[0]
+            in ['bar', 'baz'] and row[5] > 2])
+    close(c)
+
+
+def test_table_no_match():
+    (c, _) = setup_db()
+    assert (c.execute(changes_query +
+            " WHERE [table] = 'nope'").fetchall() == [])
+    assert (c.execute(changes_query +
+            " WHERE [table] = NULL").fetchall() == [])
+    assert (c.execute(changes_query +
+            " WHERE [table] IN (SELECT 'nope')").fetchall() == [])
+    close(c)
+
+
+def test_table_in_subquery():
+    (c, all_changes) = setup_db()
+    changes = c.execute(
+        changes_query + " WHERE [table] IN (SELECT 'foo' UNION SELECT 'bar') ORDER BY db_version, seq ASC").fetchall()
+    assert (changes == [row for row in all_changes if row[0] in ['foo', 'bar']])
+    close(c)
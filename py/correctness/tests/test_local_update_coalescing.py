@@ -0,0 +1,78 @@
+from crsql_correctness import connect, close
+import time
+
+# A column written several times in one transaction has its clock written once.
+# Later writes in the same transaction leave the clock of the first one alone.
+
+clock_query = "SELECT pk, cid, val, col_version, db_version, seq FROM crsql_changes WHERE cid = 'b'"
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b INTEGER, c INTEGER)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("INSERT INTO foo VALUES (1, 0, 0)")
+    c.commit()
+    return c
+
+
+def test_repeated_updates_bump_once():
+    c = make_db()
+    for i in range(50):
+        c.execute("UPDATE foo SET b = ? WHERE a = 1", (i + 1,))
+    c.commit()
+    assert (c.execute(clock_query).fetchall() == [(b'\x01\t\x01', 'b', 50, 2, 2, 0)])
+
+    c.execute("UPDATE foo SET b = 100 WHERE a = 1")
+    c.commit()
+    assert (c.execute(clock_query).fetchall() == [(b'\x01\t\x01', 'b', 100, 3, 3, 0)])
+    close(c)
+
+
+def test_first_write_keeps_its_seq():
+    c = make_db()
+    c.execute("UPDATE foo SET b = 1 WHERE a = 1")
+    c.execute("UPDATE foo SET c = 1 WHERE a = 1")
+    c.execute("UPDATE foo SET b = 2 WHERE a = 1")
+    c.commit()
+    assert (c.execute("SELECT cid, val, col_version, seq FROM crsql_changes WHERE db_version = 2 ORDER BY seq").fetchall() ==
+            [('b', 2, 2, 0), ('c', 1, 2, 1)])
+    close(c)
+
+
+def test_savepoint_rollback():
+    c = make_db()
+    c.execute("SAVEPOINT one")
+    c.execute("UPDATE foo SET b = 1 WHERE a = 1")
+    c.execute("ROLLBACK TO one")
+    c.execute("UPDATE foo SET b = 2 WHERE a = 1")
+    c.execute("RELEASE one")
+    c.commit()
+    assert (c.execute(clock_query).fetchall() == [(b'\x01\t\x01', 'b', 2, 2, 2, 0)])
+    close(c)
+
+
+def test_write_after_merge_in_same_transaction():
+    c = make_db()
+    c.execute("INSERT INTO crsql_changes VALUES ('foo', x'010901', 'b', 5, 7, 1, x'0102', 1, 0)")
+    c.execute("UPDATE foo SET b = 6 WHERE a = 1")
+    c.commit()
+    assert (c.execute("SELECT val, col_version, site_id FROM crsql_changes WHERE cid = 'b'").fetchall() ==
+            [(6, 8, c.execute("SELECT crsql_site_id()").fetchone()[0])])
+    close(c)
+
+
+def test_bulk_update_throughput():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE item (id INTEGER PRIMARY KEY NOT NULL, qty INTEGER, price INTEGER)")
+    c.execute("SELECT crsql_as_crr('item')")
+    for i in range(1_000):
+        c.execute("INSERT INTO item VALUES (?, 0, 0)", (i,))
+    c.commit()
+    start_time = time.time()
+    for n in range(20):
+        c.execute("UPDATE item SET qty = ?, price = ?", (n, n))
+    c.commit()
+    print(f"repeated updates: {20_000 / (time.time() - start_time)} rows/s")
+    assert (c.execute("SELECT DISTINCT col_version FROM crsql_changes WHERE cid != '-1'").fetchall() == [(2,)])
+    close(c)
@@ -248,3 +248,22 @@ def test_merge_update_existing_row():
     assert (rows == [(1, 1)])
     rows = b.execute("SELECT * FROM bar__crsql_pks").fetchall()
     assert (rows == [(1, 1, 2), (2, 1, 3)])
+
+
+def test_merge_noop_for_unseen_row():
+    a = simple_schema()
+    b = simple_schema()
+
+    a.execute("INSERT INTO foo VALUES (1, 2)")
+    a.commit()
+    # changes at a causal length of 0 can't change a row we've never seen
+    changes = a.execute(
+        "SELECT [table], pk, cid, val, col_version, db_version, site_id, 0, seq FROM crsql_changes").fetchall()
+    for change in changes:
+        b.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    b.commit()
+    rows = b.execute("SELECT * FROM foo__crsql_pks").fetchall()
+    assert (rows == [])
+    rows = b.execute("SELECT * FROM foo").fetchall()
+    assert (rows == [])
@@ -0,0 +1,130 @@
+from crsql_correctness import connect, close
+
+# `crsql_apply_changes` merges the column changes of a row together and writes
+# the row once. It must end up where merging each change on its own does.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+packed_change = "SELECT crsql_pack_columns(?, ?, ?, ?, ?, ?, ?, ?, ?)"
+columns = ["c{}".format(i) for i in range(8)]
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE wide (id INTEGER PRIMARY KEY NOT NULL, {})".format(
+        ", ".join(columns)))
+    c.execute("SELECT crsql_as_crr('wide')")
+    c.commit()
+    return c
+
+
+def write_rows(c, value):
+    for i in range(10):
+        c.execute("INSERT INTO wide VALUES (?, {})".format(", ".join(["?"] * len(columns))),
+                  [i] + ["{}-{}-{}".format(value, i, x) for x in columns])
+    c.commit()
+    c.execute("UPDATE wide SET c1 = ?, c5 = ? WHERE id < 5", (value, value))
+    c.execute("DELETE FROM wide WHERE id = 7")
+    c.commit()
+    c.execute("INSERT INTO wide (id, c2) VALUES (7, ?)", (value,))
+    c.commit()
+
+
+def merge_each(c, changes):
+    for change in changes:
+        c.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    c.commit()
+
+
+def merge_batch(c, changes):
+    batch = b"".join([c.execute(packed_change, change).fetchone()[0]
+                     for change in changes])
+    rows_impacted = c.execute(
+        "SELECT crsql_apply_changes(?)", (batch,)).fetchone()[0]
+    c.commit()
+    return rows_impacted
+
+
+def assert_same(l, r):
+    assert (l.execute("SELECT * FROM wide ORDER BY id").fetchall() ==
+            r.execute("SELECT * FROM wide ORDER BY id").fetchall())
+    assert (l.execute(changes_query + " ORDER BY pk, cid").fetchall() ==
+            r.execute(changes_query + " ORDER BY pk, cid").fetchall())
+
+
+def test_rows_merge_like_single_changes():
+    a = make_db()
+    b = make_db()
+    write_rows(a, 1)
+    write_rows(b, 2)
+    a_changes = a.execute(changes_query + " ORDER BY pk, db_version, seq").fetchall()
+    b_changes = b.execute(changes_query + " ORDER BY pk, db_version, seq").fetchall()
+
+    # into an empty db, onto a db with its own concurrent writes, and again with
+    # nothing left to win
+    for changes, setup in [(a_changes, None), (a_changes, 2), (b_changes, 1)]:
+        each = make_db()
+        batched = make_db()
+        if setup is not None:
+            write_rows(each, setup)
+            write_rows(batched, setup)
+        merge_each(each, changes)
+        merge_batch(batched, changes)
+        assert_same(each, batched)
+        assert (merge_batch(batched, changes) == 0)
+        assert_same(each, batched)
+        close(each)
+        close(batched)
+    close(a)
+    close(b)
+
+
+def test_same_column_twice_in_a_row():
+    a = make_db()
+    write_rows(a, 1)
+    changes = a.execute(changes_query + " WHERE pk = crsql_pack_columns(1)").fetchall()
+    # an older change to c1 on either side of the newer one
+    stale = [list(x) for x in changes if x[2] == "c1"][0]
+    stale[3] = "stale"
+    stale[4] = stale[4] - 1
+    changes = [tuple(stale)] + changes + [tuple(stale)]
+
+    each = make_db()
+    batched = make_db()
+    merge_each(each, changes)
+    merge_batch(batched, changes)
+    assert_same(each, batched)
+    assert (batched.execute("SELECT c1 FROM wide WHERE id = 1").fetchone() == (1,))
+    close(a)
+    close(each)
+    close(batched)
+
+
+def test_bootstrap_empty_replica():
+    a = make_db()
+    write_rows(a, 1)
+    a.execute("DELETE FROM wide WHERE id = 3")
+    a.commit()
+    a.execute("INSERT INTO wide (id, c0, c4) VALUES (3, 'back', 'again')")
+    a.commit()
+    history = a.execute(changes_query + " ORDER BY db_version, seq").fetchall()
+    # rows that are resurrected with no sentinel in sight
+    columns_only = [x for x in history if x[2] != "-1"]
+
+    for changes in [history, columns_only]:
+        each = make_db()
+        batched = make_db()
+        merge_each(each, changes)
+        batch = b"".join([batched.execute(packed_change, change).fetchone()[0]
+                         for change in changes])
+        batched.execute("SELECT crsql_apply_changes(?, 1000)", (batch,))
+        batched.commit()
+        assert (batched.execute("SELECT * FROM wide ORDER BY id").fetchall() ==
+                each.execute("SELECT * FROM wide ORDER BY id").fetchall())
+        # the versions merged changes get depend on the order they're merged in
+        clocks_query = "SELECT pk, cid, val, col_version, site_id, cl FROM crsql_changes ORDER BY pk, cid"
+        assert (batched.execute(clocks_query).fetchall() ==
+                each.execute(clocks_query).fetchall())
+        close(each)
+        close(batched)
+    close(a)
@@ -0,0 +1,118 @@
+from crsql_correctness import connect, close
+import time
+
+# `crsql_merge_stats` counts, per table, how the changes merged by this
+# connection turned out, and times them to the millisecond.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+stats_query = "SELECT [table], applied, lost_on_version, lost_on_value, site_id_tie_breaks, resurrects, deletes, sentinel_only, stale FROM crsql_merge_stats"
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def merge(c, changes):
+    for change in changes:
+        c.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    c.commit()
+
+
+def stats(c):
+    return dict([(row[0], row[1:]) for row in c.execute(stats_query).fetchall()])
+
+
+def test_counts_outcomes_per_table():
+    a = make_db()
+    b = make_db()
+    assert (stats(b) == {})
+
+    a.execute("INSERT INTO foo VALUES (1, 1)")
+    a.execute("INSERT INTO bar VALUES (1, 1)")
+    a.commit()
+    first = a.execute(changes_query).fetchall()
+    merge(b, first)
+    assert (stats(b) == {"foo": (1, 0, 0, 0, 0, 0, 0, 0),
+            "bar": (1, 0, 0, 0, 0, 0, 0, 0)})
+
+    # the same changes again tie on version and lose comparing values
+    merge(b, first)
+    assert (stats(b)["foo"] == (1, 0, 1, 0, 0, 0, 0, 0))
+
+    a.execute("UPDATE foo SET b = 2")
+    a.execute("DELETE FROM bar")
+    a.commit()
+    merge(b, a.execute(changes_query + " WHERE db_version > 1").fetchall())
+    assert (stats(b)["foo"] == (2, 0, 1, 0, 0, 0, 0, 0))
+    assert (stats(b)["bar"] == (1, 0, 0, 0, 0, 1, 0, 0))
+
+    # a column change from before the delete is stale
+    merge(b, [x for x in first if x[0] == "bar"])
+    assert (stats(b)["bar"] == (1, 0, 0, 0, 0, 1, 0, 1))
+
+    # an older col_version loses on version
+    older = [list(x) for x in first if x[0] == "foo"][0]
+    merge(b, [tuple(older)])
+    assert (stats(b)["foo"] == (2, 1, 1, 0, 0, 0, 0, 0))
+
+    b.execute("SELECT crsql_config_set('merge-equal-values', 1)")
+    b.commit()
+    current = b.execute(changes_query + " WHERE [table] = 'foo'").fetchall()
+    merge(b, current)
+    assert (stats(b)["foo"] == (2, 1, 1, 1, 0, 0, 0, 0))
+
+    a.execute("INSERT INTO bar VALUES (1, 3)")
+    a.commit()
+    merge(b, a.execute(changes_query + " WHERE [table] = 'bar' AND cl = 3").fetchall())
+    bar = stats(b)["bar"]
+    # the row comes back through the sentinel or through its column, whichever is first
+    assert (bar[0] == 2 and bar[6] + bar[4] >= 1)
+    close(a)
+    close(b)
+
+
+def test_counts_only_committed_merges():
+    a = make_db()
+    b = make_db()
+    a.execute("INSERT INTO foo VALUES (1, 1)")
+    a.commit()
+    changes = a.execute(changes_query).fetchall()
+
+    for change in changes:
+        b.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    # not counted until the merge commits
+    assert (stats(b) == {})
+    b.rollback()
+    assert (stats(b) == {})
+
+    merge(b, changes)
+    assert (stats(b) == {"foo": (1, 0, 0, 0, 0, 0, 0, 0)})
+    close(a)
+    close(b)
+
+
+def test_times_committed_merges():
+    a = make_db()
+    b = make_db()
+    a.execute("INSERT INTO foo VALUES (1, 1)")
+    a.commit()
+    changes = a.execute(changes_query).fetchall()
+
+    for change in changes:
+        b.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    time.sleep(0.05)
+    b.commit()
+    (merge_ms,) = b.execute("SELECT merge_ms FROM crsql_merge_stats WHERE [table] = 'foo'").fetchone()
+    # from the first merge into foo to the commit
+    assert (merge_ms >= 40)
+    close(a)
+    close(b)
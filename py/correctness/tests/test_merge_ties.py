@@ -0,0 +1,126 @@
+from crsql_correctness import connect, close, get_site_id
+import pytest
+
+# A change at our col_version is decided by one lookup of the clock entry, the
+# row and the site that wrote it. When that lookup comes up empty, because the
+# clock entry or the row is missing, the column is read piece by piece instead.
+# Both must decide the same way and fail with the same errors.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+stats_query = "SELECT applied, lost_on_value, site_id_tie_breaks FROM crsql_merge_stats WHERE [table] = 'foo'"
+
+
+def make_db(merge_equal_values=False):
+    c = connect(":memory:")
+    if merge_equal_values:
+        c.execute("SELECT crsql_config_set('merge-equal-values', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def write(c, a, b):
+    c.execute("INSERT INTO foo VALUES (?, ?)", (a, b))
+    c.commit()
+
+
+def column_change(c, a):
+    return c.execute(changes_query + " WHERE pk = crsql_pack_columns(?) AND cid = 'b'", (a,)).fetchone()
+
+
+def merge(c, change):
+    c.execute("INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    c.commit()
+
+
+def column_state(c, a):
+    return c.execute("SELECT val, col_version, site_id FROM crsql_changes WHERE pk = crsql_pack_columns(?) AND cid = 'b'", (a,)).fetchone()
+
+
+def stats(c):
+    return c.execute(stats_query).fetchone()
+
+
+def test_equal_values_tie_break_on_site_id():
+    for merge_equal_values in [False, True]:
+        source = make_db()
+        target = make_db(merge_equal_values)
+        write(source, 1, 'same')
+        write(target, 1, 'same')
+        merge(target, column_change(source, 1))
+
+        if merge_equal_values:
+            winner = max(get_site_id(source), get_site_id(target))
+            assert (column_state(target, 1) == ('same', 1, winner))
+            assert (stats(target) == (1 if winner == get_site_id(source) else 0, 0, 1))
+        else:
+            assert (column_state(target, 1) == ('same', 1, get_site_id(target)))
+            assert (stats(target) == (0, 1, 0))
+        close(source)
+        close(target)
+
+
+def test_different_values_ignore_site_id():
+    for (ours, theirs) in [(1, 2), (2, 1)]:
+        source = make_db()
+        target = make_db(True)
+        write(source, 1, theirs)
+        write(target, 1, ours)
+        merge(target, column_change(source, 1))
+
+        if theirs > ours:
+            assert (column_state(target, 1) == (theirs, 1, get_site_id(source)))
+            assert (stats(target) == (1, 0, 0))
+        else:
+            assert (column_state(target, 1) == (ours, 1, get_site_id(target)))
+            assert (stats(target) == (0, 1, 0))
+        close(source)
+        close(target)
+
+
+def test_missing_clock_entry_takes_the_change():
+    source = make_db()
+    target = make_db(True)
+    write(source, 1, 'theirs')
+    write(target, 1, 'ours')
+    target.execute("DELETE FROM foo__crsql_clock WHERE col_name = 'b'")
+    target.commit()
+    merge(target, column_change(source, 1))
+    assert (column_state(target, 1) == ('theirs', 1, get_site_id(source)))
+    close(source)
+    close(target)
+
+
+def test_missing_row_fails():
+    source = make_db()
+    target = make_db(True)
+    write(source, 1, 'same')
+    write(target, 1, 'same')
+    target.execute("SELECT crsql_internal_sync_bit(1)")
+    target.execute("DELETE FROM foo")
+    target.execute("SELECT crsql_internal_sync_bit(0)")
+    target.commit()
+    with pytest.raises(Exception, match="could not find row to merge with"):
+        merge(target, column_change(source, 1))
+    close(source)
+    close(target)
+
+
+def test_missing_site_row_fails():
+    first = make_db()
+    second = make_db()
+    target = make_db(True)
+    write(first, 1, 'same')
+    write(second, 2, 'other')
+    write(second, 1, 'same')
+    merge(target, column_change(first, 1))
+    # give the second site its ordinal before the first's row goes
+    merge(target, column_change(second, 2))
+    target.execute("DELETE FROM crsql_site_id WHERE site_id = ?", (get_site_id(first),))
+    target.commit()
+    with pytest.raises(Exception, match="could not find site_id for previous change"):
+        merge(target, column_change(second, 1))
+    close(first)
+    close(second)
+    close(target)
@@ -0,0 +1,92 @@
+from crsql_correctness import connect, close
+import os
+import tempfile
+
+# Merges and backfills compute db versions and seqs in the extension rather than
+# calling back into it from sql. They must hand out the same values as before.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def make_db(path=":memory:"):
+    c = connect(path)
+    c.execute("CREATE TABLE IF NOT EXISTS foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def merge(c, changes):
+    for change in changes:
+        c.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+
+
+def test_merge_does_not_record_local_writes():
+    a = make_db()
+    b = make_db()
+    a.execute("INSERT INTO foo VALUES (1, 2, 3)")
+    a.commit()
+    merge(b, a.execute(changes_query).fetchall())
+    b.commit()
+    # only the merged changes, nothing written by the triggers on top of them
+    assert (b.execute(changes_query).fetchall() == a.execute(changes_query).fetchall())
+    b.execute("INSERT INTO foo VALUES (2, 2, 3)")
+    b.commit()
+    assert (b.execute("SELECT count(*) FROM crsql_changes WHERE pk = crsql_pack_columns(2)").fetchone() ==
+            (2,))
+    close(a)
+    close(b)
+
+
+def test_merge_sees_versions_committed_by_other_connections():
+    remote = make_db()
+    for i in range(3):
+        remote.execute("INSERT INTO foo VALUES (?, ?, ?)", (i, i, i))
+        remote.commit()
+    changes = remote.execute(changes_query).fetchall()
+
+    path = os.path.join(tempfile.mkdtemp(), "merge_versions.db")
+    a = make_db(path)
+    other = make_db(path)
+
+    merge(a, changes[:2])
+    a.commit()
+    first = a.execute("SELECT crsql_db_version()").fetchone()[0]
+
+    for i in range(10, 20):
+        other.execute("INSERT INTO foo VALUES (?, ?, ?)", (i, i, i))
+        other.commit()
+    latest = other.execute("SELECT crsql_db_version()").fetchone()[0]
+    assert (latest > first)
+
+    merge(a, changes[2:])
+    a.commit()
+    versions = [row[0] for row in a.execute(
+        "SELECT db_version FROM crsql_changes WHERE pk IN (crsql_pack_columns(1), crsql_pack_columns(2))").fetchall()]
+    assert (all(v > latest for v in versions))
+    close(a)
+    close(other)
+    close(remote)
+
+
+def test_backfill_reserves_seqs():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b, c)")
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL)")
+    c.execute("INSERT INTO foo VALUES (1, 2, 3), (2, 3, 4)")
+    c.execute("INSERT INTO bar VALUES (1)")
+    c.commit()
+
+    # all in one transaction so every change shares a db version
+    c.execute("BEGIN")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.execute("INSERT INTO foo VALUES (3, 4, 5)")
+    c.commit()
+
+    rows = c.execute("SELECT db_version, seq FROM crsql_changes").fetchall()
+    assert (len(rows) == 7)
+    assert (len(set(rows)) == len(rows))
+    assert (sorted([row[1] for row in rows]) == list(range(7)))
+    close(c)
@@ -0,0 +1,102 @@
+from crsql_correctness import connect, close
+
+# With the `packed-pks` config set, lookaside tables store the packed primary key
+# of each row so reads and merges do not have to re-pack or compare column by column.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def make_db(packed):
+    c = connect(":memory:")
+    if packed:
+        c.execute("SELECT crsql_config_set('packed-pks', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT)")
+    c.execute("CREATE TABLE bar (a NOT NULL, b NOT NULL, c, PRIMARY KEY(a, b))")
+    # rows that exist before the table becomes a crr go through backfill
+    c.execute("INSERT INTO bar VALUES (-5, 'pre', 1)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    return c
+
+
+def write_rows(c):
+    c.execute("INSERT INTO foo VALUES (1, 'one'), (2, 'two'), (300000, 'big')")
+    c.execute("INSERT INTO bar VALUES (1, 'x', 1), (2.5, x'0102', 2), ('s', 3, 3)")
+    c.commit()
+    c.execute("UPDATE foo SET b = 'uno' WHERE a = 1")
+    c.execute("DELETE FROM bar WHERE a = 2.5")
+    c.execute("UPDATE bar SET a = 10 WHERE a = 1")
+    c.commit()
+
+
+def test_config():
+    c = connect(":memory:")
+    assert (c.execute("SELECT crsql_config_get('packed-pks')").fetchone() == (0,))
+    assert (c.execute(
+        "SELECT crsql_config_set('packed-pks', 1)").fetchone() == (1,))
+    assert (c.execute("SELECT crsql_config_get('packed-pks')").fetchone() == (1,))
+    close(c)
+
+
+def test_packed_column_only_when_configured():
+    for packed in [True, False]:
+        c = make_db(packed)
+        cols = [row[0] for row in c.execute(
+            "SELECT name FROM pragma_table_info('foo__crsql_pks')").fetchall()]
+        assert (("__crsql_packed" in cols) == packed)
+        close(c)
+
+
+def test_packed_matches_pack_columns():
+    c = make_db(True)
+    write_rows(c)
+    assert (c.execute(
+        "SELECT count(*) FROM foo__crsql_pks WHERE __crsql_packed IS NOT crsql_pack_columns(a)").fetchone() == (0,))
+    assert (c.execute(
+        "SELECT count(*) FROM bar__crsql_pks WHERE __crsql_packed IS NOT crsql_pack_columns(a, b)").fetchone() == (0,))
+    assert (c.execute("SELECT count(*) FROM bar__crsql_pks").fetchone()[0] == 5)
+    close(c)
+
+
+def test_changes_same_with_and_without_packed():
+    packed = make_db(True)
+    unpacked = make_db(False)
+    write_rows(packed)
+    write_rows(unpacked)
+
+    def strip_site(rows):
+        return [row[:6] + row[7:] for row in rows]
+
+    assert (strip_site(packed.execute(changes_query).fetchall()) ==
+            strip_site(unpacked.execute(changes_query).fetchall()))
+    close(packed)
+    close(unpacked)
+
+
+def test_merge_finds_keys_by_packed():
+    source = make_db(False)
+    target = make_db(True)
+    write_rows(source)
+
+    for change in source.execute(changes_query).fetchall():
+        target.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    target.commit()
+    keys = target.execute(
+        "SELECT __crsql_key, __crsql_packed FROM bar__crsql_pks ORDER BY __crsql_key").fetchall()
+
+    # merging again must map every change onto the keys created the first time
+    for change in source.execute(changes_query).fetchall():
+        target.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    target.commit()
+    assert (target.execute(
+        "SELECT __crsql_key, __crsql_packed FROM bar__crsql_pks ORDER BY __crsql_key").fetchall() == keys)
+
+    assert (source.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+            target.execute("SELECT * FROM foo ORDER BY a").fetchall())
+    assert (source.execute("SELECT * FROM bar ORDER BY a, b").fetchall() ==
+            target.execute("SELECT * FROM bar ORDER BY a, b").fetchall())
+    close(source)
+    close(target)
@@ -0,0 +1,110 @@
+from crsql_correctness import connect, close
+
+# With the `pks-cl` config set, lookaside tables keep the causal length of each
+# row next to its key. It must always match the version of the row's sentinel
+# clock, or 1 for rows that never had one.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+sentinel_cl = """SELECT count(*) FROM foo__crsql_pks AS p WHERE __crsql_cl IS NOT COALESCE(
+    (SELECT col_version FROM foo__crsql_clock AS c WHERE c.key = p.__crsql_key AND c.col_name = '-1'), 1)"""
+
+
+def make_db(with_cl):
+    c = connect(":memory:")
+    if with_cl:
+        c.execute("SELECT crsql_config_set('pks-cl', 1)")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT)")
+    # rows that exist before the table becomes a crr go through backfill
+    c.execute("INSERT INTO foo VALUES (-1, 'pre')")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def write_rows(c):
+    c.execute("INSERT INTO foo VALUES (1, 'one'), (2, 'two'), (3, 'three'), (4, 'four')")
+    c.commit()
+    c.execute("DELETE FROM foo WHERE a = 2")
+    c.execute("DELETE FROM foo WHERE a = 3")
+    c.execute("UPDATE foo SET a = 10 WHERE a = 4")
+    c.commit()
+    c.execute("INSERT INTO foo VALUES (3, 'back')")
+    c.commit()
+
+
+def merge(c, changes):
+    for change in changes:
+        c.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    c.commit()
+
+
+def test_config():
+    c = connect(":memory:")
+    assert (c.execute("SELECT crsql_config_get('pks-cl')").fetchone() == (0,))
+    assert (c.execute("SELECT crsql_config_set('pks-cl', 1)").fetchone() == (1,))
+    assert (c.execute("SELECT crsql_config_get('pks-cl')").fetchone() == (1,))
+    close(c)
+
+
+def test_cl_column_only_when_configured():
+    for with_cl in [True, False]:
+        c = make_db(with_cl)
+        cols = [row[0] for row in c.execute(
+            "SELECT name FROM pragma_table_info('foo__crsql_pks')").fetchall()]
+        assert (("__crsql_cl" in cols) == with_cl)
+        close(c)
+
+
+def test_local_writes_keep_cl():
+    c = make_db(True)
+    write_rows(c)
+    assert (c.execute(sentinel_cl).fetchone() == (0,))
+    assert (c.execute(
+        "SELECT a, __crsql_cl FROM foo__crsql_pks ORDER BY a").fetchall() ==
+        [(-1, 1), (1, 1), (2, 2), (3, 3), (4, 2), (10, 1)])
+    close(c)
+
+
+def test_changes_same_with_and_without_cl():
+    with_cl = make_db(True)
+    without_cl = make_db(False)
+    write_rows(with_cl)
+    write_rows(without_cl)
+
+    def strip_site(rows):
+        return [row[:6] + row[7:] for row in rows]
+
+    assert (strip_site(with_cl.execute(changes_query).fetchall()) ==
+            strip_site(without_cl.execute(changes_query).fetchall()))
+    close(with_cl)
+    close(without_cl)
+
+
+def test_merges_keep_cl():
+    source = make_db(False)
+    write_rows(source)
+    changes = source.execute(changes_query).fetchall()
+
+    for setup in [False, True]:
+        target = make_db(True)
+        if setup:
+            write_rows(target)
+            target.execute("DELETE FROM foo WHERE a = 1")
+            target.commit()
+        merge(target, changes)
+        assert (target.execute(sentinel_cl).fetchone() == (0,))
+
+        expected = make_db(False)
+        if setup:
+            write_rows(expected)
+            expected.execute("DELETE FROM foo WHERE a = 1")
+            expected.commit()
+        merge(expected, changes)
+        assert (target.execute("SELECT * FROM foo ORDER BY a").fetchall() ==
+                expected.execute("SELECT * FROM foo ORDER BY a").fetchall())
+        assert (target.execute("SELECT pk, cid, col_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall() ==
+                expected.execute("SELECT pk, cid, col_version, cl FROM crsql_changes ORDER BY pk, cid").fetchall())
+        close(target)
+        close(expected)
+    close(source)
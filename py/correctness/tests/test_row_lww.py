@@ -0,0 +1,147 @@
+from crsql_correctness import connect, close
+import pytest
+import time
+
+# `crsql_as_crr(schema, table, 'row')` merges whole rows, last writer wins.
+# Such tables keep one clock row per row, under the `__crsql_row` pseudo column,
+# whose value in `crsql_changes` is every non primary key column, packed.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+columns = ["c{}".format(i) for i in range(20)]
+
+
+def make_db(granularity="row"):
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT, c INTEGER DEFAULT 0)")
+    c.execute("SELECT crsql_as_crr('main', 'foo', ?)", (granularity,))
+    c.commit()
+    return c
+
+
+def sync(source, target, since=0):
+    for change in source.execute(changes_query + " WHERE db_version > ?", (since,)).fetchall():
+        target.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    target.commit()
+
+
+def rows(c):
+    return c.execute("SELECT * FROM foo ORDER BY a").fetchall()
+
+
+def test_bad_granularity():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b TEXT)")
+    with pytest.raises(Exception):
+        c.execute("SELECT crsql_as_crr('main', 'foo', 'cell')")
+    close(c)
+
+
+def test_one_clock_per_row():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 'one', 1), (2, 'two', 2)")
+    c.commit()
+    c.execute("UPDATE foo SET b = 'uno' WHERE a = 1")
+    c.execute("UPDATE foo SET c = 11 WHERE a = 1")
+    c.commit()
+    assert (c.execute("SELECT key, col_name, col_version FROM foo__crsql_clock ORDER BY key").fetchall() ==
+            [(1, '__crsql_row', 2), (2, '__crsql_row', 1)])
+    assert (c.execute("SELECT pk, cid, val FROM crsql_changes ORDER BY pk").fetchall() == [
+        (b'\x01\t\x01', '__crsql_row', c.execute("SELECT crsql_pack_columns('uno', 11)").fetchone()[0]),
+        (b'\x01\t\x02', '__crsql_row', c.execute("SELECT crsql_pack_columns('two', 2)").fetchone()[0])])
+
+    c.execute("DELETE FROM foo WHERE a = 2")
+    c.commit()
+    assert (c.execute("SELECT cid, cl FROM crsql_changes WHERE pk = x'010902'").fetchall() == [('-1', 2)])
+    close(c)
+
+
+def test_granularity_survives_alter():
+    c = make_db()
+    c.execute("INSERT INTO foo VALUES (1, 'one', 1)")
+    c.commit()
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN d TEXT")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.execute("UPDATE foo SET d = 'd' WHERE a = 1")
+    c.commit()
+    assert (c.execute("SELECT cid, val FROM crsql_changes").fetchall() ==
+            [('__crsql_row', c.execute("SELECT crsql_pack_columns('one', 1, 'd')").fetchone()[0])])
+    close(c)
+
+
+def test_modes_recorded_per_table():
+    c = make_db()
+    c.execute("CREATE TABLE bar (a INTEGER PRIMARY KEY NOT NULL, b TEXT)")
+    c.execute("SELECT crsql_as_crr('bar')")
+    c.commit()
+    assert (c.execute("SELECT key, value FROM crsql_master WHERE key LIKE 'modes.%' ORDER BY key").fetchall() ==
+            [('modes.bar', ''), ('modes.foo', 'row')])
+
+    c.execute("SELECT crsql_as_table('foo')")
+    c.commit()
+    assert (c.execute("SELECT key FROM crsql_master WHERE key LIKE 'modes.%'").fetchall() ==
+            [('modes.bar',)])
+    close(c)
+
+
+def test_peers_converge():
+    a = make_db()
+    b = make_db()
+    a.execute("INSERT INTO foo VALUES (1, 'one', 1), (2, 'two', 2), (3, 'three', 3)")
+    a.commit()
+    sync(a, b)
+    assert (rows(a) == rows(b))
+
+    # concurrent writes to different columns of a row: one write takes the whole row
+    a.execute("UPDATE foo SET b = 'a' WHERE a = 1")
+    a.commit()
+    b.execute("UPDATE foo SET c = 100 WHERE a = 1")
+    b.commit()
+    b.execute("DELETE FROM foo WHERE a = 2")
+    b.execute("INSERT INTO foo VALUES (4, 'four', 4)")
+    b.commit()
+    sync(a, b)
+    sync(b, a)
+    assert (rows(a) == rows(b))
+    assert (rows(a)[0] in [(1, 'a', 1), (1, 'one', 100)])
+    assert ((2, 'two', 2) not in rows(a))
+
+    # resurrect
+    a.execute("INSERT INTO foo VALUES (2, 'again', 22)")
+    a.commit()
+    sync(a, b)
+    assert (rows(a) == rows(b))
+    assert ((2, 'again', 22) in rows(b))
+    close(a)
+    close(b)
+
+
+def test_column_changes_rejected():
+    row = make_db("row")
+    column = make_db("column")
+    column.execute("INSERT INTO foo VALUES (1, 'one', 1)")
+    column.commit()
+    with pytest.raises(Exception):
+        sync(column, row)
+    close(row)
+    close(column)
+
+
+def test_clock_size_and_insert_throughput():
+    for granularity in ["column", "row"]:
+        c = connect(":memory:")
+        c.execute("CREATE TABLE wide (id INTEGER PRIMARY KEY NOT NULL, {})".format(
+            ", ".join(columns)))
+        c.execute("SELECT crsql_as_crr('main', 'wide', ?)", (granularity,))
+        c.commit()
+        start_time = time.time()
+        for i in range(2_000):
+            c.execute("INSERT INTO wide VALUES (?, {})".format(", ".join(["?"] * len(columns))),
+                      [i] + ["{}-{}".format(i, x) for x in columns])
+        c.commit()
+        print(f"{granularity} clocks: {2_000 / (time.time() - start_time)} inserts/s")
+        clock_rows = c.execute("SELECT count(*) FROM wide__crsql_clock").fetchone()[0]
+        print(f"{granularity} clocks: {clock_rows} clock rows")
+        assert (clock_rows == (2_000 if granularity == "row" else 2_000 * len(columns)))
+        close(c)
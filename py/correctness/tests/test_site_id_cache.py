@@ -0,0 +1,119 @@
+from crsql_correctness import connect, close, get_site_id
+
+# Site ids are mapped to and from the ordinals clock tables store through a cache
+# on the connection. Ordinals assigned by a transaction are handed out again if
+# it rolls back so the cache must never outlive them.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def make_db():
+    c = connect(":memory:")
+    c.execute("CREATE TABLE foo (a INTEGER PRIMARY KEY NOT NULL, b)")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def changes_from(a, b_value):
+    a.execute("INSERT INTO foo VALUES (?, ?)", (b_value, b_value))
+    a.commit()
+    return a.execute(changes_query + " WHERE db_version = (SELECT max(db_version) FROM crsql_changes)").fetchall()
+
+
+def merge(c, changes):
+    for change in changes:
+        c.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+
+
+def site_ids_by_row(c):
+    return c.execute(
+        "SELECT pk, cid, site_id FROM crsql_changes ORDER BY pk, cid").fetchall()
+
+
+def test_site_id_filters():
+    a = make_db()
+    b = make_db()
+    c = make_db()
+    merge(c, changes_from(a, 1))
+    merge(c, changes_from(b, 2))
+    c.execute("INSERT INTO foo VALUES (3, 3)")
+    c.commit()
+
+    all_changes = c.execute(changes_query).fetchall()
+    sites = set([row[6] for row in all_changes])
+    assert (sites == set([get_site_id(a), get_site_id(b), get_site_id(c)]))
+
+    unknown = get_site_id(make_db())
+    for site in [get_site_id(a), get_site_id(b), get_site_id(c), unknown, None, "text"]:
+        for op in ["=", "IS", "!=", "IS NOT"]:
+            expected = [row for row in all_changes if
+                        (op == "=" and row[6] == site and site is not None) or
+                        (op == "IS" and row[6] == site) or
+                        (op == "!=" and row[6] != site and site is not None) or
+                        (op == "IS NOT" and row[6] != site)]
+            assert (c.execute(changes_query + " WHERE site_id {} ?".format(op), (site,)).fetchall() ==
+                    expected)
+
+    assert (c.execute(changes_query + " WHERE site_id IS NULL").fetchall() == [])
+    assert (c.execute(changes_query + " WHERE site_id IS NOT NULL").fetchall() == all_changes)
+    assert (c.execute(changes_query + " WHERE site_id > ?", (get_site_id(a),)).fetchall() ==
+            [row for row in all_changes if row[6] > get_site_id(a)])
+    assert ([row[6] for row in c.execute(changes_query + " ORDER BY site_id").fetchall()] ==
+            sorted([row[6] for row in all_changes]))
+    close(a)
+    close(b)
+    close(c)
+
+
+def test_ordinal_reused_after_rollback():
+    a = make_db()
+    b = make_db()
+    c = make_db()
+    a_changes = changes_from(a, 1)
+    b_changes = changes_from(b, 2)
+
+    # a's site is given an ordinal which is given out again to b after the rollback
+    merge(c, a_changes)
+    assert (set([row[2] for row in site_ids_by_row(c)]) == set([get_site_id(a)]))
+    c.rollback()
+    merge(c, b_changes)
+    c.commit()
+    assert (set([row[2] for row in site_ids_by_row(c)]) == set([get_site_id(b)]))
+
+    merge(c, a_changes)
+    c.commit()
+    assert (c.execute("SELECT count(*) FROM crsql_changes WHERE site_id = ?",
+                      (get_site_id(a),)).fetchone() == (len(a_changes),))
+    assert (c.execute("SELECT count(*) FROM crsql_changes WHERE site_id = ?",
+                      (get_site_id(b),)).fetchone() == (len(b_changes),))
+    close(a)
+    close(b)
+    close(c)
+
+
+def test_ordinal_reused_after_savepoint_rollback():
+    a = make_db()
+    b = make_db()
+    a_changes = changes_from(a, 1)
+    b_changes = changes_from(b, 2)
+
+    for use_apply in [False, True]:
+        c = make_db()
+        c.execute("SAVEPOINT s")
+        if use_apply:
+            c.execute("SELECT crsql_apply_changes(?)", (b"".join([
+                c.execute("SELECT crsql_pack_columns(?, ?, ?, ?, ?, ?, ?, ?, ?)", change).fetchone()[0]
+                for change in a_changes]),))
+        else:
+            merge(c, a_changes)
+        assert (set([row[2] for row in site_ids_by_row(c)]) == set([get_site_id(a)]))
+        c.execute("ROLLBACK TO s")
+        merge(c, b_changes)
+        c.execute("RELEASE s")
+        c.commit()
+        assert (set([row[2] for row in site_ids_by_row(c)]) == set([get_site_id(b)]))
+        close(c)
+    close(a)
+    close(b)
@@ -0,0 +1,139 @@
+from crsql_correctness import connect, close
+import time
+
+# With the `sparse-clocks` config set, rows inserted for the first time only get
+# clock rows for columns not left at their literal default. The sentinel records
+# the row so peers insert it and fill in the same defaults.
+
+changes_query = "SELECT [table], pk, cid, val, col_version, db_version, site_id, cl, seq FROM crsql_changes"
+
+
+def make_db(sparse):
+    c = connect(":memory:")
+    if sparse:
+        c.execute("SELECT crsql_config_set('sparse-clocks', 1)")
+    c.execute("""CREATE TABLE foo (
+        a INTEGER PRIMARY KEY NOT NULL,
+        b TEXT,
+        c INTEGER NOT NULL DEFAULT 0,
+        d TEXT COLLATE NOCASE DEFAULT 'x',
+        e TEXT DEFAULT CURRENT_TIMESTAMP)""")
+    c.execute("SELECT crsql_as_crr('foo')")
+    c.commit()
+    return c
+
+
+def clock_cids(c, a):
+    return [row[0] for row in c.execute(
+        "SELECT cid FROM crsql_changes WHERE pk = crsql_pack_columns(?) ORDER BY seq", (a,)).fetchall()]
+
+
+def sync(source, target):
+    for change in source.execute(changes_query).fetchall():
+        target.execute(
+            "INSERT INTO crsql_changes VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", change)
+    target.commit()
+
+
+def test_config():
+    c = connect(":memory:")
+    assert (c.execute("SELECT crsql_config_get('sparse-clocks')").fetchone() == (0,))
+    assert (c.execute("SELECT crsql_config_set('sparse-clocks', 1)").fetchone() == (1,))
+    assert (c.execute("SELECT crsql_config_get('sparse-clocks')").fetchone() == (1,))
+    close(c)
+
+
+def test_defaults_skipped():
+    c = make_db(True)
+    c.execute("INSERT INTO foo (a) VALUES (1)")
+    c.execute("INSERT INTO foo (a, b, c) VALUES (2, 'bee', 0)")
+    c.execute("INSERT INTO foo (a, b, c, d) VALUES (3, NULL, 3, 'x')")
+    # equal to the default only through the column's collation
+    c.execute("INSERT INTO foo (a, d) VALUES (4, 'X')")
+    c.commit()
+    # a default that isn't a literal is always recorded
+    assert (clock_cids(c, 1) == ['-1', 'e'])
+    assert (clock_cids(c, 2) == ['-1', 'b', 'e'])
+    assert (clock_cids(c, 3) == ['-1', 'c', 'e'])
+    assert (clock_cids(c, 4) == ['-1', 'd', 'e'])
+
+    c.execute("INSERT INTO foo VALUES (5, 'b', 5, 'd', 'e')")
+    c.commit()
+    # nothing skipped, no sentinel needed
+    assert (clock_cids(c, 5) == ['b', 'c', 'd', 'e'])
+    close(c)
+
+
+def test_alter_keeps_mode():
+    c = make_db(True)
+    c.execute("SELECT crsql_config_set('sparse-clocks', 0)")
+    c.execute("SELECT crsql_begin_alter('foo')")
+    c.execute("ALTER TABLE foo ADD COLUMN f INTEGER DEFAULT 6")
+    c.execute("SELECT crsql_commit_alter('foo')")
+    c.execute("INSERT INTO foo (a) VALUES (1)")
+    c.commit()
+    assert (clock_cids(c, 1) == ['-1', 'e'])
+    close(c)
+
+
+def test_existing_rows_record_every_column():
+    c = make_db(True)
+    c.execute("INSERT INTO foo (a, b, c) VALUES (1, 'b', 1)")
+    c.commit()
+    c.execute("DELETE FROM foo WHERE a = 1")
+    c.commit()
+    c.execute("INSERT INTO foo (a) VALUES (1)")
+    c.commit()
+    assert (clock_cids(c, 1) == ['-1', 'b', 'c', 'd', 'e'])
+
+    c.execute("INSERT INTO foo (a, b) VALUES (2, 'b')")
+    c.commit()
+    c.execute("INSERT OR REPLACE INTO foo (a) VALUES (2)")
+    c.commit()
+    assert (sorted(clock_cids(c, 2)) == ['-1', 'b', 'c', 'd', 'e'])
+    close(c)
+
+
+def test_peers_converge():
+    source = make_db(True)
+    peer = make_db(True)
+    source.execute("INSERT INTO foo (a, b, c, d, e) VALUES (1, 'b', 1, 'd', 'e'), (2, 'b', 2, 'd', 'e')")
+    source.execute("INSERT INTO foo (a, e) VALUES (3, 'e'), (4, 'e')")
+    source.commit()
+    sync(source, peer)
+
+    # later writes reset values the peer already has to their defaults
+    source.execute("DELETE FROM foo WHERE a = 1")
+    source.commit()
+    source.execute("INSERT INTO foo (a, e) VALUES (1, 'e')")
+    source.execute("INSERT OR REPLACE INTO foo (a, e) VALUES (2, 'e')")
+    source.execute("UPDATE foo SET b = 'b', d = 'y' WHERE a = 3")
+    source.commit()
+    sync(source, peer)
+
+    expected = [(1, None, 0, 'x', 'e'), (2, None, 0, 'x', 'e'), (3, 'b', 0, 'y', 'e'), (4, None, 0, 'x', 'e')]
+    assert (source.execute("SELECT * FROM foo ORDER BY a").fetchall() == expected)
+    assert (peer.execute("SELECT * FROM foo ORDER BY a").fetchall() == expected)
+    close(source)
+    close(peer)
+
+
+def test_clock_size():
+    columns = ["c{}".format(i) for i in range(40)]
+    for sparse in [False, True]:
+        c = connect(":memory:")
+        if sparse:
+            c.execute("SELECT crsql_config_set('sparse-clocks', 1)")
+        c.execute("CREATE TABLE wide (id INTEGER PRIMARY KEY NOT NULL, {})".format(
+            ", ".join(columns)))
+        c.execute("SELECT crsql_as_crr('wide')")
+        c.commit()
+        start_time = time.time()
+        for i in range(2_000):
+            c.execute("INSERT INTO wide (id, c0, c1) VALUES (?, ?, ?)", (i, i, "{}".format(i)))
+        c.commit()
+        label = "sparse clocks" if sparse else "every column"
+        print(f"{label}: {2_000 / (time.time() - start_time)} inserts/s")
+        clock_rows = c.execute("SELECT count(*) FROM wide__crsql_clock").fetchone()[0]
+        assert (clock_rows == (3 * 2_000 if sparse else 40 * 2_000))
+        close(c)